@@ -149,6 +149,10 @@ struct CAddressIndexKey {
         spending = false;
     }
 
+    friend bool operator==(const CAddressIndexKey& a, const CAddressIndexKey& b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes && a.blockHeight == b.blockHeight &&
+               a.txindex == b.txindex && a.txhash == b.txhash && a.index == b.index && a.spending == b.spending;
+    }
 };
 
 struct CAddressIndexIteratorKey {
@@ -222,6 +226,39 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Running totals of the address index entries of an address */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    uint64_t txCount;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(VARINT(txCount));
+        READWRITE(lastHeight);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        lastHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (txCount == 0);
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -4,6 +4,7 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
 #include "key.h"
 #include "main.h"
 #include "util.h"
@@ -14,6 +15,7 @@ main(int argc, char** argv)
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::REGTEST);
 
     benchmark::BenchRunner::RunAll();
 
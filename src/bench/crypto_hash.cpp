@@ -7,6 +7,7 @@
 #include "bench.h"
 #include "bloom.h"
 #include "hash.h"
+#include "hashblock.h"
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
@@ -69,6 +70,31 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+/* Number of 80 byte block headers to hash per iteration */
+static const size_t X13_HEADERS = 1000;
+
+static void X13_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(X13_HEADERS * 80, 0);
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < X13_HEADERS; i++) {
+            in[i * 80] = i & 0xff;
+            hash = Hash9(in.begin() + i * 80, in.begin() + (i + 1) * 80);
+        }
+    }
+}
+
+static void X13Batch_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(X13_HEADERS * 80, 0);
+    std::vector<uint256> hashes(X13_HEADERS);
+    for (size_t i = 0; i < X13_HEADERS; i++)
+        in[i * 80] = i & 0xff;
+    while (state.KeepRunning())
+        HashX13Batch(begin_ptr(in), 80, X13_HEADERS, begin_ptr(hashes));
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
@@ -76,3 +102,6 @@ BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+
+BENCHMARK(X13_80b);
+BENCHMARK(X13Batch_80b);
@@ -0,0 +1,203 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/cfund.h"
+#include "kernel.h"
+#include "main.h"
+#include "pos.h"
+#include "random.h"
+
+#include <vector>
+
+// Proof-of-stake benchmarks on a synthetic chain. They run with the regtest
+// parameters selected in bench_navcoin.cpp.
+
+static const unsigned int nTimeGenesis = 1500000000;
+
+/**
+ * A chain of nBlocks blocks nTargetSpacing apart, with every other block
+ * staked and stake modifiers computed as ConnectBlock does.
+ */
+class CSyntheticChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    CSyntheticChain(unsigned int nBlocks) : vHashes(nBlocks), vIndex(nBlocks)
+    {
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < nBlocks; i++) {
+            vHashes[i] = GetRandHash();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = nTimeGenesis + i * Params().GetConsensus().nTargetSpacing;
+            vIndex[i].pprev = i == 0 ? NULL : &vIndex[i - 1];
+            vIndex[i].hashProof = UintToArith256(GetRandHash());
+            if (i % 2)
+                vIndex[i].SetProofOfStake();
+            vIndex[i].SetStakeEntropyBit(vHashes[i].GetUint64(0) & 1);
+            vIndex[i].BuildSkip();
+
+            uint64_t nStakeModifier = 0;
+            bool fGeneratedStakeModifier = true;
+            if (i > 0)
+                ComputeNextStakeModifier(vIndex[i].pprev, nStakeModifier, fGeneratedStakeModifier);
+            vIndex[i].SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+        }
+    }
+
+    ~CSyntheticChain()
+    {
+        // The stake modifier window keeps pointers into the chain
+        LOCK(cs_main);
+        stakeModifierWindow.Clear();
+    }
+
+    const CBlockIndex* Tip() const { return &vIndex.back(); }
+};
+
+/**
+ * Staked outputs of a wallet with nInputs coins. With fSkewed, coin values
+ * follow a power law, as in wallets holding a few large and many small coins.
+ */
+static std::vector<CStakeKernelInput> MakeStakeInputs(size_t nInputs, bool fSkewed)
+{
+    std::vector<CStakeKernelInput> vInputs;
+    vInputs.reserve(nInputs);
+    for (size_t i = 0; i < nInputs; i++) {
+        CAmount nValue = fSkewed ? (CAmount)(nInputs / (i + 1)) * 10 * COIN : 1000 * COIN;
+        unsigned int nTimeTxPrev = nTimeGenesis + i % 1000;
+        vInputs.push_back(CStakeKernelInput(COutPoint(GetRandHash(), i % 3), nTimeTxPrev + 30, nTimeTxPrev, nValue));
+    }
+    return vInputs;
+}
+
+// The kernel search of one stake slot over every staked output: the bulk of
+// CreateCoinStake. The target is low enough for the search to visit them all.
+static void StakeKernelSearch(benchmark::State& state, size_t nInputs, bool fSkewed)
+{
+    CSyntheticChain chain(100);
+    CStakeKernelSearch search;
+    search.SetTip(chain.Tip(), 0x1c00ffff);
+    search.SetInputs(MakeStakeInputs(nInputs, fSkewed));
+
+    unsigned int nTime = chain.Tip()->nTime & ~STAKE_TIMESTAMP_MASK;
+    std::vector<unsigned int> vTimes(1);
+    size_t nIndex;
+    unsigned int nTimeFound;
+    while (state.KeepRunning()) {
+        nTime += STAKE_TIMESTAMP_MASK + 1;
+        vTimes[0] = nTime;
+        search.Search(vTimes, nIndex, nTimeFound);
+    }
+}
+
+static void StakeKernelSearch_100(benchmark::State& state) { StakeKernelSearch(state, 100, false); }
+static void StakeKernelSearch_1000(benchmark::State& state) { StakeKernelSearch(state, 1000, false); }
+static void StakeKernelSearch_10000(benchmark::State& state) { StakeKernelSearch(state, 10000, false); }
+static void StakeKernelSearch_10000_Skewed(benchmark::State& state) { StakeKernelSearch(state, 10000, true); }
+
+// The kernel precomputation the staker does on every new tip
+static void StakeKernelNewTip_10000(benchmark::State& state)
+{
+    CSyntheticChain chain(100);
+    std::vector<CStakeKernelInput> vInputs = MakeStakeInputs(10000, false);
+    CStakeKernelSearch search;
+    unsigned int n = 0;
+    while (state.KeepRunning()) {
+        search.SetTip(&chain.vIndex[50 + n++ % 50], 0x1c00ffff);
+        search.SetInputs(vInputs);
+    }
+}
+
+// The proof-of-stake check of a block's coinstake, as CheckProofOfStake
+// queues it
+static void CheckStake(benchmark::State& state)
+{
+    CSyntheticChain chain(100);
+    CBlockIndex* pindexPrev = &chain.vIndex.back();
+
+    CMutableTransaction txPrev;
+    txPrev.nTime = nTimeGenesis;
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 1000 * COIN;
+    txPrev.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CTransaction txPrevConst(txPrev);
+
+    CMutableTransaction txStake;
+    txStake.nTime = (pindexPrev->nTime + Params().GetConsensus().nStakeMinAge) & ~STAKE_TIMESTAMP_MASK;
+    txStake.vin.push_back(CTxIn(txPrevConst.GetHash(), 0));
+    txStake.vout.resize(2);
+    txStake.vout[1].scriptPubKey = txPrev.vout[0].scriptPubKey;
+
+    // Move the coinstake to the first slot whose kernel meets the target, so
+    // the benchmark times the check of a valid block
+    CTransaction txStakeConst(txStake);
+    while (!CStakeCheck(pindexPrev, 0x1c00ffff, nTimeGenesis + 30, txPrev.nTime, txPrev.vout[0], txStakeConst)()) {
+        txStake.nTime += STAKE_TIMESTAMP_MASK + 1;
+        txStakeConst = CTransaction(txStake);
+    }
+
+    while (state.KeepRunning()) {
+        CStakeCheck check(pindexPrev, 0x1c00ffff, nTimeGenesis + 30, txPrev.nTime, txPrev.vout[0], txStakeConst);
+        check();
+    }
+}
+
+// Stake modifiers along a chain, as computed when connecting its blocks
+static void StakeModifierReplay(benchmark::State& state)
+{
+    CSyntheticChain chain(2000);
+    LOCK(cs_main);
+    unsigned int n = 0;
+    uint64_t nStakeModifier;
+    bool fGeneratedStakeModifier;
+    while (state.KeepRunning()) {
+        ComputeNextStakeModifier(&chain.vIndex[1000 + n++ % 1000], nStakeModifier, fGeneratedStakeModifier);
+    }
+}
+
+// Counting the votes of a whole voting cycle again, as CountVotes does after
+// a reorg: every block votes for nProposals proposals and payment requests
+static void CountCycleVotes(benchmark::State& state, unsigned int nCycleLength, unsigned int nProposals)
+{
+    std::vector<uint256> vProposals(nProposals);
+    for (unsigned int i = 0; i < nProposals; i++)
+        vProposals[i] = GetRandHash();
+
+    std::vector<CBlockVotes> vVotes(nCycleLength);
+    for (unsigned int i = 0; i < nCycleLength; i++) {
+        for (unsigned int j = 0; j < nProposals; j++) {
+            if (j % 4 == 3)
+                vVotes[i].vPaymentRequestVotes.push_back(std::make_pair(vProposals[j], (i + j) % 3 != 0));
+            else
+                vVotes[i].vProposalVotes.push_back(std::make_pair(vProposals[j], (i + j) % 3 != 0));
+        }
+    }
+
+    CFund::CVoteTally tally;
+    while (state.KeepRunning()) {
+        tally.SetNull();
+        for (unsigned int i = 0; i < nCycleLength; i++)
+            tally.AddBlock(vVotes[i], 1);
+    }
+}
+
+static void CountVotes_Cycle180(benchmark::State& state) { CountCycleVotes(state, 180, 20); }
+static void CountVotes_Cycle20160(benchmark::State& state) { CountCycleVotes(state, 2880 * 7, 20); }
+
+BENCHMARK(StakeKernelSearch_100);
+BENCHMARK(StakeKernelSearch_1000);
+BENCHMARK(StakeKernelSearch_10000);
+BENCHMARK(StakeKernelSearch_10000_Skewed);
+BENCHMARK(StakeKernelNewTip_10000);
+BENCHMARK(CheckStake);
+BENCHMARK(StakeModifierReplay);
+BENCHMARK(CountVotes_Cycle180);
+BENCHMARK(CountVotes_Cycle20160);
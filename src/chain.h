@@ -215,11 +215,6 @@ public:
     int64_t nCFSupply;
     int64_t nCFLocked;
 
-    std::vector<std::pair<uint256, bool>> vProposalVotes;
-    std::vector<std::pair<uint256, bool>> vPaymentRequestVotes;
-
-    std::string strDZeel;
-
     unsigned int nFlags;  // ppcoin: block index flags
 
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
@@ -260,8 +255,6 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
-        vProposalVotes.clear();
-        vPaymentRequestVotes.clear();
     }
 
     CBlockIndex()
@@ -464,6 +457,37 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 
+/**
+ * Community fund votes cast by a block. They are stored in their own records
+ * next to the block index and not kept in CBlockIndex; see
+ * CBlockTreeDB::ReadBlockVotes.
+ */
+class CBlockVotes
+{
+public:
+    std::vector<std::pair<uint256, bool>> vProposalVotes;
+    std::vector<std::pair<uint256, bool>> vPaymentRequestVotes;
+
+    void SetNull()
+    {
+        vProposalVotes.clear();
+        vPaymentRequestVotes.clear();
+    }
+
+    bool IsNull() const
+    {
+        return vProposalVotes.empty() && vPaymentRequestVotes.empty();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vPaymentRequestVotes);
+        READWRITE(vProposalVotes);
+    }
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -472,16 +496,23 @@ private:
 public:
     uint256 hashPrev;
     uint256 hashNext;
+    //! Votes which older versions stored at the end of the record, only read
+    //! when fLegacyVotes is set (see CBlockTreeDB::BuildBlockVotesIndex). They
+    //! are still written, empty, so that older versions can read the record.
+    CBlockVotes votes;
+    bool fLegacyVotes;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
 	      hashNext = uint256();
         blockHash = uint256();
+        fLegacyVotes = false;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
         hashNext = (pnext ? pnext->GetBlockHash() : uint256());
+        fLegacyVotes = false;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -523,11 +554,11 @@ public:
         READWRITE(blockHash);
         READWRITE(nCFSupply);
         READWRITE(nCFLocked);
-        READWRITE(vPaymentRequestVotes);
-        READWRITE(vProposalVotes);
+        if (fLegacyVotes || !ser_action.ForRead())
+            READWRITE(votes);
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -536,10 +567,14 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
+        return block;
+    }
 
-        const_cast<CDiskBlockIndex*>(this)->blockHash = block.GetHash();
+    uint256 GetBlockHash() const
+    {
+        const_cast<CDiskBlockIndex*>(this)->blockHash = GetBlockHeader().GetHash();
 
-        return block.GetHash();
+        return blockHash;
     }
 
 
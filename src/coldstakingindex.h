@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_COLDSTAKINGINDEX_H
+#define NAVCOIN_COLDSTAKINGINDEX_H
+
+#include "uint256.h"
+#include "amount.h"
+#include "script/script.h"
+
+/** Unspent cold staking output, keyed by the hash of its staking key */
+struct CColdStakingIndexKey {
+    uint160 stakingKey;
+    uint256 txhash;
+    size_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 56;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        stakingKey.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        stakingKey.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+
+    CColdStakingIndexKey(uint160 stakingKeyIn, uint256 txid, size_t indexValue) {
+        stakingKey = stakingKeyIn;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CColdStakingIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        stakingKey.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+struct CColdStakingIndexIteratorKey {
+    uint160 stakingKey;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 20;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        stakingKey.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        stakingKey.Unserialize(s, nType, nVersion);
+    }
+
+    CColdStakingIndexIteratorKey(uint160 stakingKeyIn) {
+        stakingKey = stakingKeyIn;
+    }
+
+    CColdStakingIndexIteratorKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        stakingKey.SetNull();
+    }
+};
+
+struct CColdStakingIndexValue {
+    CAmount satoshis;
+    uint160 spendingKey;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(spendingKey);
+        READWRITE(blockHeight);
+    }
+
+    CColdStakingIndexValue(CAmount sats, uint160 spendingKeyIn, int height) {
+        satoshis = sats;
+        spendingKey = spendingKeyIn;
+        blockHeight = height;
+    }
+
+    CColdStakingIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        satoshis = -1;
+        spendingKey.SetNull();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (satoshis == -1);
+    }
+};
+
+#endif // NAVCOIN_COLDSTAKINGINDEX_H
@@ -6,6 +6,7 @@
 #include "base58.h"
 #include "main.h"
 #include "rpc/server.h"
+#include "txdb.h"
 #include "utilmoneystr.h"
 
 void CFund::SetScriptForCommunityFundContribution(CScript &script)
@@ -48,7 +49,7 @@ bool CFund::FindProposal(uint256 prophash, CFund::CProposal &proposal)
 {
 
     CFund::CProposal temp;
-    if(pblocktree->ReadProposalIndex(prophash, temp)) {
+    if(pcfundstate->ReadProposalIndex(prophash, temp)) {
         proposal = temp;
         return true;
     }
@@ -61,7 +62,7 @@ bool CFund::FindPaymentRequest(uint256 preqhash, CFund::CPaymentRequest &preques
 {
 
     CFund::CPaymentRequest temp;
-    if(pblocktree->ReadPaymentRequestIndex(preqhash, temp)) {
+    if(pcfundstate->ReadPaymentRequestIndex(preqhash, temp)) {
         prequest = temp;
         return true;
     }
@@ -188,8 +189,148 @@ bool CFund::RemoveVotePaymentRequest(uint256 proposalHash)
     return RemoveVotePaymentRequest(proposalHash.ToString());
 }
 
-bool CFund::IsValidPaymentRequest(CTransaction tx, int nMaxVersion)
-{    
+CFund::CTxCheckCache CFund::txCheckCache;
+
+bool CFund::IsValidPaymentRequest(const CTransaction& tx, int nMaxVersion)
+{
+    CTxCheck check(tx);
+    if (!txCheckCache.Get(tx, true, check)) {
+        check.Check(true);
+        txCheckCache.Add(check);
+    }
+    return IsValidPaymentRequest(check, nMaxVersion);
+}
+
+bool CFund::IsValidPaymentRequest(const CTxCheck& check, int nMaxVersion)
+{
+    if (!check.strException.empty())
+        throw std::runtime_error(check.strException);
+
+    if (!check.fValid)
+        return false;
+
+    const CTransaction& tx = *check.ptx;
+    const CPaymentRequest& prequest = check.prequest;
+
+    CFund::CProposal proposal;
+
+    if(!CFund::FindProposal(prequest.proposalhash, proposal) || proposal.fState != CFund::ACCEPTED)
+        return error("%s: Could not find parent proposal %s for payment request %s", __func__, prequest.proposalhash.ToString(),tx.GetHash().ToString());
+
+    CNavCoinAddress addr(proposal.Address);
+    if (!addr.IsValid())
+        return error("%s: Address %s is not valid for payment request %s", __func__, proposal.Address, tx.GetHash().ToString());
+
+    CKeyID keyID;
+    addr.GetKeyID(keyID);
+
+    if (check.signer != keyID)
+        return error("%s: Invalid signature for payment request %s", __func__, tx.GetHash().ToString());
+
+    if(prequest.nAmount > proposal.GetAvailable(true))
+        return error("%s: Invalid requested amount for payment request %s (%d vs %d available)",
+                     __func__, tx.GetHash().ToString(), prequest.nAmount, proposal.GetAvailable());
+
+    bool ret = (prequest.nVersion <= nMaxVersion);
+
+    if(!ret)
+        return error("%s: Invalid version for payment request %s", __func__, tx.GetHash().ToString());
+
+    return prequest.nVersion <= Params().GetConsensus().nPaymentRequestMaxVersion;
+
+}
+
+bool CFund::CPaymentRequest::CanVote() const {
+    CFund::CProposal proposal;
+    if(!CFund::FindProposal(proposalhash, proposal))
+        return false;
+    return nAmount <= proposal.GetAvailable() && fState != ACCEPTED && fState != REJECTED && fState != EXPIRED;
+}
+
+bool CFund::CPaymentRequest::IsExpired() const {
+    if(nVersion >= 2)
+        return ( nVotingCycle > Params().GetConsensus().nCyclesPaymentRequestVoting &&
+                fState != ACCEPTED && fState != REJECTED);
+    return false;
+}
+
+bool CFund::IsValidProposal(const CTransaction& tx, int nMaxVersion)
+{
+    CTxCheck check(tx);
+    if (!txCheckCache.Get(tx, false, check)) {
+        check.Check(false);
+        txCheckCache.Add(check);
+    }
+    return IsValidProposal(check, nMaxVersion);
+}
+
+bool CFund::IsValidProposal(const CTxCheck& check, int nMaxVersion)
+{
+    if (!check.strException.empty())
+        throw std::runtime_error(check.strException);
+
+    if (!check.fValid)
+        return false;
+
+    if (check.proposal.nVersion > nMaxVersion)
+        return error("%s: Wrong strdzeel %s for proposal %s", __func__, check.ptx->strDZeel.c_str(), check.ptx->GetHash().ToString());
+
+    return true;
+}
+
+bool CFund::CTxCheck::operator()()
+{
+    Check(ptx->nVersion == CTransaction::PAYMENT_REQUEST_VERSION);
+    return true;
+}
+
+void CFund::CTxCheck::Check(bool fPaymentRequestIn)
+{
+    fPaymentRequest = fPaymentRequestIn;
+
+    // Reading numbers out of range throws, the contextual checks rethrow
+    // so callers see the same exception as before the split
+    try {
+        fValid = fPaymentRequest ? CheckPaymentRequest() : CheckProposal();
+    } catch (const std::exception& e) {
+        fValid = false;
+        strException = e.what();
+    }
+}
+
+bool CFund::CTxCheckCache::Get(const CTransaction& tx, bool fPaymentRequest, CTxCheck& check)
+{
+    LOCK(cs);
+    std::map<uint256, CTxCheck>::const_iterator it = mapChecks.find(tx.GetHash());
+    if (it == mapChecks.end() || it->second.fPaymentRequest != fPaymentRequest)
+        return false;
+    check = it->second;
+    check.ptx = &tx;
+    return true;
+}
+
+void CFund::CTxCheckCache::Add(const CTxCheck& check)
+{
+    LOCK(cs);
+    const uint256& hash = check.ptx->GetHash();
+    std::pair<std::map<uint256, CTxCheck>::iterator, bool> ret = mapChecks.insert(std::make_pair(hash, check));
+    if (!ret.second) {
+        ret.first->second = check;
+    } else {
+        vKeys.push_back(hash);
+        while (vKeys.size() > nMaxEntries) {
+            mapChecks.erase(vKeys.front());
+            vKeys.pop_front();
+        }
+    }
+    // The transaction may not outlive the entry
+    ret.first->second.ptx = NULL;
+}
+
+bool CFund::CTxCheck::CheckPaymentRequest()
+{
+    const CTransaction& tx = *ptx;
+
     if(tx.strDZeel.length() > 1024)
         return error("%s: Too long strdzeel for payment request %s", __func__, tx.GetHash().ToString());
 
@@ -213,36 +354,25 @@ bool CFund::IsValidPaymentRequest(CTransaction tx, int nMaxVersion)
     if(!(find_value(metadata, "n").isNum() && find_value(metadata, "s").isStr() && find_value(metadata, "h").isStr() && find_value(metadata, "i").isStr()))
         return error("%s: Wrong strdzeel for payment request %s", __func__, tx.GetHash().ToString());
 
-    CAmount nAmount = find_value(metadata, "n").get_int64();
+    prequest.hash = tx.GetHash();
+    prequest.nAmount = find_value(metadata, "n").get_int64();
+    prequest.proposalhash = uint256S("0x" + find_value(metadata, "h").get_str());
+    prequest.strDZeel = find_value(metadata, "i").get_str();
+    prequest.nVersion = find_value(metadata, "v").isNum() ? find_value(metadata, "v").get_int() : 1;
     std::string Signature = find_value(metadata, "s").get_str();
-    std::string Hash = find_value(metadata, "h").get_str();
-    std::string strDZeel = find_value(metadata, "i").get_str();
-    int nVersion = find_value(metadata, "v").isNum() ? find_value(metadata, "v").get_int() : 1;
 
-    if (nAmount < 0) {
+    if (prequest.nAmount < 0) {
          return error("%s: Payment Request cannot have amount less than 0: %s", __func__, tx.GetHash().ToString());
     }
 
-    CFund::CProposal proposal;
-
-    if(!CFund::FindProposal(Hash, proposal) || proposal.fState != CFund::ACCEPTED)
-        return error("%s: Could not find parent proposal %s for payment request %s", __func__, Hash.c_str(),tx.GetHash().ToString());
-
     std::string sRandom = "";
 
-    if (nVersion >= 2 && find_value(metadata, "r").isStr())
+    if (prequest.nVersion >= 2 && find_value(metadata, "r").isStr())
         sRandom = find_value(metadata, "r").get_str();
 
     std::string Secret = sRandom + "I kindly ask to withdraw " +
-            std::to_string(nAmount) + "NAV from the proposal " +
-            proposal.hash.ToString() + ". Payment request id: " + strDZeel;
-
-    CNavCoinAddress addr(proposal.Address);
-    if (!addr.IsValid())
-        return error("%s: Address %s is not valid for payment request %s", __func__, proposal.Address, Hash.c_str(), tx.GetHash().ToString());
-
-    CKeyID keyID;
-    addr.GetKeyID(keyID);
+            std::to_string(prequest.nAmount) + "NAV from the proposal " +
+            prequest.proposalhash.ToString() + ". Payment request id: " + prequest.strDZeel;
 
     bool fInvalid = false;
     std::vector<unsigned char> vchSig = DecodeBase64(Signature.c_str(), &fInvalid);
@@ -255,38 +385,18 @@ bool CFund::IsValidPaymentRequest(CTransaction tx, int nMaxVersion)
     ss << Secret;
 
     CPubKey pubkey;
-    if (!pubkey.RecoverCompact(ss.GetHash(), vchSig) || pubkey.GetID() != keyID)
+    if (!pubkey.RecoverCompact(ss.GetHash(), vchSig))
         return error("%s: Invalid signature for payment request %s", __func__, tx.GetHash().ToString());
 
-    if(nAmount > proposal.GetAvailable(true))
-        return error("%s: Invalid requested amount for payment request %s (%d vs %d available)",
-                     __func__, tx.GetHash().ToString(), nAmount, proposal.GetAvailable());
-    
-    bool ret = (nVersion <= nMaxVersion);
-
-    if(!ret)
-        return error("%s: Invalid version for payment request %s", __func__, tx.GetHash().ToString());
-
-    return nVersion <= Params().GetConsensus().nPaymentRequestMaxVersion;
-
-}
-
-bool CFund::CPaymentRequest::CanVote() const {
-    CFund::CProposal proposal;
-    if(!CFund::FindProposal(proposalhash, proposal))
-        return false;
-    return nAmount <= proposal.GetAvailable() && fState != ACCEPTED && fState != REJECTED && fState != EXPIRED;
-}
+    signer = pubkey.GetID();
 
-bool CFund::CPaymentRequest::IsExpired() const {
-    if(nVersion >= 2)
-        return ( nVotingCycle > Params().GetConsensus().nCyclesPaymentRequestVoting &&
-                fState != ACCEPTED && fState != REJECTED);
-    return false;
+    return true;
 }
 
-bool CFund::IsValidProposal(CTransaction tx, int nMaxVersion)
+bool CFund::CTxCheck::CheckProposal()
 {
+    const CTransaction& tx = *ptx;
+
     if(tx.strDZeel.length() > 1024)
         return error("%s: Too long strdzeel for proposal %s", __func__, tx.GetHash().ToString());
 
@@ -322,26 +432,35 @@ bool CFund::IsValidProposal(CTransaction tx, int nMaxVersion)
     CAmount nContribution = 0;
     int nVersion = find_value(metadata, "v").isNum() ? find_value(metadata, "v").get_int() : 1;
 
+    proposal.hash = tx.GetHash();
+    proposal.nAmount = nAmount;
+    proposal.Address = Address;
+    proposal.nDeadline = nDeadline;
+    proposal.strDZeel = find_value(metadata, "s").get_str();
+    proposal.nVersion = nVersion;
+
     CNavCoinAddress address(Address);
     if (!address.IsValid())
         return error("%s: Wrong address %s for proposal %s", __func__, Address.c_str(), tx.GetHash().ToString());
 
     for(unsigned int i=0;i<tx.vout.size();i++)
-        if(tx.vout[i].IsCommunityFundContribution())
+        if(tx.vout[i].IsCommunityFundContribution()) {
+            fContribution = true;
             nContribution +=tx.vout[i].nValue;
+        }
+
+    proposal.nFee = nContribution;
 
     bool ret = (nContribution >= Params().GetConsensus().nProposalMinimalFee &&
             Address != "" &&
             nAmount < MAX_MONEY &&
             nAmount > 0 &&
-            nDeadline > 0 &&
-            nVersion <= nMaxVersion);
+            nDeadline > 0);
 
     if (!ret)
         return error("%s: Wrong strdzeel %s for proposal %s", __func__, tx.strDZeel.c_str(), tx.GetHash().ToString());
 
     return true;
-
 }
 
 bool CFund::CPaymentRequest::IsAccepted() const {
@@ -451,3 +570,273 @@ void CFund::CPaymentRequest::ToJson(UniValue& ret) const {
         ret.push_back(Pair("paidOnBlock", paymenthash.ToString()));
     }
 }
+
+CFund::CStateCache::CStateCache(CBlockTreeDB* pdbIn) : pdb(pdbIn)
+{
+}
+
+bool CFund::CStateCache::Load()
+{
+    LOCK(cs);
+
+    mapProposals.clear();
+    mapPaymentRequests.clear();
+    mapProposalsByState.clear();
+    mapPaymentRequestsByState.clear();
+    mapProposalsByAddress.clear();
+    setDirtyProposals.clear();
+    setDirtyPaymentRequests.clear();
+
+    std::vector<CProposal> vProposals;
+    if (!pdb->GetProposalIndex(vProposals))
+        return false;
+    for (unsigned int i = 0; i < vProposals.size(); i++)
+        SetProposal(vProposals[i].hash, vProposals[i]);
+
+    std::vector<CPaymentRequest> vPaymentRequests;
+    if (!pdb->GetPaymentRequestIndex(vPaymentRequests))
+        return false;
+    for (unsigned int i = 0; i < vPaymentRequests.size(); i++)
+        SetPaymentRequest(vPaymentRequests[i].hash, vPaymentRequests[i]);
+
+    // Nothing to write back yet
+    setDirtyProposals.clear();
+    setDirtyPaymentRequests.clear();
+
+    voteTally.SetNull();
+    pdb->ReadVoteTally(voteTally);
+    cycleStats.SetNull();
+
+    LogPrint("cfund", "Loaded %u proposals and %u payment requests\n", mapProposals.size(), mapPaymentRequests.size());
+
+    return true;
+}
+
+void CFund::CStateCache::SetProposal(const uint256& hash, const CProposal& proposal)
+{
+    std::map<uint256, CProposal>::iterator it = mapProposals.find(hash);
+    if (it != mapProposals.end()) {
+        mapProposalsByState[it->second.fState].erase(hash);
+        std::map<std::string, std::set<uint256> >::iterator mi = mapProposalsByAddress.find(it->second.Address);
+        if (mi != mapProposalsByAddress.end()) {
+            mi->second.erase(hash);
+            if (mi->second.empty())
+                mapProposalsByAddress.erase(mi);
+        }
+        if (proposal.IsNull())
+            mapProposals.erase(it);
+        else
+            it->second = proposal;
+    } else if (!proposal.IsNull()) {
+        mapProposals.insert(std::make_pair(hash, proposal));
+    }
+    if (!proposal.IsNull()) {
+        mapProposalsByState[proposal.fState].insert(hash);
+        mapProposalsByAddress[proposal.Address].insert(hash);
+    }
+    setDirtyProposals.insert(hash);
+}
+
+void CFund::CStateCache::SetPaymentRequest(const uint256& hash, const CPaymentRequest& prequest)
+{
+    std::map<uint256, CPaymentRequest>::iterator it = mapPaymentRequests.find(hash);
+    if (it != mapPaymentRequests.end()) {
+        mapPaymentRequestsByState[it->second.fState].erase(hash);
+        if (prequest.IsNull())
+            mapPaymentRequests.erase(it);
+        else
+            it->second = prequest;
+    } else if (!prequest.IsNull()) {
+        mapPaymentRequests.insert(std::make_pair(hash, prequest));
+    }
+    if (!prequest.IsNull())
+        mapPaymentRequestsByState[prequest.fState].insert(hash);
+    setDirtyPaymentRequests.insert(hash);
+}
+
+bool CFund::CStateCache::ReadProposalIndex(const uint256& proposalid, CProposal& proposal) const
+{
+    LOCK(cs);
+    std::map<uint256, CProposal>::const_iterator it = mapProposals.find(proposalid);
+    if (it == mapProposals.end())
+        return false;
+    proposal = it->second;
+    return true;
+}
+
+bool CFund::CStateCache::ReadPaymentRequestIndex(const uint256& prequestid, CPaymentRequest& prequest) const
+{
+    LOCK(cs);
+    std::map<uint256, CPaymentRequest>::const_iterator it = mapPaymentRequests.find(prequestid);
+    if (it == mapPaymentRequests.end())
+        return false;
+    prequest = it->second;
+    return true;
+}
+
+bool CFund::CStateCache::UpdateProposalIndex(const std::vector<std::pair<uint256, CProposal> >& vect)
+{
+    LOCK(cs);
+    for (std::vector<std::pair<uint256, CProposal> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        SetProposal(it->first, it->second);
+    return true;
+}
+
+bool CFund::CStateCache::UpdatePaymentRequestIndex(const std::vector<std::pair<uint256, CPaymentRequest> >& vect)
+{
+    LOCK(cs);
+    for (std::vector<std::pair<uint256, CPaymentRequest> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        SetPaymentRequest(it->first, it->second);
+    return true;
+}
+
+bool CFund::CStateCache::GetProposalIndex(std::vector<CProposal>& vect) const
+{
+    {
+        LOCK(cs);
+        vect.reserve(vect.size() + mapProposals.size());
+        for (std::map<uint256, CProposal>::const_iterator it = mapProposals.begin(); it != mapProposals.end(); it++)
+            vect.push_back(it->second);
+    }
+
+    // The map iterates in the key order of the database, so sorting yields
+    // the same order as CBlockTreeDB::GetProposalIndex
+    std::sort(vect.begin(), vect.end(), make_member_comparer<std::greater>(&CProposal::nFee));
+
+    return true;
+}
+
+bool CFund::CStateCache::GetPaymentRequestIndex(std::vector<CPaymentRequest>& vect) const
+{
+    LOCK(cs);
+    vect.reserve(vect.size() + mapPaymentRequests.size());
+    for (std::map<uint256, CPaymentRequest>::const_iterator it = mapPaymentRequests.begin(); it != mapPaymentRequests.end(); it++)
+        vect.push_back(it->second);
+    return true;
+}
+
+bool CFund::CStateCache::GetProposalsByState(flags state, std::vector<CProposal>& vect) const
+{
+    {
+        LOCK(cs);
+        std::map<flags, std::set<uint256> >::const_iterator mi = mapProposalsByState.find(state);
+        if (mi != mapProposalsByState.end())
+            for (std::set<uint256>::const_iterator it = mi->second.begin(); it != mi->second.end(); it++)
+                vect.push_back(mapProposals.find(*it)->second);
+    }
+
+    std::sort(vect.begin(), vect.end(), make_member_comparer<std::greater>(&CProposal::nFee));
+
+    return true;
+}
+
+bool CFund::CStateCache::GetPaymentRequestsByState(flags state, std::vector<CPaymentRequest>& vect) const
+{
+    LOCK(cs);
+    std::map<flags, std::set<uint256> >::const_iterator mi = mapPaymentRequestsByState.find(state);
+    if (mi != mapPaymentRequestsByState.end())
+        for (std::set<uint256>::const_iterator it = mi->second.begin(); it != mi->second.end(); it++)
+            vect.push_back(mapPaymentRequests.find(*it)->second);
+    return true;
+}
+
+bool CFund::CStateCache::GetProposalsByStates(const std::set<flags>& states, std::vector<CProposal>& vect) const
+{
+    {
+        LOCK(cs);
+        for (std::set<flags>::const_iterator st = states.begin(); st != states.end(); st++) {
+            std::map<flags, std::set<uint256> >::const_iterator mi = mapProposalsByState.find(*st);
+            if (mi != mapProposalsByState.end())
+                for (std::set<uint256>::const_iterator it = mi->second.begin(); it != mi->second.end(); it++)
+                    vect.push_back(mapProposals.find(*it)->second);
+        }
+    }
+
+    std::sort(vect.begin(), vect.end(), make_member_comparer<std::greater>(&CProposal::nFee));
+
+    return true;
+}
+
+bool CFund::CStateCache::GetProposalsByAddress(const std::string& address, std::vector<CProposal>& vect) const
+{
+    {
+        LOCK(cs);
+        std::map<std::string, std::set<uint256> >::const_iterator mi = mapProposalsByAddress.find(address);
+        if (mi != mapProposalsByAddress.end())
+            for (std::set<uint256>::const_iterator it = mi->second.begin(); it != mi->second.end(); it++)
+                vect.push_back(mapProposals.find(*it)->second);
+    }
+
+    std::sort(vect.begin(), vect.end(), make_member_comparer<std::greater>(&CProposal::nFee));
+
+    return true;
+}
+
+void CFund::CStateCache::GetDirty(std::vector<std::pair<uint256, CProposal> >& vProposals,
+                                  std::vector<std::pair<uint256, CPaymentRequest> >& vPaymentRequests) const
+{
+    LOCK(cs);
+
+    vProposals.reserve(setDirtyProposals.size());
+    for (std::set<uint256>::const_iterator it = setDirtyProposals.begin(); it != setDirtyProposals.end(); it++) {
+        std::map<uint256, CProposal>::const_iterator mi = mapProposals.find(*it);
+        vProposals.push_back(std::make_pair(*it, mi != mapProposals.end() ? mi->second : CProposal()));
+    }
+
+    vPaymentRequests.reserve(setDirtyPaymentRequests.size());
+    for (std::set<uint256>::const_iterator it = setDirtyPaymentRequests.begin(); it != setDirtyPaymentRequests.end(); it++) {
+        std::map<uint256, CPaymentRequest>::const_iterator mi = mapPaymentRequests.find(*it);
+        vPaymentRequests.push_back(std::make_pair(*it, mi != mapPaymentRequests.end() ? mi->second : CPaymentRequest()));
+    }
+}
+
+void CFund::CStateCache::ClearDirty()
+{
+    LOCK(cs);
+    setDirtyProposals.clear();
+    setDirtyPaymentRequests.clear();
+}
+
+bool CFund::CStateCache::GetCycleStats(CCycleStats& stats) const
+{
+    LOCK(cs);
+    if (cycleStats.IsNull())
+        return false;
+    stats = cycleStats;
+    return true;
+}
+
+void CFund::CStateCache::SetCycleStats(const CCycleStats& stats)
+{
+    LOCK(cs);
+    cycleStats = stats;
+}
+
+void CFund::CVoteTally::AddBlock(const CBlockVotes& votes, int nSign)
+{
+    std::set<uint256> setSeen;
+
+    for (unsigned int i = 0; i < votes.vProposalVotes.size(); i++) {
+        if (!setSeen.insert(votes.vProposalVotes[i].first).second)
+            continue;
+        std::pair<int, int>& count = mapProposalVotes[votes.vProposalVotes[i].first];
+        if (votes.vProposalVotes[i].second)
+            count.first += nSign;
+        else
+            count.second += nSign;
+        if (count.first == 0 && count.second == 0)
+            mapProposalVotes.erase(votes.vProposalVotes[i].first);
+    }
+
+    for (unsigned int i = 0; i < votes.vPaymentRequestVotes.size(); i++) {
+        if (!setSeen.insert(votes.vPaymentRequestVotes[i].first).second)
+            continue;
+        std::pair<int, int>& count = mapPaymentRequestVotes[votes.vPaymentRequestVotes[i].first];
+        if (votes.vPaymentRequestVotes[i].second)
+            count.first += nSign;
+        else
+            count.second += nSign;
+        if (count.first == 0 && count.second == 0)
+            mapPaymentRequestVotes.erase(votes.vPaymentRequestVotes[i].first);
+    }
+}
@@ -6,14 +6,24 @@
 #define NAVCOIN_CFUND_H
 
 #include "amount.h"
+#include "pubkey.h"
 #include "script/script.h"
 #include "serialize.h"
+#include "sync.h"
 #include "tinyformat.h"
 #include "univalue/include/univalue.h"
 #include "uint256.h"
 
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
 using namespace std;
 
+class CBlockIndex;
+class CBlockTreeDB;
+class CBlockVotes;
 class CTransaction;
 
 extern std::vector<std::pair<std::string, bool>> vAddedProposalVotes;
@@ -23,6 +33,7 @@ namespace CFund {
 
 class CProposal;
 class CPaymentRequest;
+class CTxCheck;
 
 typedef unsigned int flags;
 
@@ -48,8 +59,11 @@ bool VotePaymentRequest(string strProp, bool vote, bool &duplicate);
 bool VotePaymentRequest(uint256 proposalHash, bool vote, bool &duplicate);
 bool RemoveVotePaymentRequest(string strProp);
 bool RemoveVotePaymentRequest(uint256 proposalHash);
-bool IsValidPaymentRequest(CTransaction tx, int nMaxVersion);
-bool IsValidProposal(CTransaction tx, int nMaxVersion);
+bool IsValidPaymentRequest(const CTransaction& tx, int nMaxVersion);
+bool IsValidProposal(const CTransaction& tx, int nMaxVersion);
+/** Contextual part of the checks above, for a CTxCheck which already ran */
+bool IsValidPaymentRequest(const CTxCheck& check, int nMaxVersion);
+bool IsValidProposal(const CTxCheck& check, int nMaxVersion);
 
 class CPaymentRequest
 {
@@ -344,6 +358,216 @@ public:
 
 };
 
+/**
+ * Closure representing the context-free part of the validation of a proposal
+ * or payment request transaction: reading its strDZeel and, for a payment
+ * request, recovering the key which signed the withdrawal message. The
+ * contextual part (IsValidProposal, IsValidPaymentRequest) only compares the
+ * results with the community fund state, so ConnectBlock can queue the
+ * closure with the block's script checks. It never fails the queue, the
+ * outcome is kept in fValid.
+ */
+class CTxCheck
+{
+public:
+    const CTransaction* ptx;
+    bool fPaymentRequest;
+    bool fValid;
+    bool fContribution;
+    //! Proposal read from the strDZeel, with nFee set to the contributed amount
+    CProposal proposal;
+    //! Payment request read from the strDZeel
+    CPaymentRequest prequest;
+    //! Key which signed the payment request
+    CKeyID signer;
+    //! Set when reading the strDZeel threw
+    std::string strException;
+
+    CTxCheck() : ptx(NULL), fPaymentRequest(false), fValid(false), fContribution(false) {}
+    explicit CTxCheck(const CTransaction& txIn) : ptx(&txIn), fPaymentRequest(false), fValid(false), fContribution(false) {}
+
+    //! Checks ptx as a proposal or a payment request depending on its version
+    bool operator()();
+    void Check(bool fPaymentRequestIn);
+
+private:
+    bool CheckProposal();
+    bool CheckPaymentRequest();
+};
+
+/**
+ * Results of recent CTxCheck runs by transaction hash, so the strDZeel of a
+ * proposal or payment request is read once for the mempool, ConnectBlock
+ * and DisconnectBlock. The hash commits to the strDZeel, so entries never
+ * go stale; the oldest ones are dropped first.
+ */
+class CTxCheckCache
+{
+private:
+    CCriticalSection cs;
+    std::map<uint256, CTxCheck> mapChecks;
+    std::deque<uint256> vKeys;
+
+public:
+    static const size_t nMaxEntries = 2000;
+
+    /** Fill check with the cached results for tx, checked as a payment request or as a proposal */
+    bool Get(const CTransaction& tx, bool fPaymentRequest, CTxCheck& check);
+    void Add(const CTxCheck& check);
+};
+
+extern CTxCheckCache txCheckCache;
+
+/**
+ * Running vote counts of the current voting cycle, up to and including
+ * hashBlock. Every block counts the first vote it carries for each proposal
+ * or payment request; entries without votes are dropped. Proposals and
+ * payment requests which can not be voted are only filtered out when the
+ * counts are applied (see CountVotes).
+ */
+class CVoteTally
+{
+public:
+    uint256 hashBlock;
+    std::map<uint256, std::pair<int, int> > mapProposalVotes;
+    std::map<uint256, std::pair<int, int> > mapPaymentRequestVotes;
+
+    CVoteTally() { SetNull(); }
+
+    void SetNull() {
+        hashBlock = uint256();
+        mapProposalVotes.clear();
+        mapPaymentRequestVotes.clear();
+    }
+
+    bool IsNull() const {
+        return hashBlock.IsNull();
+    }
+
+    /** Add (nSign = 1) or remove (nSign = -1) the votes of a block */
+    void AddBlock(const CBlockVotes& votes, int nSign);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(mapProposalVotes);
+        READWRITE(mapPaymentRequestVotes);
+    }
+};
+
+/** Votes of one proposal or payment request in a CCycleStats snapshot */
+struct CCycleVotes
+{
+    uint256 hash;
+    std::string strDZeel;
+    std::string strProposalDZeel; //! Payment requests only
+    CAmount nAmount;
+    int nVotesYes;
+    int nVotesNo;
+};
+
+/**
+ * Snapshot of the current voting cycle at the tip, as reported by
+ * cfundstats. Taken by CountVotes, so readers need no cs_main.
+ */
+class CCycleStats
+{
+public:
+    int nHeight;
+    CAmount nCFSupply;
+    CAmount nCFLocked;
+    std::vector<CCycleVotes> vProposals;
+    std::vector<CCycleVotes> vPaymentRequests;
+
+    CCycleStats() { SetNull(); }
+
+    void SetNull() {
+        nHeight = -1;
+        nCFSupply = 0;
+        nCFLocked = 0;
+        vProposals.clear();
+        vPaymentRequests.clear();
+    }
+
+    bool IsNull() const {
+        return nHeight == -1;
+    }
+};
+
+/**
+ * In-memory state of the community fund.
+ *
+ * Holds every proposal and payment request together with secondary indexes
+ * by state and proposals by payment address, and is the authoritative copy
+ * while the node runs. The secondary indexes are rebuilt on Load. Changes are
+ * only tracked as dirty entries and are written to the block tree database
+ * in the same batch as the block index when the chain state is flushed (see
+ * FlushStateToDisk). Null entries are erased, as the database index does.
+ */
+class CStateCache
+{
+private:
+    mutable CCriticalSection cs;
+    CBlockTreeDB* pdb;
+
+    std::map<uint256, CProposal> mapProposals;
+    std::map<uint256, CPaymentRequest> mapPaymentRequests;
+    std::map<flags, std::set<uint256> > mapProposalsByState;
+    std::map<flags, std::set<uint256> > mapPaymentRequestsByState;
+    std::map<std::string, std::set<uint256> > mapProposalsByAddress;
+    std::set<uint256> setDirtyProposals;
+    std::set<uint256> setDirtyPaymentRequests;
+    CVoteTally voteTally;
+    CCycleStats cycleStats;
+
+    void SetProposal(const uint256& hash, const CProposal& proposal);
+    void SetPaymentRequest(const uint256& hash, const CPaymentRequest& prequest);
+
+public:
+    CStateCache(CBlockTreeDB* pdbIn);
+
+    /** Read the whole proposal and payment request indexes from the database */
+    bool Load();
+
+    bool ReadProposalIndex(const uint256& proposalid, CProposal& proposal) const;
+    bool ReadPaymentRequestIndex(const uint256& prequestid, CPaymentRequest& prequest) const;
+
+    /** Same semantics as the database updates: null entries are erased */
+    bool UpdateProposalIndex(const std::vector<std::pair<uint256, CProposal> >& vect);
+    bool UpdatePaymentRequestIndex(const std::vector<std::pair<uint256, CPaymentRequest> >& vect);
+
+    /** All proposals, sorted by fee in the same order as CBlockTreeDB::GetProposalIndex */
+    bool GetProposalIndex(std::vector<CProposal>& vect) const;
+    /** All payment requests, in database key order */
+    bool GetPaymentRequestIndex(std::vector<CPaymentRequest>& vect) const;
+
+    /** Proposals and payment requests whose fState is state, in the same order as above */
+    bool GetProposalsByState(flags state, std::vector<CProposal>& vect) const;
+    bool GetPaymentRequestsByState(flags state, std::vector<CPaymentRequest>& vect) const;
+    /** Proposals whose fState is any of states, sorted by fee */
+    bool GetProposalsByStates(const std::set<flags>& states, std::vector<CProposal>& vect) const;
+
+    /** Proposals paying to address, sorted by fee */
+    bool GetProposalsByAddress(const std::string& address, std::vector<CProposal>& vect) const;
+
+    /** Vote counts of the current cycle, written back with every flush (protected by cs_main) */
+    CVoteTally& GetVoteTally() { return voteTally; }
+
+    /** Snapshot of the current voting cycle, false until the first one is set */
+    bool GetCycleStats(CCycleStats& stats) const;
+    void SetCycleStats(const CCycleStats& stats);
+
+    /** Entries changed since the last flush, null ones have to be erased */
+    void GetDirty(std::vector<std::pair<uint256, CProposal> >& vProposals,
+                  std::vector<std::pair<uint256, CPaymentRequest> >& vPaymentRequests) const;
+    void ClearDirty();
+};
+
 }
 
+/** Global variable that points to the community fund state (protected by cs_main) */
+extern CFund::CStateCache *pcfundstate;
+
 #endif // NAVCOIN_CFUND_H
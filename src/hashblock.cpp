@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hashblock.h"
+
+#include "sph_blake.h"
+#include "sph_bmw.h"
+#include "sph_groestl.h"
+#include "sph_jh.h"
+#include "sph_keccak.h"
+#include "sph_skein.h"
+#include "sph_luffa.h"
+#include "sph_cubehash.h"
+#include "sph_shavite.h"
+#include "sph_simd.h"
+#include "sph_echo.h"
+#include "sph_hamsi.h"
+#include "sph_fugue.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+/** Contexts of the 13 X13 stages */
+struct CX13Context
+{
+    sph_blake512_context     blake;
+    sph_bmw512_context       bmw;
+    sph_groestl512_context   groestl;
+    sph_jh512_context        jh;
+    sph_keccak512_context    keccak;
+    sph_skein512_context     skein;
+    sph_luffa512_context     luffa;
+    sph_cubehash512_context  cubehash;
+    sph_shavite512_context   shavite;
+    sph_simd512_context      simd;
+    sph_echo512_context      echo;
+    sph_hamsi512_context     hamsi;
+    sph_fugue512_context     fugue;
+
+    CX13Context()
+    {
+        sph_blake512_init(&blake);
+        sph_bmw512_init(&bmw);
+        sph_groestl512_init(&groestl);
+        sph_jh512_init(&jh);
+        sph_keccak512_init(&keccak);
+        sph_skein512_init(&skein);
+        sph_luffa512_init(&luffa);
+        sph_cubehash512_init(&cubehash);
+        sph_shavite512_init(&shavite);
+        sph_simd512_init(&simd);
+        sph_echo512_init(&echo);
+        sph_hamsi512_init(&hamsi);
+        sph_fugue512_init(&fugue);
+    }
+};
+
+/** Freshly initialized contexts, copied instead of running every init function per hash */
+const CX13Context& InitialContext()
+{
+    static const CX13Context context;
+    return context;
+}
+
+/** Run one stage over nCount lanes, rehashing the 512 bit output of the previous stage */
+#define X13_STAGE(name, in, out) \
+    for (size_t i = 0; i < nCount; i++) { \
+        memcpy(&ctx.name, &init.name, sizeof(ctx.name)); \
+        sph_##name##512(&ctx.name, static_cast<const void*>(&in[i]), 64); \
+        sph_##name##512_close(&ctx.name, static_cast<void*>(&out[i])); \
+    }
+
+/** Hash up to X13_BATCH_SIZE messages stage by stage */
+void HashX13Lanes(const unsigned char* pdata, size_t nLen, size_t nCount, uint256* phashes)
+{
+    static const unsigned char pblank[1] = {0};
+    const CX13Context& init = InitialContext();
+    CX13Context ctx;
+    uint512 a[X13_BATCH_SIZE], b[X13_BATCH_SIZE];
+
+    for (size_t i = 0; i < nCount; i++) {
+        memcpy(&ctx.blake, &init.blake, sizeof(ctx.blake));
+        sph_blake512(&ctx.blake, nLen ? static_cast<const void*>(pdata + i * nLen) : pblank, nLen);
+        sph_blake512_close(&ctx.blake, static_cast<void*>(&a[i]));
+    }
+
+    X13_STAGE(bmw, a, b);
+    X13_STAGE(groestl, b, a);
+    X13_STAGE(skein, a, b);
+    X13_STAGE(jh, b, a);
+    X13_STAGE(keccak, a, b);
+    X13_STAGE(luffa, b, a);
+    X13_STAGE(cubehash, a, b);
+    X13_STAGE(shavite, b, a);
+    X13_STAGE(simd, a, b);
+    X13_STAGE(echo, b, a);
+    X13_STAGE(hamsi, a, b);
+    X13_STAGE(fugue, b, a);
+
+    for (size_t i = 0; i < nCount; i++)
+        phashes[i] = a[i].trim256();
+}
+
+#undef X13_STAGE
+
+} // anon namespace
+
+uint256 HashX13(const void* pdata, size_t nLen)
+{
+    uint256 hash;
+    HashX13Lanes(static_cast<const unsigned char*>(pdata), nLen, 1, &hash);
+    return hash;
+}
+
+void HashX13Batch(const unsigned char* pdata, size_t nLen, size_t nCount, uint256* phashes)
+{
+    for (size_t n = 0; n < nCount; n += X13_BATCH_SIZE)
+        HashX13Lanes(pdata + n * nLen, nLen, std::min(nCount - n, X13_BATCH_SIZE), phashes + n);
+}
@@ -108,17 +108,41 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 static float fBootstrapProgress = 0.0;
 
+/** Number of times an interrupted bootstrap download is resumed */
+static const int BOOTSTRAP_MAX_RESUMES = 10;
+
+/** State of a streamed bootstrap download */
+struct CBootstrapDownload
+{
+    CURL *curl;
+    CBootstrapStream *pstream;
+    //! Offset the current request asked the server to start from
+    curl_off_t nResumeFrom;
+    //! Bytes to drop because the server ignored the range of the request
+    curl_off_t nSkip;
+    //! Whether the response of the current request has been checked
+    bool fResponseChecked;
+};
+
 static int xferinfo(void *p,
                     curl_off_t dltotal, curl_off_t dlnow,
                     curl_off_t ultotal, curl_off_t ulnow)
 {
+    CBootstrapDownload *pdownload = (CBootstrapDownload*)p;
+    if (dltotal <= 0)
+        return 0;
+
+    // Resumed requests only report the remainder of the archive
+    dltotal += pdownload->nResumeFrom;
+    dlnow += pdownload->nResumeFrom;
+
     float fProgress = (float)dlnow/(float)dltotal*100.0f;
     if (fProgress == fBootstrapProgress)
         return 0;
 
     uiInterface.InitMessage(strprintf("[BOOTSTRAP] Downloaded %" CURL_FORMAT_CURL_OFF_T "MB of %" CURL_FORMAT_CURL_OFF_T
                                       "MB  (%.2f%%)",
-                                      dlnow/(1024*1024), dltotal/(1024*1024), (float)dlnow/(float)dltotal*100.0f));
+                                      dlnow/(1024*1024), dltotal/(1024*1024), fProgress));
     fprintf(stdout, "[BOOTSTRAP] Downloaded %" CURL_FORMAT_CURL_OFF_T "MB of %" CURL_FORMAT_CURL_OFF_T
             "MB  (%.2f%%)    \r",
             dlnow/(1024*1024), dltotal/(1024*1024), fProgress);
@@ -128,10 +152,49 @@ static int xferinfo(void *p,
     return 0;
 }
 
-size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-    size_t written;
-    written = fwrite(ptr, size, nmemb, stream);
-    return written;
+/** Hand the downloaded data straight to the extractor, there is no temporary archive */
+static size_t write_bootstrap(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    CBootstrapDownload *pdownload = (CBootstrapDownload*)userdata;
+    const char *pch = (const char*)ptr;
+    size_t nSize = size * nmemb;
+
+    if (!pdownload->fResponseChecked)
+    {
+        pdownload->fResponseChecked = true;
+        long nCode = 0;
+        curl_easy_getinfo(pdownload->curl, CURLINFO_RESPONSE_CODE, &nCode);
+        // A server without range support sends the archive from the start again
+        if (pdownload->nResumeFrom > 0 && nCode == 200)
+            pdownload->nSkip = pdownload->nResumeFrom;
+    }
+
+    size_t nDrop = (size_t)std::min((curl_off_t)nSize, pdownload->nSkip);
+    pdownload->nSkip -= nDrop;
+    if (nDrop == nSize)
+        return nSize;
+
+    // Returning less than nSize aborts the transfer
+    if (!pdownload->pstream->Write(pch + nDrop, nSize - nDrop))
+        return 0;
+
+    return nSize;
+}
+
+static bool IsBootstrapResumable(CURLcode res)
+{
+    switch (res)
+    {
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+        return true;
+    default:
+        return false;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -236,6 +299,8 @@ void Shutdown()
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(false);
+    BOOST_FOREACH(CWallet* pwallet, vpwalletStaking)
+        pwallet->Flush(false);
 #endif
     StopNode();
     StopTorControl();
@@ -263,12 +328,16 @@ void Shutdown()
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        delete pcfundstate;
+        pcfundstate = NULL;
         delete pblocktree;
         pblocktree = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(true);
+    BOOST_FOREACH(CWallet* pwallet, vpwalletStaking)
+        pwallet->Flush(true);
 #endif
 
 #if ENABLE_ZMQ
@@ -290,6 +359,9 @@ void Shutdown()
 #ifdef ENABLE_WALLET
     delete pwalletMain;
     pwalletMain = NULL;
+    BOOST_FOREACH(CWallet* pwallet, vpwalletStaking)
+        delete pwallet;
+    vpwalletStaking.clear();
 #endif
     globalVerifyHandle.reset();
     ECC_Stop();
@@ -350,6 +422,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-bootstrap=<url>", _("Specifies an URL from where a bootstrapped copy of the blockchain would be downloaded"));
+    strUsage += HelpMessageOpt("-bootstrapsha256=<hex>", _("Expected SHA256 checksum of the -bootstrap archive"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), NAVCOIN_CONF_FILENAME));
@@ -367,10 +440,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
-    strUsage += HelpMessageOpt("-minersleep=<n>", strprintf(_("Sets the default sleep for the staking thread (default: %u)"), 500));
+    strUsage += HelpMessageOpt("-minersleep=<n>", strprintf(_("Milliseconds the staking thread sleeps after it found a stake (default: %u)"), 500));
     strUsage += HelpMessageOpt("-mininputvalue=<n>", strprintf(_("Sets the minimum value for an output to be considered as a coinstake kernel candidate")));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
                                                      -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parheaders=<n>", strprintf(_("Set the number of threads hashing and checking the headers received from peers (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+                                                            -GetNumCores(), MAX_HEADERCHECK_THREADS, DEFAULT_HEADERCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), NAVCOIN_PID_FILENAME));
 #endif
@@ -381,6 +456,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageOpt("-staking=<bool>", _("Enables or disables the staking thread."));
+    strUsage += HelpMessageOpt("-stakerthreads=<n>", strprintf(_("Set the number of stake kernel search threads (%u to %d, 0 = search in the staking thread, <0 = leave that many cores free, default: %d)"),
+                                                     -GetNumCores(), MAX_STAKER_THREADS, DEFAULT_STAKER_THREADS));
 #endif
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
@@ -390,10 +467,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-coldstakingindex", strprintf(_("Maintain an index of the unspent cold staking outputs by staking key, used to query the coins and weight delegated to a staker (default: %u)"), DEFAULT_COLDSTAKINGINDEX));
     strUsage += HelpMessageGroup(_("Clock options:"));
     strUsage += HelpMessageOpt("-ntpserver=<ip/host>", _("Adds a ntp server to use for clock syncronization"));
     strUsage += HelpMessageOpt("-ntpminmeasures=<n>", strprintf(_("Min. number of valid requests to NTP servers (default: %u)"), MINIMUM_NTP_MEASURE));
     strUsage += HelpMessageOpt("-ntptimeout=<n>", strprintf(_("Number of seconds to wait for a response from a NTP server (default: %u)"), DEFAULT_NTP_TIMEOUT));
+    strUsage += HelpMessageOpt("-ntpsyncinterval=<n>", strprintf(_("Number of seconds between clock syncs with the NTP servers, 0 to only sync at startup (default: %u)"), DEFAULT_NTP_SYNC_INTERVAL));
     strUsage += HelpMessageOpt("-maxtimeoffset=<n>", strprintf(_("Max number of seconds allowed as clock offset for a peer (default: %u)"), MAXIMUM_TIME_OFFSET));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -456,6 +535,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubstakinground=<address>", _("Enable publish staking round timings in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -862,82 +942,100 @@ void DownloadBlockchain(std::string url)
 {
 
     CURL *curl;
-    FILE *fp, *a;
-    CURLcode res;
+    CURLcode res = CURLE_OK;
 
     curl = curl_easy_init();
-    if (curl)
+    if (!curl)
+        throw std::runtime_error("Failed!");
+
+    // The archive is extracted aside and only replaces the chain data once it is complete and verified
+    boost::filesystem::path pathStaging = GetDataDir(true) / "bootstrap.tmp";
+    boost::filesystem::remove_all(pathStaging);
+    boost::filesystem::create_directories(pathStaging);
+
+    CBootstrapStream stream(pathStaging);
+    CBootstrapDownload download;
+    download.curl = curl;
+    download.pstream = &stream;
+    download.nResumeFrom = 0;
+    download.nSkip = 0;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_bootstrap);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &download);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    // Interrupted transfers continue where they stopped with a range request
+    for (int nAttempt = 0; nAttempt <= BOOTSTRAP_MAX_RESUMES; nAttempt++)
     {
+        download.nResumeFrom = stream.GetSize();
+        download.nSkip = 0;
+        download.fResponseChecked = false;
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, download.nResumeFrom);
 
-        std::string sDownload = (GetDataDir(true).string() + "/bootstrap_temp.tar");
-        fp = fopen(sDownload.c_str(),"wb");
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo);
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
         res = curl_easy_perform(curl);
 
-        if (res != CURLE_OK)
-        {
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            throw std::runtime_error("Failed!");
-
-        }
-        else
-        {
+        if (res == CURLE_OK || stream.HasFailed() || stream.IsFinished() || !IsBootstrapResumable(res))
+            break;
 
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            int i=fclose(fp);
-
-            if(i==0)
-            {
-
-                a = fopen(sDownload.c_str(), "rb");
-
-                if (a == NULL)
-                {
-
-                    boost::filesystem::remove_all(sDownload);
-                    throw std::runtime_error("Unable to open downloaded file.");
-
-                }
-                else
-                {
-
-                    boost::filesystem::remove_all(GetDataDir(true) / "blocks");
-                    boost::filesystem::remove_all(GetDataDir(true) / "chainstate");
-                    boost::filesystem::remove_all(GetDataDir(true) / "cfund");
-                    bool fOk = untar(a, sDownload.c_str());
-                    fclose(a);
-                    boost::filesystem::remove_all(sDownload);
-
-                    if(!fOk)
-                        throw std::runtime_error("Could not extract data.");
-
-                }
-
-            }
-            else
-            {
+        LogPrintf("[BOOTSTRAP] Download interrupted after %d bytes (%s), resuming\n", stream.GetSize(), curl_easy_strerror(res));
+        MilliSleep(1000);
+    }
 
-                throw std::runtime_error("Failed!");
+    curl_easy_cleanup(curl);
+    curl_global_cleanup();
 
-            }
-
-        }
+    // The end of the archive is all that is needed, a connection dropped after it does not matter
+    std::string strError;
+    if (stream.HasFailed())
+        strError = "Could not extract data.";
+    else if (!stream.Finish())
+        strError = res == CURLE_OK ? "The downloaded archive is incomplete." : "Failed!";
+    else
+    {
+        std::string strHash = stream.GetSHA256();
+        LogPrintf("[BOOTSTRAP] Extracted %d bytes, sha256 %s\n", stream.GetSize(), strHash);
 
+        std::string strExpected = GetArg("-bootstrapsha256", "");
+        if (strExpected != "" && strExpected != strHash)
+            strError = strprintf("Checksum mismatch, expected %s but got %s.", strExpected, strHash);
     }
-    else
+
+    if (!strError.empty())
     {
+        boost::filesystem::remove_all(pathStaging);
+        throw std::runtime_error(strError);
+    }
 
-        throw std::runtime_error("Failed!");
+    // Only the chain data is taken from the archive, anything else in it
+    // (a wallet.dat, a navcoin.conf...) is left behind and removed
+    if (!boost::filesystem::is_directory(pathStaging / "blocks") || !boost::filesystem::is_directory(pathStaging / "chainstate"))
+    {
+        boost::filesystem::remove_all(pathStaging);
+        throw std::runtime_error("The downloaded archive does not contain the blocks and chainstate folders.");
+    }
 
+    // Replace the chain data with the extracted one
+    const char* vChainData[] = {"blocks", "chainstate", "cfund"};
+    BOOST_FOREACH(const char* pszDir, vChainData)
+    {
+        boost::filesystem::path pathTarget = GetDataDir(true) / pszDir;
+        boost::filesystem::remove_all(pathTarget);
+        if (boost::filesystem::is_directory(pathStaging / pszDir))
+            boost::filesystem::rename(pathStaging / pszDir, pathTarget);
     }
+
+    for (boost::filesystem::directory_iterator it(pathStaging); it != boost::filesystem::directory_iterator(); ++it)
+        LogPrintf("[BOOTSTRAP] Ignoring %s from the archive\n", it->path().filename().string());
+    boost::filesystem::remove_all(pathStaging);
 }
 
 /** Initialize navcoin.
@@ -1133,6 +1231,26 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // Same for -parheaders, the thread handling the headers message is one of them
+    nHeaderCheckThreads = GetArg("-parheaders", DEFAULT_HEADERCHECK_THREADS);
+    if (nHeaderCheckThreads <= 0)
+        nHeaderCheckThreads += GetNumCores();
+    if (nHeaderCheckThreads <= 1)
+        nHeaderCheckThreads = 0;
+    else if (nHeaderCheckThreads > MAX_HEADERCHECK_THREADS)
+        nHeaderCheckThreads = MAX_HEADERCHECK_THREADS;
+
+#ifdef ENABLE_WALLET
+    // -stakerthreads=0 hashes kernels in the staking thread itself
+    nStakerThreads = GetArg("-stakerthreads", DEFAULT_STAKER_THREADS);
+    if (nStakerThreads < 0)
+        nStakerThreads += GetNumCores();
+    if (nStakerThreads <= 1)
+        nStakerThreads = 0;
+    else if (nStakerThreads > MAX_STAKER_THREADS)
+        nStakerThreads = MAX_STAKER_THREADS;
+#endif
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1254,6 +1372,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u threads for header verification\n", nHeaderCheckThreads);
+    if (nHeaderCheckThreads) {
+        for (int i=0; i<nHeaderCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+    }
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1327,6 +1451,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    if(GetArg("-ntpminmeasures", MINIMUM_NTP_MEASURE) != 0)
+        StartNtpClockSync(scheduler);
+
     if (sMsg != "")
     {
         uiInterface.ThreadSafeMessageBox(sMsg, "", CClientUIInterface::MSG_ERROR);
@@ -1540,9 +1667,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcfundstate;
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
+                pcfundstate = new CFund::CStateCache(pblocktree);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
 
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
@@ -1555,6 +1684,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                         CleanupBlockRevFiles();
                 }
 
+                if (!pcfundstate->Load()) {
+                    strLoadError = _("Error loading community fund state");
+                    break;
+                }
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1589,6 +1723,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -coldstakingindex state
+                if (fColdStakingIndex != GetBoolArg("-coldstakingindex", DEFAULT_COLDSTAKINGINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -coldstakingindex");
+                    break;
+                }
+
                 // Check for changed -timestampindex state
                 if (fTimestampIndex != GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -timestampindex");
@@ -1687,6 +1827,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         CWallet::InitLoadWallet();
         if (!pwalletMain)
             return false;
+        if (!CWallet::InitLoadStakingWallets())
+            return false;
     }
 #else // ENABLE_WALLET
     LogPrintf("No wallet support compiled in!\n");
@@ -1772,6 +1914,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     SetStaking(GetBoolArg("-staking", true));
+    LogPrintf("Using %u threads for stake kernel search\n", nStakerThreads);
+    for (int i=0; i<nStakerThreads-1; i++)
+        threadGroup.create_thread(&ThreadStakeKernelSearch);
     threadGroup.create_thread(boost::bind(&NavCoinStaker, boost::cref(chainparams)));
 #endif
 
@@ -9,3 +9,324 @@
 #include "timedata.h"
 #include "txdb.h"
 #include "main.h"
+
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+int nStakerThreads = 0;
+
+static CCheckQueue<CStakeKernelCheck> kernelcheckqueue(128);
+
+void ThreadStakeKernelSearch() {
+    RenameThread("navcoin-kernel");
+    kernelcheckqueue.Thread();
+}
+
+CStakeKernelSearch::CStakeKernelSearch() : nBits(0), nStakeModifier(0), fFound(false), nFoundIndex(0), nFoundTime(0)
+{
+}
+
+void CStakeKernelSearch::SetTip(const CBlockIndex* pindexPrev, unsigned int nBitsIn)
+{
+    if (pindexPrev->GetBlockHash() == hashTip && nBitsIn == nBits)
+        return;
+
+    hashTip = pindexPrev->GetBlockHash();
+    nBits = nBitsIn;
+    nStakeModifier = pindexPrev->nStakeModifier;
+
+    // Every kernel commits to the stake modifier of the tip
+    vInputs.clear();
+    vPreimages.clear();
+    vTargets.clear();
+    vTargetOverflow.clear();
+}
+
+void CStakeKernelSearch::SetInputs(const std::vector<CStakeKernelInput>& vInputsIn)
+{
+    if (vInputsIn == vInputs)
+        return;
+
+    vInputs = vInputsIn;
+    Precompute();
+}
+
+void CStakeKernelSearch::Precompute()
+{
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+    const base_uint<512> bnTarget512(bnTarget.GetHex());
+
+    vPreimages.resize(vInputs.size() * STAKE_KERNEL_SIZE);
+    vTargets.resize(vInputs.size());
+    vTargetOverflow.resize(vInputs.size());
+
+    for (size_t i = 0; i < vInputs.size(); i++)
+    {
+        const CStakeKernelInput& input = vInputs[i];
+
+        // Same layout as the CDataStream serialization used by CheckStakeKernelHash
+        unsigned char* ptr = &vPreimages[i * STAKE_KERNEL_SIZE];
+        WriteLE64(ptr, nStakeModifier);
+        WriteLE32(ptr + 8, input.nTimeBlockFrom);
+        WriteLE32(ptr + 12, input.nTimeTxPrev);
+        memcpy(ptr + 16, input.prevout.hash.begin(), 32);
+        WriteLE32(ptr + 48, input.prevout.n);
+        WriteLE32(ptr + 52, 0);
+
+        // The target is weighted by the value of the output in 512 bits to
+        // prevent overflows; the kernel hash always meets targets which do not
+        // fit back in 256 bits
+        arith_uint512 bnWeighted(bnTarget512);
+        bnWeighted *= arith_uint512((uint64_t)input.nValue);
+        if (bnWeighted.bits() > 256) {
+            vTargetOverflow[i] = true;
+            vTargets[i] = arith_uint256();
+        } else {
+            uint512 weighted = ArithToUint512(bnWeighted);
+            uint256 target;
+            memcpy(target.begin(), weighted.begin(), 32);
+            vTargetOverflow[i] = false;
+            vTargets[i] = UintToArith256(target);
+        }
+    }
+}
+
+bool CStakeKernelSearch::CheckKernel(size_t nIndex, unsigned int nTimeTx, uint256* phashProofOfStake) const
+{
+    const CStakeKernelInput& input = vInputs[nIndex];
+
+    if (nTimeTx < input.nTimeTxPrev)
+        return false;
+
+    if (input.nTimeBlockFrom + Params().GetConsensus().nStakeMinAge > nTimeTx)
+        return false;
+
+    unsigned char preimage[STAKE_KERNEL_SIZE];
+    memcpy(preimage, &vPreimages[nIndex * STAKE_KERNEL_SIZE], STAKE_KERNEL_SIZE - 4);
+    WriteLE32(preimage + STAKE_KERNEL_SIZE - 4, nTimeTx);
+
+    uint256 hashProofOfStake;
+    CHash256().Write(preimage, STAKE_KERNEL_SIZE).Finalize(hashProofOfStake.begin());
+
+    if (phashProofOfStake)
+        *phashProofOfStake = hashProofOfStake;
+
+    return vTargetOverflow[nIndex] || UintToArith256(hashProofOfStake) <= vTargets[nIndex];
+}
+
+void CStakeKernelSearch::SetFound(size_t nIndex, unsigned int nTime) const
+{
+    boost::unique_lock<boost::mutex> lock(cs_result);
+    if (!fFound || nIndex < nFoundIndex) {
+        fFound = true;
+        nFoundIndex = nIndex;
+        nFoundTime = nTime;
+    }
+}
+
+bool CStakeKernelSearch::SearchRange(size_t nBegin, size_t nEnd, const std::vector<unsigned int>& vTimes) const
+{
+    const int64_t nStakeMinAge = Params().GetConsensus().nStakeMinAge;
+    unsigned char preimage[STAKE_KERNEL_SIZE];
+    uint256 hashProofOfStake;
+
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        const CStakeKernelInput& input = vInputs[i];
+
+        // Only the timestamp changes between the hashes of a candidate
+        memcpy(preimage, &vPreimages[i * STAKE_KERNEL_SIZE], STAKE_KERNEL_SIZE - 4);
+
+        for (std::vector<unsigned int>::const_iterator it = vTimes.begin(); it != vTimes.end(); ++it)
+        {
+            const unsigned int nTimeTx = *it;
+            if (nTimeTx < input.nTimeTxPrev || input.nTimeBlockFrom + nStakeMinAge > nTimeTx)
+                continue;
+
+            WriteLE32(preimage + STAKE_KERNEL_SIZE - 4, nTimeTx);
+            CHash256().Write(preimage, STAKE_KERNEL_SIZE).Finalize(hashProofOfStake.begin());
+
+            if (vTargetOverflow[i] || UintToArith256(hashProofOfStake) <= vTargets[i]) {
+                SetFound(i, nTimeTx);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool CStakeKernelSearch::Search(const std::vector<unsigned int>& vTimes, size_t& nIndexRet, unsigned int& nTimeRet) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_result);
+        fFound = false;
+    }
+
+    if (vInputs.empty() || vTimes.empty())
+        return false;
+
+    // The check queue hands out jobs from the back, so the batches are queued
+    // in reverse to hash the first candidates first
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(vInputs.size() / STAKE_KERNEL_BATCH_SIZE + 1);
+    for (size_t n = 0; n < vInputs.size(); n += STAKE_KERNEL_BATCH_SIZE)
+        vChecks.push_back(CStakeKernelCheck(this, n, std::min(n + STAKE_KERNEL_BATCH_SIZE, vInputs.size()), &vTimes));
+    if (nStakerThreads)
+        std::reverse(vChecks.begin(), vChecks.end());
+
+    if (nStakerThreads) {
+        CCheckQueueControl<CStakeKernelCheck> control(&kernelcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH(CStakeKernelCheck& check, vChecks)
+            if (!check())
+                break;
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs_result);
+    if (!fFound)
+        return false;
+
+    nIndexRet = nFoundIndex;
+    nTimeRet = nFoundTime;
+    return true;
+}
+
+bool CStakeKernelCheck::operator()()
+{
+    return psearch->SearchRange(nBegin, nEnd, *pvTimes);
+}
+
+CStakeModifierCandidate::CStakeModifierCandidate(const CBlockIndex* pindexIn) :
+    nStakeModifierHashed(0), fHashed(false), pindex(pindexIn), nTime(pindexIn->GetBlockTime())
+{
+}
+
+const uint256& CStakeModifierCandidate::GetSelectionHash(uint64_t nStakeModifierPrev)
+{
+    uint256 hashProof = ArithToUint256(pindex->hashProof);
+    if (fHashed && nStakeModifierHashed == nStakeModifierPrev && hashProofHashed == hashProof)
+        return hashSelection;
+
+    // compute the selection hash by hashing its proof-hash and the
+    // previous proof-of-stake modifier
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashProof << nStakeModifierPrev;
+    hashSelection = ss.GetHash();
+
+    // the selection hash is divided by 2**32 so that proof-of-stake block
+    // is always favored over proof-of-work block. this is to preserve
+    // the energy efficiency property
+    if (pindex->IsProofOfStake())
+        hashSelection = ArithToUint256(UintToArith256(hashSelection) >> 32);
+
+    hashProofHashed = hashProof;
+    nStakeModifierHashed = nStakeModifierPrev;
+    fHashed = true;
+    return hashSelection;
+}
+
+bool CStakeModifierWindow::CompareCandidate::operator()(const CStakeModifierCandidate* a, const CStakeModifierCandidate* b) const
+{
+    if (a->nTime != b->nTime)
+        return a->nTime < b->nTime;
+    return a->pindex->GetBlockHash() < b->pindex->GetBlockHash();
+}
+
+void CStakeModifierWindow::Clear()
+{
+    setSorted.clear();
+    vChain.clear();
+    pindexTip = NULL;
+}
+
+void CStakeModifierWindow::PushBack(const CBlockIndex* pindex)
+{
+    vChain.push_back(CStakeModifierCandidate(pindex));
+    setSorted.insert(&vChain.back());
+    pindexTip = pindex;
+}
+
+void CStakeModifierWindow::PushFront(const CBlockIndex* pindex)
+{
+    vChain.push_front(CStakeModifierCandidate(pindex));
+    setSorted.insert(&vChain.front());
+}
+
+void CStakeModifierWindow::PopBack()
+{
+    setSorted.erase(&vChain.back());
+    vChain.pop_back();
+    pindexTip = vChain.empty() ? NULL : vChain.back().pindex;
+}
+
+void CStakeModifierWindow::PopFront()
+{
+    setSorted.erase(&vChain.front());
+    vChain.pop_front();
+    if (vChain.empty())
+        pindexTip = NULL;
+}
+
+void CStakeModifierWindow::SetTip(const CBlockIndex* pindexPrev)
+{
+    if (pindexTip == pindexPrev)
+        return;
+
+    // Disconnect the blocks which are not in the new chain
+    while (!vChain.empty() && pindexPrev->GetAncestor(vChain.back().pindex->nHeight) != vChain.back().pindex)
+        PopBack();
+
+    // Connect the blocks up to the new tip, or start over when it is too far ahead
+    if (vChain.empty() || pindexPrev->nHeight - pindexTip->nHeight > (int)vChain.size()) {
+        Clear();
+        PushBack(pindexPrev);
+        return;
+    }
+
+    std::vector<const CBlockIndex*> vConnect;
+    for (const CBlockIndex* pindex = pindexPrev; pindex != pindexTip; pindex = pindex->pprev)
+        vConnect.push_back(pindex);
+    for (std::vector<const CBlockIndex*>::reverse_iterator it = vConnect.rbegin(); it != vConnect.rend(); ++it)
+        PushBack(*it);
+}
+
+void CStakeModifierWindow::GetCandidates(const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart,
+                                         std::vector<CStakeModifierCandidate*>& vCandidatesRet, int& nHeightFirstCandidateRet)
+{
+    SetTip(pindexPrev);
+
+    // Find the first block (walking back) before the selection interval,
+    // extending the window towards the genesis block when needed
+    int nBoundary = (int)vChain.size() - 1;
+    while (nBoundary >= 0 && vChain[nBoundary].nTime >= nSelectionIntervalStart)
+        nBoundary--;
+    while (nBoundary < 0 && vChain.front().pindex->pprev) {
+        PushFront(vChain.front().pindex->pprev);
+        if (vChain.front().nTime < nSelectionIntervalStart)
+            nBoundary = 0;
+    }
+
+    // Keep the boundary block itself, it tells where the window starts
+    while (nBoundary > 0) {
+        PopFront();
+        nBoundary--;
+    }
+
+    nHeightFirstCandidateRet = nBoundary < 0 ? 0 : vChain.front().pindex->nHeight + 1;
+
+    vCandidatesRet.clear();
+    vCandidatesRet.reserve(vChain.size());
+    for (std::set<CStakeModifierCandidate*, CompareCandidate>::iterator it = setSorted.begin(); it != setSorted.end(); ++it)
+        if ((*it)->pindex->nHeight >= nHeightFirstCandidateRet)
+            vCandidatesRet.push_back(*it);
+}
@@ -0,0 +1,210 @@
+// Copyright (c) 2012-2013 The PPCoin developers
+// Copyright (c) 2014 The NavCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_KERNEL_H
+#define NAVCOIN_KERNEL_H
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <deque>
+#include <set>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+class CBlockIndex;
+
+/** Size of the V2 kernel preimage: nStakeModifier, nTimeBlockFrom, nTimeTxPrev, prevout and nTimeTx */
+static const unsigned int STAKE_KERNEL_SIZE = 56;
+/** Number of kernel candidates hashed by a single kernel search job */
+static const unsigned int STAKE_KERNEL_BATCH_SIZE = 32;
+/** Maximum number of kernel search threads */
+static const int MAX_STAKER_THREADS = 16;
+/** -stakerthreads default (0 = hash kernels in the staker thread) */
+static const int DEFAULT_STAKER_THREADS = 0;
+
+extern int nStakerThreads;
+
+/** Inputs of the stake kernel hash which only depend on the staked output. */
+struct CStakeKernelInput
+{
+    COutPoint prevout;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTxPrev;
+    CAmount nValue;
+
+    CStakeKernelInput() : nTimeBlockFrom(0), nTimeTxPrev(0), nValue(0) {}
+
+    CStakeKernelInput(const COutPoint& prevoutIn, unsigned int nTimeBlockFromIn, unsigned int nTimeTxPrevIn, CAmount nValueIn) :
+        prevout(prevoutIn), nTimeBlockFrom(nTimeBlockFromIn), nTimeTxPrev(nTimeTxPrevIn), nValue(nValueIn) {}
+
+    friend bool operator==(const CStakeKernelInput& a, const CStakeKernelInput& b)
+    {
+        return a.prevout == b.prevout && a.nTimeBlockFrom == b.nTimeBlockFrom &&
+               a.nTimeTxPrev == b.nTimeTxPrev && a.nValue == b.nValue;
+    }
+};
+
+/**
+ * Stake kernel search engine.
+ *
+ * Serializes the tip dependent part of the kernel of every candidate output
+ * and its weighted target once per tip, and then evaluates the kernel hash
+ * (see CheckStakeKernelHash) of all candidates over a window of timestamps in
+ * batches which are spread over the kernel search threads.
+ */
+class CStakeKernelSearch
+{
+private:
+    uint256 hashTip;
+    unsigned int nBits;
+    uint64_t nStakeModifier;
+
+    std::vector<CStakeKernelInput> vInputs;
+    //! Kernel preimages without nTimeTx, STAKE_KERNEL_SIZE bytes per candidate
+    std::vector<unsigned char> vPreimages;
+    //! Weighted targets, meaningless when the target does not fit in 256 bits
+    std::vector<arith_uint256> vTargets;
+    std::vector<unsigned char> vTargetOverflow;
+
+    mutable boost::mutex cs_result;
+    mutable bool fFound;
+    mutable size_t nFoundIndex;
+    mutable unsigned int nFoundTime;
+
+    void Precompute();
+    void SetFound(size_t nIndex, unsigned int nTime) const;
+
+public:
+    CStakeKernelSearch();
+
+    /** Select the tip to search on; drops the precomputed kernels when the tip or nBits changed */
+    void SetTip(const CBlockIndex* pindexPrev, unsigned int nBitsIn);
+
+    /** Set the candidate outputs, only recomputing their kernels when the set changed */
+    void SetInputs(const std::vector<CStakeKernelInput>& vInputsIn);
+
+    const std::vector<CStakeKernelInput>& GetInputs() const { return vInputs; }
+
+    /** Whether the kernel of candidate nIndex meets its weighted target at nTimeTx */
+    bool CheckKernel(size_t nIndex, unsigned int nTimeTx, uint256* phashProofOfStake = NULL) const;
+
+    /**
+     * Hash the candidates [nBegin, nEnd) at every timestamp of vTimes.
+     * Returns false when a valid kernel was found.
+     */
+    bool SearchRange(size_t nBegin, size_t nEnd, const std::vector<unsigned int>& vTimes) const;
+
+    /**
+     * Search all candidates at the timestamps of vTimes (most preferred first)
+     * and return the candidate index and timestamp of a valid kernel.
+     */
+    bool Search(const std::vector<unsigned int>& vTimes, size_t& nIndexRet, unsigned int& nTimeRet) const;
+};
+
+/** A batch of kernel candidates to be hashed by the kernel search threads. */
+class CStakeKernelCheck
+{
+private:
+    const CStakeKernelSearch* psearch;
+    size_t nBegin;
+    size_t nEnd;
+    const std::vector<unsigned int>* pvTimes;
+
+public:
+    CStakeKernelCheck() : psearch(NULL), nBegin(0), nEnd(0), pvTimes(NULL) {}
+    CStakeKernelCheck(const CStakeKernelSearch* psearchIn, size_t nBeginIn, size_t nEndIn, const std::vector<unsigned int>* pvTimesIn) :
+        psearch(psearchIn), nBegin(nBeginIn), nEnd(nEndIn), pvTimes(pvTimesIn) {}
+
+    /** Returns false when a kernel was found, so the queue stops handing out batches */
+    bool operator()();
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(psearch, check.psearch);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pvTimes, check.pvTimes);
+    }
+};
+
+/** Run an instance of the kernel search thread */
+void ThreadStakeKernelSearch();
+
+/** A block of the stake modifier selection window. */
+class CStakeModifierCandidate
+{
+private:
+    uint256 hashSelection;
+    uint256 hashProofHashed;
+    uint64_t nStakeModifierHashed;
+    bool fHashed;
+
+public:
+    const CBlockIndex* pindex;
+    int64_t nTime;
+
+    CStakeModifierCandidate(const CBlockIndex* pindexIn);
+
+    /**
+     * The selection hash of the block for a previous stake modifier: the hash
+     * of its proof-hash and the modifier, divided by 2**32 for proof-of-stake
+     * blocks. It is kept until the modifier changes.
+     */
+    const uint256& GetSelectionHash(uint64_t nStakeModifierPrev);
+};
+
+/**
+ * Sliding window over the blocks which can be selected for the next stake
+ * modifier.
+ *
+ * The window follows the chain it is queried for: blocks are appended when
+ * the tip moves forward, removed when they are disconnected, and dropped from
+ * the start once they are older than the selection interval. Blocks are also
+ * kept ordered by timestamp and hash, so selecting candidates walks neither
+ * the chain nor sorts them. Callers must hold cs_main.
+ */
+class CStakeModifierWindow
+{
+private:
+    struct CompareCandidate
+    {
+        bool operator()(const CStakeModifierCandidate* a, const CStakeModifierCandidate* b) const;
+    };
+
+    //! Candidates in chain order, the last one is pindexTip
+    std::deque<CStakeModifierCandidate> vChain;
+    //! The same candidates sorted by timestamp and hash
+    std::set<CStakeModifierCandidate*, CompareCandidate> setSorted;
+    const CBlockIndex* pindexTip;
+
+    void PushBack(const CBlockIndex* pindex);
+    void PushFront(const CBlockIndex* pindex);
+    void PopBack();
+    void PopFront();
+    void SetTip(const CBlockIndex* pindexPrev);
+
+public:
+    CStakeModifierWindow() : pindexTip(NULL) {}
+
+    /** Forget all blocks, e.g. when the block index is unloaded. */
+    void Clear();
+
+    /**
+     * Get the blocks from pindexPrev back to (but not including) the first
+     * block with a timestamp before nSelectionIntervalStart, sorted by
+     * timestamp and hash, and the height of the oldest of them. The returned
+     * candidates are valid until the next call.
+     */
+    void GetCandidates(const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart,
+                       std::vector<CStakeModifierCandidate*>& vCandidatesRet, int& nHeightFirstCandidateRet);
+
+    size_t size() const { return vChain.size(); }
+};
+
+#endif // NAVCOIN_KERNEL_H
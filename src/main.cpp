@@ -19,6 +19,7 @@
 #include "core_io.h"
 #include "hash.h"
 #include "init.h"
+#include "kernel.h"
 #include "merkleblock.h"
 #include "net.h"
 #include "policy/fees.h"
@@ -30,6 +31,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "stakingstats.h"
 #include "tinyformat.h"
 #include "timedata.h"
 #include "txdb.h"
@@ -72,12 +74,14 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nHeaderCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fColdStakingIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -98,6 +102,8 @@ CBlockIndex* pindexBest = NULL;
 
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
+CStakeModifierWindow stakeModifierWindow;
+
 CTxMemPool mempool(::minRelayTxFee);
 FeeFilterRounder filterRounder(::minRelayTxFee);
 
@@ -250,6 +256,9 @@ namespace {
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
+    /** Blocks connected since startup whose coinstake announces a newer wallet version, for the upgrade warning. */
+    std::set<const CBlockIndex*> setNewerWalletBlocks;
+
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
 
@@ -789,6 +798,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CFund::CStateCache *pcfundstate = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -1750,6 +1760,28 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &balance)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressBalance(addressHash, type, balance))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
+CAddressIndexCursor* GetAddressIndexCursor(uint160 addressHash, int type, int start, int end,
+                                           const CAddressIndexKey* pkeyAfter)
+{
+    if (!fAddressIndex) {
+        error("address index not enabled");
+        return NULL;
+    }
+
+    return pblocktree->AddressIndexCursor(addressHash, type, start, end, pkeyAfter);
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -1762,6 +1794,61 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetColdStakingUnspent(uint160 stakingKey,
+                           std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &unspentOutputs)
+{
+    if (!fColdStakingIndex)
+        return error("cold staking index not enabled");
+
+    if (!pblocktree->ReadColdStakingIndex(stakingKey, unspentOutputs))
+        return error("unable to get outputs for staking key");
+
+    return true;
+}
+
+static bool GetColdStakingKeys(const CScript& script, uint160& stakingKey, uint160& spendingKey)
+{
+    if (!script.IsColdStaking())
+        return false;
+
+    stakingKey = uint160(vector<unsigned char>(script.begin()+5, script.begin()+25));
+    spendingKey = uint160(vector<unsigned char>(script.begin()+31, script.begin()+51));
+    return true;
+}
+
+void IndexColdStakingOutputs(const CTransaction& tx, int nHeight, bool fErase,
+                             std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex)
+{
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        uint160 stakingKey, spendingKey;
+        if (GetColdStakingKeys(tx.vout[k].scriptPubKey, stakingKey, spendingKey))
+            coldStakingIndex.push_back(make_pair(CColdStakingIndexKey(stakingKey, tx.GetHash(), k),
+                                                 fErase ? CColdStakingIndexValue() : CColdStakingIndexValue(tx.vout[k].nValue, spendingKey, nHeight)));
+    }
+}
+
+void IndexColdStakingSpends(const CTransaction& tx, const CCoinsViewCache& view,
+                            std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex)
+{
+    for (size_t j = 0; j < tx.vin.size(); j++) {
+        uint160 stakingKey, spendingKey;
+        if (GetColdStakingKeys(view.GetOutputFor(tx.vin[j]).scriptPubKey, stakingKey, spendingKey))
+            coldStakingIndex.push_back(make_pair(CColdStakingIndexKey(stakingKey, tx.vin[j].prevout.hash, tx.vin[j].prevout.n), CColdStakingIndexValue()));
+    }
+}
+
+void IndexColdStakingUndo(const CTxInUndo& undo, const COutPoint& out, const CCoinsViewCache& view,
+                          std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex)
+{
+    uint160 stakingKey, spendingKey;
+    if (!GetColdStakingKeys(undo.txout.scriptPubKey, stakingKey, spendingKey))
+        return;
+    // Only the undo of the last spent output carries the height, the coins restored before it have it too
+    const CCoins* coins = view.AccessCoins(out.hash);
+    int nHeight = coins ? coins->nHeight : undo.nHeight;
+    coldStakingIndex.push_back(make_pair(CColdStakingIndexKey(stakingKey, out.hash, out.n), CColdStakingIndexValue(undo.txout.nValue, spendingKey, nHeight)));
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -2094,6 +2181,11 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (pstake)
+        return (*pstake)();
+    if (pcfund)
+        return (*pcfund)();
+
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = (nIn < ptxTo->wit.vtxinwit.size()) ? &ptxTo->wit.vtxinwit[nIn].scriptWitness : NULL;
 
@@ -2320,7 +2412,7 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
@@ -2346,6 +2438,22 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
     return fClean;
 }
 
+bool DisconnectedCoinsMatch(CCoins& coins, const CTransaction& tx, int nHeight)
+{
+    CCoins outsBlock(tx, nHeight);
+    // The CCoins serialization does not serialize negative numbers.
+    // No network rules currently depend on the version here, so an inconsistency is harmless
+    // but it must be corrected before txout nversion ever influences a network rule.
+    if (outsBlock.nVersion < 0)
+        coins.nVersion = outsBlock.nVersion;
+    // Coins written before the transaction time was stored, and coins restored by
+    // ApplyTxInUndo, whose undo data does not carry it, have no time.
+    if (coins.nTime == 0)
+        coins.nTime = outsBlock.nTime;
+
+    return coins == outsBlock;
+}
+
 bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -2368,6 +2476,7 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > coldStakingIndex;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -2382,7 +2491,7 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             if(tx.nVersion == CTransaction::PROPOSAL_VERSION && CFund::IsValidProposal(tx, nMaxVersionProposal)) {
                 std::vector<std::pair<uint256, CFund::CProposal> > proposalIndex;
                 proposalIndex.push_back(make_pair(hash,CFund::CProposal()));
-                if (!pfClean && !pblocktree->UpdateProposalIndex(proposalIndex)) {
+                if (!pfClean && !pcfundstate->UpdateProposalIndex(proposalIndex)) {
                     return AbortNode(state, "Failed to write proposal index");
                 }
             }
@@ -2399,11 +2508,11 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                         proposalIndex.push_back(make_pair(proposal.hash,proposal));
                     }
                 }
-                if (!pfClean && !pblocktree->UpdateProposalIndex(proposalIndex)) {
+                if (!pfClean && !pcfundstate->UpdateProposalIndex(proposalIndex)) {
                     return AbortNode(state, "Failed to write proposal index");
                 }
 
-                if (!pfClean && !pblocktree->UpdatePaymentRequestIndex(paymentRequestIndex)) {
+                if (!pfClean && !pcfundstate->UpdatePaymentRequestIndex(paymentRequestIndex)) {
                     return AbortNode(state, "Failed to write proposal index");
                 }
             }
@@ -2456,20 +2565,16 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
         }
 
+        if (fColdStakingIndex)
+            IndexColdStakingOutputs(tx, pindex->nHeight, true, coldStakingIndex);
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
         CCoinsModifier outs = view.ModifyCoins(hash);
         outs->ClearUnspendable();
 
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-
-        if (*outs != outsBlock)
+        if (!DisconnectedCoinsMatch(*outs, tx, pindex->nHeight))
             fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
 
         // remove outputs
@@ -2494,6 +2599,11 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                     spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
                 }
 
+                if (fColdStakingIndex) {
+                    // restore unspent output, at the height ApplyTxInUndo restored
+                    IndexColdStakingUndo(undo, input.prevout, view, coldStakingIndex);
+                }
+
                 if (fAddressIndex) {
                     const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
                     if (prevout.scriptPubKey.IsPayToScriptHash()) {
@@ -2557,6 +2667,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         }
     }
 
+    if (fColdStakingIndex)
+        if (!pblocktree->UpdateColdStakingIndex(coldStakingIndex))
+            return AbortNode(state, "Failed to write cold staking index");
+
     return fClean;
 }
 
@@ -2592,6 +2706,47 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CHeaderCheck> headercheckqueue(128);
+
+void ThreadHeaderCheck() {
+    RenameThread("navcoin-hdrcheck");
+    headercheckqueue.Thread();
+}
+
+bool CHeaderCheck::operator()() {
+    std::vector<CBlockHeader> vBatch(pvHeaders->begin() + nBegin, pvHeaders->begin() + nEnd);
+    std::vector<uint256> vBatchHashes;
+    GetBlockHeaderHashes(vBatch, vBatchHashes);
+
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CValidationState state;
+        (*pvHashes)[i] = vBatchHashes[i - nBegin];
+        (*pvValid)[i] = CheckBlockHeader((*pvHeaders)[i], state, *pparams, false, &(*pvHashes)[i]);
+    }
+
+    return true;
+}
+
+void CheckBlockHeaders(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet, std::vector<unsigned char>& vValidRet, const Consensus::Params& consensusParams)
+{
+    vHashesRet.resize(vHeaders.size());
+    vValidRet.resize(vHeaders.size());
+
+    std::vector<CHeaderCheck> vChecks;
+    vChecks.reserve(vHeaders.size() / HEADER_CHECK_BATCH_SIZE + 1);
+    for (size_t n = 0; n < vHeaders.size(); n += HEADER_CHECK_BATCH_SIZE)
+        vChecks.push_back(CHeaderCheck(&vHeaders, &vHashesRet, &vValidRet, n, std::min(n + HEADER_CHECK_BATCH_SIZE, vHeaders.size()), &consensusParams));
+
+    if (nHeaderCheckThreads) {
+        CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH(CHeaderCheck& check, vChecks)
+            check();
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2698,8 +2853,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     pindex->nCFSupply = pindex->pprev != NULL ? pindex->pprev->nCFSupply : 0;
     pindex->nCFLocked = pindex->pprev != NULL ? pindex->pprev->nCFLocked : 0;
 
-    pindex->vProposalVotes.clear();
-    pindex->vPaymentRequestVotes.clear();
+    // Community fund votes of the block, stored next to its index (see CBlockTreeDB::WriteBlockVotes)
+    CBlockVotes blockVotes;
+
+    //! Whether the coinstake announces a newer wallet version than ours
+    bool fNewerWallet = false;
 
     if (block.IsProofOfStake())
     {
@@ -2715,6 +2873,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTimeStart = GetTimeMicros();
     int64_t nStakeReward = 0;
+    uint64_t nCoinAge = 0;
 
     // Check it again in case a previous version let a bad block in
     if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck, !fJustCheck))
@@ -2729,8 +2888,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // (its coinbase is unspendable)
 
     if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
-        if (!fJustCheck)
+        if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            pblocktree->WriteBlockVotes(pindex->GetBlockHash(), blockVotes);
+        }
         return true;
     }
 
@@ -2742,32 +2903,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(1,error("ContextualCheckBlock() : incorrect %s at height %d (%d)", !block.IsProofOfStake() ? "proof-of-work" : "proof-of-stake",pindex->pprev->nHeight, block.nBits), REJECT_INVALID, "bad-diffbits");
     }
 
-    arith_uint256 hashProof;
-
-    // Verify hash target and signature of coinstake tx
+    // Look up the kernel of the coinstake tx. The kernel hash target is
+    // verified together with the script checks below, while the signature
+    // will be checked in CheckInputs()
+    CStakeCheck stakeCheck;
     if (block.IsProofOfStake())
     {
-        arith_uint256 targetProofOfStake;
-        // Signature will be checked in CheckInputs(), we can avoid it here (fCheckSignature = false)
-        if (!CheckProofOfStake(pindex->pprev, block.vtx[1], block.nBits, hashProof, targetProofOfStake, NULL, false))
+        if (!PrepareStakeCheck(pindex->pprev, block.vtx[1], block.nBits, stakeCheck))
         {
               return error("ContextualCheckBlock() : check proof-of-stake signature failed for block %s", block.GetHash().GetHex());
         }
     }
 
-    if (block.IsProofOfWork())
-    {
-        hashProof = UintToArith256(block.GetPoWHash());
-    }
-
-
-
     if (!pindex->SetStakeEntropyBit(block.GetStakeEntropyBit()))
         return state.DoS(1,error("ContextualCheckBlock() : SetStakeEntropyBit() failed"), REJECT_INVALID, "bad-entropy-bit");
 
-    // Record proof hash value
-    pindex->hashProof = hashProof;
-
     uint64_t nStakeModifier = 0;
     bool fGeneratedStakeModifier = false;
     if (!ComputeNextStakeModifier(pindex->pprev, nStakeModifier, fGeneratedStakeModifier))
@@ -2775,14 +2925,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     pindex->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
 
-    // Flag the block index so we can be sure it will be saved on disk
-    if (!pindex->IsValid(BLOCK_VALID_STAKE))
-    {
-        pindex->RaiseValidity(BLOCK_VALID_STAKE);
-        setDirtyBlockIndex.insert(pindex);
-    }
-
-
     bool fScriptChecks = true;
     if (fCheckpointsEnabled) {
         CBlockIndex *pindexLastCheckpoint = Checkpoints::GetLastCheckpoint(chainparams.Checkpoints());
@@ -2877,10 +3019,27 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > coldStakingIndex;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // The queued checks point into txdata and vCFundChecks, so both must be
+    // declared before control and outlive the wait in its destructor
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    std::vector<CFund::CTxCheck> vCFundChecks;
+    vCFundChecks.reserve(block.vtx.size()); // Same for the queued community fund checks
+
+    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+
+    // Verify the kernel hash target of the coinstake tx alongside the script checks
+    if (block.IsProofOfStake())
+    {
+        if (fScriptChecks && nScriptCheckThreads) {
+            std::vector<CScriptCheck> vStakeChecks(1, CScriptCheck(&stakeCheck));
+            control.Add(vStakeChecks);
+        } else if (!stakeCheck()) {
+            return error("ContextualCheckBlock() : check proof-of-stake signature failed for block %s", block.GetHash().GetHex());
+        }
+    }
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -2900,7 +3059,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         CFund::CProposal proposal;
                         if(CFund::FindProposal(hash, proposal))
                             if(proposal.CanVote())
-                                pindex->vProposalVotes.push_back(make_pair(hash, vote));
+                                blockVotes.vProposalVotes.push_back(make_pair(hash, vote));
                     }
                 }
                 else if (tx.vout[j].IsPaymentRequestVote()) {
@@ -2916,7 +3075,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             if((proposal.CanRequestPayments() || proposal.fState == CFund::PENDING_VOTING_PREQ)
                                     && prequest.CanVote()
                                     && pindex->nHeight - pblockindex->nHeight > Params().GetConsensus().nCommunityFundMinAge)
-                                pindex->vPaymentRequestVotes.push_back(make_pair(hash, vote));
+                                blockVotes.vPaymentRequestVotes.push_back(make_pair(hash, vote));
                         }
                     }
                 }
@@ -2994,6 +3153,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 }
 
             }
+
+            if (fColdStakingIndex)
+                IndexColdStakingSpends(tx, view, coldStakingIndex);
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -3016,7 +3178,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             {
 
               nStakeReward = tx.GetValueOut() - view.GetValueIn(tx);
-              pindex->strDZeel = tx.strDZeel;
+
+              // ppcoin: coin stake tx earns reward instead of paying fee, by the age of inputs still in the view
+              if (block.IsProofOfStake() && i == 1 && !TransactionGetCoinAge(tx, view, pindex->pprev, nCoinAge))
+                  return error("ConnectBlock() : %s unable to get coin age for coinstake", tx.GetHash().ToString());
+              fNewerWallet = tx.strDZeel.find(';') != std::string::npos &&
+                             atoi(tx.strDZeel.substr(tx.strDZeel.find(";") + 1).c_str()) > CLIENT_VERSION;
 
               if(IsCommunityFundAccumulationEnabled(pindex->pprev, Params().GetConsensus(), false))
               {
@@ -3115,125 +3282,35 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
-        bool fContribution = false;
-        CAmount nProposalFee = 0;
+        if (fColdStakingIndex)
+            IndexColdStakingOutputs(tx, pindex->nHeight, false, coldStakingIndex);
 
         BOOST_FOREACH(const CTxOut& vout, tx.vout)
         {
           if(vout.IsCommunityFundContribution())
           {
-            fContribution=true;
             pindex->nCFSupply += vout.nValue;
-            nProposalFee += vout.nValue;
           }
         }
 
-        if(IsCommunityFundEnabled(pindex->pprev, Params().GetConsensus())) {
-            bool fReducedQuorum = IsReducedCFundQuorumEnabled(pindexBestHeader, Params().GetConsensus());
-            int nMaxVersionProposal = fReducedQuorum ? Params().GetConsensus().nProposalMaxVersion : 2;
-            int nMaxVersionPaymentRequest = fReducedQuorum ? Params().GetConsensus().nPaymentRequestMaxVersion : 2;
-
-            if(fContribution && tx.nVersion == CTransaction::PROPOSAL_VERSION && CFund::IsValidProposal(tx, nMaxVersionProposal)){
-                std::vector<std::pair<uint256, CFund::CProposal> > proposalIndex;
-
-                UniValue metadata(UniValue::VOBJ);
-                try {
-                    UniValue valRequest;
-                    if (!valRequest.read(tx.strDZeel))
-                        return error("ConnectBlock(): Could not read strDZeel of Proposal\n");
-
-                    if (valRequest.isObject())
-                        metadata = valRequest.get_obj();
-                    else
-                        return error("ConnectBlock(): Could not read strDZeel of Proposal\n");
-
-                } catch (const UniValue& objError) {
-                    error("ConnectBlock(): Could not read strDZeel of Proposal\n");
-                } catch (const std::exception& e) {
-                    return error("ConnectBlock(): Could not read strDZeel of Proposal: %s\n", e.what());
-                }
-
-                CFund::CProposal proposal;
-
-                proposal.nAmount = find_value(metadata, "n").get_int64();
-                proposal.Address = find_value(metadata, "a").get_str();
-                proposal.nDeadline = find_value(metadata, "d").get_int64();
-                proposal.strDZeel = find_value(metadata, "s").get_str();
-                proposal.nVersion = find_value(metadata, "v").isNum() ? find_value(metadata, "v").get_int() : 1;
-                proposal.nFee = nProposalFee;
-                proposal.hash = tx.GetHash();
-                proposal.txblockhash = block.GetHash();
-
-                proposalIndex.push_back(make_pair(tx.GetHash(),proposal));
-
-                if(proposal.nAmount < 0) {
-                    return error("ConnectBlock(): Proposal cannot have an amount less than 0\n");
-                }
-
-                if (!pblocktree->UpdateProposalIndex(proposalIndex))
-                    return AbortNode(state, "Failed to write proposal index");
-
-                LogPrint("cfund","New proposal %s\n",tx.GetHash().ToString());
-
-            }
-
-            if(tx.nVersion == CTransaction::PAYMENT_REQUEST_VERSION && CFund::IsValidPaymentRequest(tx, nMaxVersionPaymentRequest)){
-                std::vector<std::pair<uint256, CFund::CProposal> > proposalIndex;
-                std::vector<std::pair<uint256, CFund::CPaymentRequest> > paymentRequestIndex;
-
-                UniValue metadata(UniValue::VOBJ);
-                try {
-                    UniValue valRequest;
-                    if (!valRequest.read(tx.strDZeel))
-                        return error("ConnectBlock(): Could not read strDZeel of Payment Request\n");
-
-                    if (valRequest.isObject())
-                        metadata = valRequest.get_obj();
-                    else
-                        return error("ConnectBlock(): Could not read strDZeel of Payment Request\n");
-
-                } catch (const UniValue& objError) {
-                    return error("ConnectBlock(): Could not read strDZeel of Payment Request\n");
-                } catch (const std::exception& e) {
-                    return error("ConnectBlock(): Could not read strDZeel of Payment Request: %s\n", e.what());
-                }  // May not return ever false, as transactions were already chcked.
-
-                CFund::CPaymentRequest prequest;
-
-                prequest.hash = tx.GetHash();
-                prequest.nAmount = find_value(metadata, "n").get_int64();
-                prequest.proposalhash = uint256S("0x" + find_value(metadata, "h").get_str());
-                prequest.strDZeel = find_value(metadata, "i").get_str();
-                prequest.nVersion = find_value(metadata, "v").isNum() ? find_value(metadata, "v").get_int() : 1;
-                prequest.txblockhash = block.GetHash();
-
-                if(prequest.nAmount < 0) {
-                    return error("ConnectBlock(): Payment request cannot have an amount less than 0\n");
+        // Read the strDZeel of proposals and payment requests and check the
+        // payment request signatures alongside the script checks, unless that
+        // was done when they entered the mempool; they are registered in
+        // block order once the checks are done
+        if(IsCommunityFundEnabled(pindex->pprev, Params().GetConsensus()) &&
+           (tx.nVersion == CTransaction::PROPOSAL_VERSION || tx.nVersion == CTransaction::PAYMENT_REQUEST_VERSION)) {
+            vCFundChecks.push_back(CFund::CTxCheck(tx));
+            CFund::CTxCheck& cfundCheck = vCFundChecks.back();
+            if (!CFund::txCheckCache.Get(tx, tx.nVersion == CTransaction::PAYMENT_REQUEST_VERSION, cfundCheck)) {
+                if (fScriptChecks && nScriptCheckThreads) {
+                    std::vector<CScriptCheck> vCFundCheck(1, CScriptCheck(&cfundCheck));
+                    control.Add(vCFundCheck);
+                } else {
+                    cfundCheck();
                 }
-
-                CFund::CProposal proposal;
-                if(!CFund::FindProposal(prequest.proposalhash, proposal))
-                    return error("ConnectBlock(): Could not find parent proposal of Payment Request: %s\n",
-                                 proposal.hash.ToString(), prequest.proposalhash.ToString());
-
-                std::vector<uint256>::iterator position = std::find(proposal.vPayments.begin(), proposal.vPayments.end(), tx.hash);
-                if (position == proposal.vPayments.end())
-                    proposal.vPayments.push_back(tx.hash);
-
-                proposalIndex.push_back(make_pair(prequest.proposalhash, proposal));
-                paymentRequestIndex.push_back(make_pair(tx.GetHash(), prequest));
-
-                if (!pblocktree->UpdateProposalIndex(proposalIndex))
-                    return AbortNode(state, "Failed to write proposal index");
-
-                if (!pblocktree->UpdatePaymentRequestIndex(paymentRequestIndex))
-                    return AbortNode(state, "Failed to write payment request index");
-
-                LogPrint("cfund","New payment request %s\n",tx.GetHash().ToString());
             }
         }
 
-
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -3302,7 +3379,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     std::vector<std::pair<uint256, CFund::CPaymentRequest> > paymentRequestIndex;
                     prequest.paymenthash = block.GetHash();
                     paymentRequestIndex.push_back(make_pair(prequest.hash, prequest));                
-                    if (!pblocktree->UpdatePaymentRequestIndex(paymentRequestIndex))
+                    if (!pcfundstate->UpdatePaymentRequestIndex(paymentRequestIndex))
                         return AbortNode(state, "Failed to write payment request index");
                 }
             } else {
@@ -3315,11 +3392,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (block.IsProofOfStake())
     {
-        // ppcoin: coin stake tx earns reward instead of paying fee
-        uint64_t nCoinAge;
-        if (!TransactionGetCoinAge(const_cast<CTransaction&>(block.vtx[1]), nCoinAge))
-            return error("ConnectBlock() : %s unable to get coin age for coinstake", block.vtx[1].GetHash().ToString());
-
         int64_t nCalculatedStakeReward = GetProofOfStakeReward(pindex->nHeight, nCoinAge, nFees, pindex->pprev);
 
         if (nStakeReward > nCalculatedStakeReward)
@@ -3327,14 +3399,100 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     if (!control.Wait()) {
+        if (stakeCheck.HasFailed())
+            return error("ContextualCheckBlock() : check proof-of-stake signature failed for block %s", block.GetHash().GetHex());
         return state.DoS(100, false);
     }
+
+    // Contextual part of the community fund checks, in block order as every
+    // payment request lowers the amount left to the next ones
+    if (!vCFundChecks.empty()) {
+        bool fReducedQuorum = IsReducedCFundQuorumEnabled(pindexBestHeader, Params().GetConsensus());
+        int nMaxVersionProposal = fReducedQuorum ? Params().GetConsensus().nProposalMaxVersion : 2;
+        int nMaxVersionPaymentRequest = fReducedQuorum ? Params().GetConsensus().nPaymentRequestMaxVersion : 2;
+
+        BOOST_FOREACH(const CFund::CTxCheck& check, vCFundChecks) {
+            const CTransaction& tx = *check.ptx;
+
+            // Kept for DisconnectBlock
+            CFund::txCheckCache.Add(check);
+
+            if(check.fContribution && tx.nVersion == CTransaction::PROPOSAL_VERSION && CFund::IsValidProposal(check, nMaxVersionProposal)){
+                std::vector<std::pair<uint256, CFund::CProposal> > proposalIndex;
+
+                CFund::CProposal proposal = check.proposal;
+                proposal.txblockhash = block.GetHash();
+
+                proposalIndex.push_back(make_pair(tx.GetHash(),proposal));
+
+                if(proposal.nAmount < 0) {
+                    return error("ConnectBlock(): Proposal cannot have an amount less than 0\n");
+                }
+
+                if (!pcfundstate->UpdateProposalIndex(proposalIndex))
+                    return AbortNode(state, "Failed to write proposal index");
+
+                LogPrint("cfund","New proposal %s\n",tx.GetHash().ToString());
+
+            }
+
+            if(tx.nVersion == CTransaction::PAYMENT_REQUEST_VERSION && CFund::IsValidPaymentRequest(check, nMaxVersionPaymentRequest)){
+                std::vector<std::pair<uint256, CFund::CProposal> > proposalIndex;
+                std::vector<std::pair<uint256, CFund::CPaymentRequest> > paymentRequestIndex;
+
+                CFund::CPaymentRequest prequest = check.prequest;
+                prequest.txblockhash = block.GetHash();
+
+                if(prequest.nAmount < 0) {
+                    return error("ConnectBlock(): Payment request cannot have an amount less than 0\n");
+                }
+
+                CFund::CProposal proposal;
+                if(!CFund::FindProposal(prequest.proposalhash, proposal))
+                    return error("ConnectBlock(): Could not find parent proposal of Payment Request: %s\n",
+                                 proposal.hash.ToString(), prequest.proposalhash.ToString());
+
+                std::vector<uint256>::iterator position = std::find(proposal.vPayments.begin(), proposal.vPayments.end(), tx.hash);
+                if (position == proposal.vPayments.end())
+                    proposal.vPayments.push_back(tx.hash);
+
+                proposalIndex.push_back(make_pair(prequest.proposalhash, proposal));
+                paymentRequestIndex.push_back(make_pair(tx.GetHash(), prequest));
+
+                if (!pcfundstate->UpdateProposalIndex(proposalIndex))
+                    return AbortNode(state, "Failed to write proposal index");
+
+                if (!pcfundstate->UpdatePaymentRequestIndex(paymentRequestIndex))
+                    return AbortNode(state, "Failed to write payment request index");
+
+                LogPrint("cfund","New payment request %s\n",tx.GetHash().ToString());
+            }
+        }
+    }
+
+    // Record proof hash value
+    if (block.IsProofOfStake())
+        pindex->hashProof = stakeCheck.GetHashProofOfStake();
+    else
+        pindex->hashProof = UintToArith256(block.GetPoWHash());
+
+    // Flag the block index so we can be sure it will be saved on disk
+    if (!pindex->IsValid(BLOCK_VALID_STAKE))
+    {
+        pindex->RaiseValidity(BLOCK_VALID_STAKE);
+        setDirtyBlockIndex.insert(pindex);
+    }
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
     if (fJustCheck)
         return true;
 
+    pblocktree->WriteBlockVotes(pindex->GetBlockHash(), blockVotes);
+    setDirtyBlockIndex.insert(pindex);
+    if (fNewerWallet)
+        setNewerWalletBlocks.insert(pindex);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
@@ -3372,6 +3530,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fColdStakingIndex)
+        if (!pblocktree->UpdateColdStakingIndex(coldStakingIndex))
+            return AbortNode(state, "Failed to write cold staking index");
+
     if (fTimestampIndex) {
         unsigned int logicalTS = pindex->nTime;
         unsigned int prevLogicalTS = 0;
@@ -3494,9 +3656,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 vBlocks.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
-            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+            // The community fund state is only kept in memory between flushes
+            std::vector<std::pair<uint256, CFund::CProposal> > vProposals;
+            std::vector<std::pair<uint256, CFund::CPaymentRequest> > vPaymentRequests;
+            pcfundstate->GetDirty(vProposals, vPaymentRequests);
+            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, vProposals, vPaymentRequests, &pcfundstate->GetVoteTally())) {
                 return AbortNode(state, "Files to write to block index database");
             }
+            pcfundstate->ClearDirty();
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -3555,6 +3722,14 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
 
     cvBlockChange.notify_all();
 
+    // Blocks more than 1000 below the tip do not count any more
+    for (std::set<const CBlockIndex*>::iterator it = setNewerWalletBlocks.begin(); it != setNewerWalletBlocks.end(); ) {
+        if ((*it)->nHeight + 1000 <= chainActive.Height())
+            setNewerWalletBlocks.erase(it++);
+        else
+            it++;
+    }
+
     static bool fWarned = false;
     std::vector<std::string> warningMessages;
     if (!IsInitialBlockDownload())
@@ -3583,9 +3758,7 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
         // Check the version of the last 1000 blocks to see if we need to upgrade:
         for (int i = 0; i < 1000 && pindex != NULL; i++)
         {
-            int32_t nExpectedVersion = CLIENT_VERSION;
-            if (atoi(pindex->strDZeel.substr(pindex->strDZeel.find(";") + 1).c_str()) > nExpectedVersion
-                    && pindex->strDZeel.find(';') != std::string::npos)
+            if (setNewerWalletBlocks.count(pindex))
                 ++nUpgraded;
             pindex = pindex->pprev;
         }
@@ -3618,6 +3791,14 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
 
 }
 
+/** Community fund votes of a connected block, read on demand as they are not kept in the block index */
+static bool GetBlockVotes(const CBlockIndex* pindex, CBlockVotes& votes)
+{
+    if (!pblocktree->ReadBlockVotes(pindex->GetBlockHash(), votes))
+        return error("%s: failed to read the votes of block %s", __func__, pindex->GetBlockHash().ToString());
+    return true;
+}
+
 /** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
 bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, bool fBare = false)
 {
@@ -3627,6 +3808,9 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     CBlock block;
     if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
         return AbortNode(state, "Failed to read block");
+    CBlockVotes deleteVotes;
+    if (!GetBlockVotes(pindexDelete, deleteVotes))
+        return AbortNode(state, "Failed to read block votes");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
@@ -3674,7 +3858,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     CFund::CProposal proposal; CFund::CPaymentRequest prequest;
     std::map<uint256, bool> vSeen;
 
-    if(pblocktree->GetPaymentRequestIndex(vecPaymentRequest)){
+    if(pcfundstate->GetPaymentRequestIndex(vecPaymentRequest)){
         for(unsigned int i = 0; i < vecPaymentRequest.size(); i++) {
             prequest = vecPaymentRequest[i];
             bool fUpdate = false;
@@ -3689,7 +3873,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
             }
             if(fUpdate) {
                 vecPaymentRequestsToUpdate.push_back(make_pair(prequest.hash, prequest));
-                if (!pblocktree->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
+                if (!pcfundstate->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
                     AbortNode(state, "Failed to write payment request index");
                 }
                 vecPaymentRequestsToUpdate.clear();
@@ -3697,14 +3881,14 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         }
     }
 
-    if(pblocktree->GetProposalIndex(vecProposal)){
+    if(pcfundstate->GetProposalIndex(vecProposal)){
         for(unsigned int i = 0; i < vecProposal.size(); i++) {
             proposal = vecProposal[i];
             if(proposal.blockhash == pindexDelete->GetBlockHash()) {
                 proposal.blockhash = uint256();
                 proposal.fState = CFund::NIL;
                 vecProposalsToUpdate.push_back(make_pair(proposal.hash, proposal));
-                if (!pblocktree->UpdateProposalIndex(vecProposalsToUpdate)) {
+                if (!pcfundstate->UpdateProposalIndex(vecProposalsToUpdate)) {
                     AbortNode(state, "Failed to write proposal index");
                 }
                 vecProposalsToUpdate.clear();
@@ -3712,24 +3896,25 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         }
     }
 
-    for(unsigned int i = 0; i < pindexDelete->vProposalVotes.size(); i++) {
-        if(!CFund::FindProposal(pindexDelete->vProposalVotes[i].first, proposal))
+
+    for(unsigned int i = 0; i < deleteVotes.vProposalVotes.size(); i++) {
+        if(!CFund::FindProposal(deleteVotes.vProposalVotes[i].first, proposal))
             continue;
-        if(vSeen.count(pindexDelete->vProposalVotes[i].first) == 0) {
-            if(vCacheProposalsToUpdate.count(pindexDelete->vProposalVotes[i].first) == 0)
-                vCacheProposalsToUpdate[pindexDelete->vProposalVotes[i].first] = make_pair(proposal.nVotesYes, proposal.nVotesNo);
-            if(pindexDelete->vProposalVotes[i].second)
-                vCacheProposalsToUpdate[pindexDelete->vProposalVotes[i].first].first -= 1;
+        if(vSeen.count(deleteVotes.vProposalVotes[i].first) == 0) {
+            if(vCacheProposalsToUpdate.count(deleteVotes.vProposalVotes[i].first) == 0)
+                vCacheProposalsToUpdate[deleteVotes.vProposalVotes[i].first] = make_pair(proposal.nVotesYes, proposal.nVotesNo);
+            if(deleteVotes.vProposalVotes[i].second)
+                vCacheProposalsToUpdate[deleteVotes.vProposalVotes[i].first].first -= 1;
             else
-                vCacheProposalsToUpdate[pindexDelete->vProposalVotes[i].first].second -= 1;
-            vSeen[pindexDelete->vProposalVotes[i].first]=true;
+                vCacheProposalsToUpdate[deleteVotes.vProposalVotes[i].first].second -= 1;
+            vSeen[deleteVotes.vProposalVotes[i].first]=true;
         }
     }
 
     vSeen.clear();
 
-    for(unsigned int i = 0; i < pindexDelete->vPaymentRequestVotes.size(); i++) {
-        if(!CFund::FindPaymentRequest(pindexDelete->vPaymentRequestVotes[i].first, prequest))
+    for(unsigned int i = 0; i < deleteVotes.vPaymentRequestVotes.size(); i++) {
+        if(!CFund::FindPaymentRequest(deleteVotes.vPaymentRequestVotes[i].first, prequest))
             continue;
         if(!CFund::FindProposal(prequest.proposalhash, proposal))
             continue;
@@ -3738,14 +3923,14 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         CBlockIndex* pindexblockparent = mapBlockIndex[proposal.blockhash];
         if(pindexblockparent == NULL)
             continue;
-        if(vSeen.count(pindexDelete->vPaymentRequestVotes[i].first) == 0) {
-            if(vCachePaymentRequestToUpdate.count(pindexDelete->vPaymentRequestVotes[i].first) == 0)
-                vCachePaymentRequestToUpdate[pindexDelete->vPaymentRequestVotes[i].first] = make_pair(prequest.nVotesYes, prequest.nVotesNo);
-            if(pindexDelete->vPaymentRequestVotes[i].second)
-                vCachePaymentRequestToUpdate[pindexDelete->vPaymentRequestVotes[i].first].first -= 1;
+        if(vSeen.count(deleteVotes.vPaymentRequestVotes[i].first) == 0) {
+            if(vCachePaymentRequestToUpdate.count(deleteVotes.vPaymentRequestVotes[i].first) == 0)
+                vCachePaymentRequestToUpdate[deleteVotes.vPaymentRequestVotes[i].first] = make_pair(prequest.nVotesYes, prequest.nVotesNo);
+            if(deleteVotes.vPaymentRequestVotes[i].second)
+                vCachePaymentRequestToUpdate[deleteVotes.vPaymentRequestVotes[i].first].first -= 1;
             else
-                vCachePaymentRequestToUpdate[pindexDelete->vPaymentRequestVotes[i].first].second -= 1;
-            vSeen[pindexDelete->vPaymentRequestVotes[i].first]=true;
+                vCachePaymentRequestToUpdate[deleteVotes.vPaymentRequestVotes[i].first].second -= 1;
+            vSeen[deleteVotes.vPaymentRequestVotes[i].first]=true;
         }
     }
 
@@ -3770,11 +3955,11 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         vecPaymentRequestsToUpdate.push_back(make_pair(prequest.hash, prequest));
     }
 
-    if (!pblocktree->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
+    if (!pcfundstate->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
         AbortNode(state, "Failed to write payment request index");
     }
 
-    if (!pblocktree->UpdateProposalIndex(vecProposalsToUpdate)) {
+    if (!pcfundstate->UpdateProposalIndex(vecProposalsToUpdate)) {
         AbortNode(state, "Failed to write proposal index");
     }
 
@@ -3858,76 +4043,156 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     return true;
 }
 
-std::map<uint256, std::pair<int, int>> vCacheProposalsToUpdate;
-std::map<uint256, std::pair<int, int>> vCachePaymentRequestToUpdate;
+//! Vote counts of the last completed cycle, to step back over a cycle boundary (protected by cs_main)
+static CFund::CVoteTally voteTallyPrevCycle;
 
-void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
+/**
+ * Bring the vote counts of the current cycle to pindexNew. Connecting or
+ * disconnecting a single block only applies the votes of that block, the
+ * cycle is only recounted, reading the votes of all its blocks, when the
+ * counts do not belong to a neighbour of pindexNew. Returns false, leaving
+ * the counts empty, when the votes of a block could not be read.
+ */
+static bool UpdateVoteTally(CBlockIndex *pindexNew, bool fUndo)
 {
-    int64_t nTimeStart = GetTimeMicros();
-    CFund::CPaymentRequest prequest; CFund::CProposal proposal;
-
-    int nBlocks = (pindexNew->nHeight % Params().GetConsensus().nBlocksPerVotingCycle) + 1;
-    CBlockIndex* pindexblock = pindexNew;
+    CFund::CVoteTally& tally = pcfundstate->GetVoteTally();
+    const int nBlocksPerVotingCycle = Params().GetConsensus().nBlocksPerVotingCycle;
+    CBlockVotes votes;
 
-    std::map<uint256, bool> vSeen;
+    if (!fUndo && pindexNew->nHeight % nBlocksPerVotingCycle == 0) {
+        // First block of a cycle
+        if (pindexNew->pprev && tally.hashBlock == pindexNew->pprev->GetBlockHash())
+            voteTallyPrevCycle = tally;
+        else
+            voteTallyPrevCycle.SetNull();
+        tally.SetNull();
+        if (!GetBlockVotes(pindexNew, votes))
+            return false;
+        tally.AddBlock(votes, 1);
+        tally.hashBlock = pindexNew->GetBlockHash();
+        return true;
+    }
 
-    if (fUndo || nBlocks == 1 || vCacheProposalsToUpdate.empty() || vCachePaymentRequestToUpdate.empty()) {
-        vCacheProposalsToUpdate.clear();
-        vCachePaymentRequestToUpdate.clear();
-    } else {
-        nBlocks = 1;
+    if (!fUndo && pindexNew->pprev && tally.hashBlock == pindexNew->pprev->GetBlockHash()) {
+        if (!GetBlockVotes(pindexNew, votes)) {
+            tally.SetNull();
+            return false;
+        }
+        tally.AddBlock(votes, 1);
+        tally.hashBlock = pindexNew->GetBlockHash();
+        return true;
     }
 
-    int64_t nTimeStart2 = GetTimeMicros();
-    while(nBlocks > 0 && pindexblock != NULL) {
-        vSeen.clear();
-        for(unsigned int i = 0; i < pindexblock->vProposalVotes.size(); i++) {
-            if(!CFund::FindProposal(pindexblock->vProposalVotes[i].first, proposal))
-                continue;
-            if(vSeen.count(pindexblock->vProposalVotes[i].first) == 0) {
-                if(vCacheProposalsToUpdate.count(pindexblock->vProposalVotes[i].first) == 0)
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first] = make_pair(0, 0);
-                if(pindexblock->vProposalVotes[i].second)
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first].first += 1;
-                else
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first].second += 1;
-                vSeen[pindexblock->vProposalVotes[i].first]=true;
+    if (fUndo && tally.hashBlock != pindexNew->GetBlockHash()) {
+        BlockMap::iterator mi = mapBlockIndex.find(tally.hashBlock);
+        CBlockIndex* pindexDelete = mi == mapBlockIndex.end() ? NULL : mi->second;
+        if (pindexDelete && pindexDelete->pprev == pindexNew) {
+            if (pindexDelete->nHeight % nBlocksPerVotingCycle != 0) {
+                if (!GetBlockVotes(pindexDelete, votes)) {
+                    tally.SetNull();
+                    return false;
+                }
+                tally.AddBlock(votes, -1);
+                tally.hashBlock = pindexNew->GetBlockHash();
+                return true;
             }
-        }
-        for(unsigned int i = 0; i < pindexblock->vPaymentRequestVotes.size(); i++) {
-            if(!CFund::FindPaymentRequest(pindexblock->vPaymentRequestVotes[i].first, prequest))
-                continue;
-            if(!CFund::FindProposal(prequest.proposalhash, proposal))
-                continue;
-            if (mapBlockIndex.count(proposal.blockhash) == 0)
-                continue;
-            CBlockIndex* pindexblockparent = mapBlockIndex[proposal.blockhash];
-            if(pindexblockparent == NULL)
-                continue;
-            if(vSeen.count(pindexblock->vPaymentRequestVotes[i].first) == 0) {
-                if(vCachePaymentRequestToUpdate.count(pindexblock->vPaymentRequestVotes[i].first) == 0)
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first] = make_pair(0, 0);
-                if(pindexblock->vPaymentRequestVotes[i].second)
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first].first += 1;
-                else
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first].second += 1;
-                vSeen[pindexblock->vPaymentRequestVotes[i].first]=true;
+            if (voteTallyPrevCycle.hashBlock == pindexNew->GetBlockHash()) {
+                tally = voteTallyPrevCycle;
+                voteTallyPrevCycle.SetNull();
+                return true;
             }
         }
+    }
+
+    if (tally.hashBlock == pindexNew->GetBlockHash())
+        return true;
+
+    // Count the cycle again
+    int64_t nTimeStart = GetTimeMicros();
+    tally.SetNull();
+    int nBlocks = (pindexNew->nHeight % nBlocksPerVotingCycle) + 1;
+    CBlockIndex* pindexblock = pindexNew;
+    while(nBlocks > 0 && pindexblock != NULL) {
+        if (!GetBlockVotes(pindexblock, votes)) {
+            tally.SetNull();
+            return false;
+        }
+        tally.AddBlock(votes, 1);
         pindexblock = pindexblock->pprev;
         nBlocks--;
     }
-    int64_t nTimeEnd2 = GetTimeMicros();
-    LogPrint("bench-cfund", "  - CFund count votes from headers: %.2fms\n", (nTimeEnd2 - nTimeStart2) * 0.001);
+    tally.hashBlock = pindexNew->GetBlockHash();
+    LogPrint("bench-cfund", "  - CFund count votes from headers: %.2fms\n", (GetTimeMicros() - nTimeStart) * 0.001);
+    return true;
+}
 
+bool UpdateCycleStats(CBlockIndex *pindexNew)
+{
+    AssertLockHeld(cs_main);
 
-    vSeen.clear();
+    if (pcfundstate->GetVoteTally().hashBlock != pindexNew->GetBlockHash() && !UpdateVoteTally(pindexNew, false))
+        return error("%s: could not count the votes of the cycle at %s", __func__, pindexNew->GetBlockHash().ToString());
+
+    const CFund::CVoteTally& tally = pcfundstate->GetVoteTally();
+    CFund::CPaymentRequest prequest; CFund::CProposal proposal;
+    CFund::CCycleStats stats;
+    stats.nHeight = pindexNew->nHeight;
+    stats.nCFSupply = pindexNew->nCFSupply;
+    stats.nCFLocked = pindexNew->nCFLocked;
+
+    std::map<uint256, std::pair<int, int>>::const_iterator it;
+    for(it = tally.mapProposalVotes.begin(); it != tally.mapProposalVotes.end(); it++) {
+        if(!CFund::FindProposal(it->first, proposal))
+            continue;
+        CFund::CCycleVotes votes;
+        votes.hash = proposal.hash;
+        votes.strDZeel = proposal.strDZeel;
+        votes.nAmount = proposal.nAmount;
+        votes.nVotesYes = it->second.first;
+        votes.nVotesNo = it->second.second;
+        stats.vProposals.push_back(votes);
+    }
+    for(it = tally.mapPaymentRequestVotes.begin(); it != tally.mapPaymentRequestVotes.end(); it++) {
+        if(!CFund::FindPaymentRequest(it->first, prequest))
+            continue;
+        if(!CFund::FindProposal(prequest.proposalhash, proposal))
+            continue;
+        if (mapBlockIndex.count(proposal.blockhash) == 0 || mapBlockIndex[proposal.blockhash] == NULL)
+            continue;
+        CFund::CCycleVotes votes;
+        votes.hash = prequest.hash;
+        votes.strDZeel = prequest.strDZeel;
+        votes.strProposalDZeel = proposal.strDZeel;
+        votes.nAmount = prequest.nAmount;
+        votes.nVotesYes = it->second.first;
+        votes.nVotesNo = it->second.second;
+        stats.vPaymentRequests.push_back(votes);
+    }
+
+    pcfundstate->SetCycleStats(stats);
+    return true;
+}
+
+void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    CFund::CPaymentRequest prequest; CFund::CProposal proposal;
+
+    std::map<uint256, bool> vSeen;
+
+    // Applying an incomplete tally would overwrite the vote counts of every proposal
+    if (!UpdateVoteTally(pindexNew, fUndo)) {
+        AbortNode(state, "Failed to read block votes");
+        return;
+    }
+
+    const CFund::CVoteTally& tally = pcfundstate->GetVoteTally();
 
     int64_t nTimeStart3 = GetTimeMicros();
-    std::map<uint256, std::pair<int, int>>::iterator it;
+    std::map<uint256, std::pair<int, int>>::const_iterator it;
     std::vector<std::pair<uint256, CFund::CProposal>> vecProposalsToUpdate;
     std::vector<std::pair<uint256, CFund::CPaymentRequest>> vecPaymentRequestsToUpdate;
-    for(it = vCacheProposalsToUpdate.begin(); it != vCacheProposalsToUpdate.end(); it++) {
+    for(it = tally.mapProposalVotes.begin(); it != tally.mapProposalVotes.end(); it++) {
         if(!CFund::FindProposal(it->first, proposal))
             continue;
         proposal.nVotesYes = it->second.first;
@@ -3935,20 +4200,27 @@ void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
         vSeen[proposal.hash]=true;
         vecProposalsToUpdate.push_back(make_pair(proposal.hash, proposal));
     }
-    for(it = vCachePaymentRequestToUpdate.begin(); it != vCachePaymentRequestToUpdate.end(); it++) {
+    for(it = tally.mapPaymentRequestVotes.begin(); it != tally.mapPaymentRequestVotes.end(); it++) {
         if(!CFund::FindPaymentRequest(it->first, prequest))
             continue;
+        if(!CFund::FindProposal(prequest.proposalhash, proposal))
+            continue;
+        if (mapBlockIndex.count(proposal.blockhash) == 0)
+            continue;
+        CBlockIndex* pindexblockparent = mapBlockIndex[proposal.blockhash];
+        if(pindexblockparent == NULL)
+            continue;
         prequest.nVotesYes = it->second.first;
         prequest.nVotesNo = it->second.second;
         vSeen[prequest.hash]=true;
         vecPaymentRequestsToUpdate.push_back(make_pair(prequest.hash, prequest));
     }
 
-    if (!pblocktree->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
+    if (!pcfundstate->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
         AbortNode(state, "Failed to write payment request index");
     }
 
-    if (!pblocktree->UpdateProposalIndex(vecProposalsToUpdate)) {
+    if (!pcfundstate->UpdateProposalIndex(vecProposalsToUpdate)) {
         AbortNode(state, "Failed to write proposal index");
     }
     int64_t nTimeEnd3 = GetTimeMicros();
@@ -3957,7 +4229,7 @@ void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
     std::vector<CFund::CPaymentRequest> vecPaymentRequest;
 
     int64_t nTimeStart4 = GetTimeMicros();
-    if(pblocktree->GetPaymentRequestIndex(vecPaymentRequest)){
+    if(pcfundstate->GetPaymentRequestIndex(vecPaymentRequest)){
         for(unsigned int i = 0; i < vecPaymentRequest.size(); i++) {
             vecPaymentRequestsToUpdate.clear();
             bool fUpdate = false;
@@ -4031,7 +4303,7 @@ void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
             }
             if(fUpdate) {
                 vecPaymentRequestsToUpdate.push_back(make_pair(prequest.hash, prequest));
-                if (!pblocktree->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
+                if (!pcfundstate->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
                     AbortNode(state, "Failed to write payment request index");
                 }
             }
@@ -4045,7 +4317,7 @@ void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
     std::vector<CFund::CProposal> vecProposal;
 
     int64_t nTimeStart5 = GetTimeMicros();
-    if(pblocktree->GetProposalIndex(vecProposal)){
+    if(pcfundstate->GetProposalIndex(vecProposal)){
         for(unsigned int i = 0; i < vecProposal.size(); i++) {
             bool fUpdate = false;
             proposal = vecProposal[i];
@@ -4136,14 +4408,16 @@ void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo)
 
     LogPrint("bench-cfund", "  - CFund update proposal status: %.2fms\n", (nTimeEnd5 - nTimeStart5) * 0.001);
 
-    if (!pblocktree->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
+    if (!pcfundstate->UpdatePaymentRequestIndex(vecPaymentRequestsToUpdate)) {
         AbortNode(state, "Failed to write payment request index");
     }
 
-    if (!pblocktree->UpdateProposalIndex(vecProposalsToUpdate)) {
+    if (!pcfundstate->UpdateProposalIndex(vecProposalsToUpdate)) {
         AbortNode(state, "Failed to write proposal index");
     }
 
+    UpdateCycleStats(pindexNew);
+
     int64_t nTimeEnd = GetTimeMicros();
     LogPrint("bench", "- CFund total CountVotes() function: %.2fms\n", (nTimeEnd - nTimeStart) * 0.001);
 }
@@ -4479,12 +4753,12 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256* phash = NULL)
 {
 
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
@@ -4655,12 +4929,12 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, const uint256* phash)
 {
     // Check proof of work matches claimed amount
     CBlockIndex pblock = CBlockIndex(block);
     if (pblock.IsProofOfWork())
-        if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+        if (!CheckProofOfWork(phash ? *phash : block.GetHash(), block.nBits, consensusParams))
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -5100,11 +5374,16 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/**
+ * Add a header to the block index. phash optionally passes the already
+ * computed hash of the header, fCheckHeader is false when CheckBlockHeader
+ * already succeeded for it (see CheckBlockHeaders).
+ */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, const uint256* phash=NULL, bool fCheckHeader=true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -5119,7 +5398,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), false))
+        if (fCheckHeader && !CheckBlockHeader(block, state, chainparams.GetConsensus(), false, &hash))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -5141,7 +5420,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     }
 
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, &hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -5557,6 +5836,28 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // Address indexes created before the address balances were kept need them computed once
+    if (fAddressIndex) {
+        bool fAddressBalanceIndex = false;
+        pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+        if (!fAddressBalanceIndex) {
+            LogPrintf("%s: building the address balance index\n", __func__);
+            if (!pblocktree->BuildAddressBalanceIndex())
+                return error("%s: failed to build the address balance index", __func__);
+            pblocktree->WriteFlag("addressbalanceindex", true);
+        }
+    }
+
+    // Databases created while the votes were part of the block index records need them moved once
+    bool fBlockVotesIndex = false;
+    pblocktree->ReadFlag("blockvotes", fBlockVotesIndex);
+    if (!fBlockVotesIndex) {
+        LogPrintf("%s: moving the block votes out of the block index\n", __func__);
+        if (!pblocktree->BuildBlockVotesIndex())
+            return error("%s: failed to move the block votes", __func__);
+        pblocktree->WriteFlag("blockvotes", true);
+    }
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -5565,6 +5866,10 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have a cold staking index
+    pblocktree->ReadFlag("coldstakingindex", fColdStakingIndex);
+    LogPrintf("%s: cold staking index %s\n", __func__, fColdStakingIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -5777,6 +6082,8 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    stakeModifierWindow.Clear();
+    stakingStats.Clear();
     mempool.clear();
     mapOrphanTransactions.clear();
     mapOrphanTransactionsByPrev.clear();
@@ -5789,6 +6096,7 @@ void UnloadBlockIndex()
     mapBlocksInFlight.clear();
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
+    setNewerWalletBlocks.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
     recentRejects.reset(NULL);
@@ -5823,6 +6131,9 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
+    // Block votes are kept in their own records in the new database
+    pblocktree->WriteFlag("blockvotes", true);
+
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
@@ -5831,6 +6142,7 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
     // Use the provided setting for -timestampindex in the new database
@@ -5843,6 +6155,11 @@ bool InitBlockIndex(const CChainParams& chainparams)
     pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Use the provided setting for -coldstakingindex in the new database
+    fColdStakingIndex = GetBoolArg("-coldstakingindex", DEFAULT_COLDSTAKINGINDEX);
+    pblocktree->WriteFlag("coldstakingindex", fColdStakingIndex);
+    LogPrintf("%s: cold staking index %s\n", __func__, fColdStakingIndex ? "enabled" : "disabled");
+
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -7377,6 +7694,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             //ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Hash and check the headers in parallel before taking cs_main, so the
+        // locked stage below only has to link them into the block index
+        std::vector<CBlockHeader> vHeaders(headers.begin(), headers.end());
+        std::vector<uint256> vHashes;
+        std::vector<unsigned char> vValid;
+        CheckBlockHeaders(vHeaders, vHashes, vValid, chainparams.GetConsensus());
+
         {
         LOCK(cs_main);
 
@@ -7399,14 +7723,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             nodestate->nUnconnectingHeaders++;
             pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
             LogPrint("net", "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
-                    headers[0].GetHash().ToString(),
+                    vHashes[0].ToString(),
                     headers[0].hashPrevBlock.ToString(),
                     pindexBestHeader->nHeight,
                     pfrom->id, nodestate->nUnconnectingHeaders);
             // Set hashLastUnknownBlock for this peer, so that if we
             // eventually get the headers - even from a different peer -
             // we can use this peer to download.
-            UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+            UpdateBlockAvailability(pfrom->GetId(), vHashes.back());
 
             if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -7424,16 +7748,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         CBlockIndex *pindexLast = NULL;
 
-        BOOST_FOREACH(const CBlock& header, headers) {
+        for (unsigned int i = 0; i < vHeaders.size(); i++) {
+            const CBlockHeader& pblockheader = vHeaders[i];
             CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+            if (pindexLast != NULL && pblockheader.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 ret = false;
                 strError = "non-continuous headers sequence";
                 break;
             }
-            CBlockHeader pblockheader = CBlockHeader(header);
-            if (!AcceptBlockHeader(pblockheader, state, chainparams, &pindexLast)) {
+            // Headers which failed the context-free checks go through the
+            // full serial path, which reports the failure
+            bool fAccepted = vValid[i] ? AcceptBlockHeader(pblockheader, state, chainparams, &pindexLast, &vHashes[i], false)
+                                       : AcceptBlockHeader(pblockheader, state, chainparams, &pindexLast);
+            if (!fAccepted) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -8522,7 +8850,90 @@ arith_uint256 GetProofOfStakeLimit(int nHeight)
     return (bnProofOfStakeLimitV2);
 }
 
-bool TransactionGetCoinAge(CTransaction& transaction, uint64_t& nCoinAge)
+/**
+ * Find the output spent by a proof-of-stake input, with the time of its
+ * transaction and the block which included it (NULL when that block is not
+ * known). Unspent outputs are served from the UTXO set; spent outputs and
+ * coins written before the transaction time was stored are read with
+ * GetTransaction.
+ */
+static bool GetStakePrevout(const COutPoint& prevout, CTxOut& txoutRet, unsigned int& nTimeTxRet, CBlockIndex*& pindexFromRet)
+{
+    LOCK(cs_main);
+
+    const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+    if (coins && coins->nTime != 0 && coins->IsAvailable(prevout.n) && coins->nHeight <= chainActive.Height())
+    {
+        txoutRet = coins->vout[prevout.n];
+        nTimeTxRet = coins->nTime;
+        pindexFromRet = chainActive[coins->nHeight];
+        return true;
+    }
+
+    CTransaction txPrev;
+    uint256 hashBlock = uint256();
+    if (!GetTransaction(prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true) || prevout.n >= txPrev.vout.size())
+        return false;
+
+    txoutRet = txPrev.vout[prevout.n];
+    nTimeTxRet = txPrev.nTime;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    pindexFromRet = mi == mapBlockIndex.end() ? NULL : mi->second;
+    return true;
+}
+
+/**
+ * Coin ages of recent coinstakes, so the staker's reward estimate and the
+ * validation of the block carrying the coinstake (and its reconnection after
+ * a reorg) compute it only once. The coin age only depends on the inputs, the
+ * transaction time and the chain they are looked up in, which together make
+ * the key.
+ */
+class CCoinAgeCache
+{
+private:
+    CCriticalSection cs;
+    std::map<uint256, uint64_t> mapCoinAge;
+    std::deque<uint256> vKeys;
+
+public:
+    static const size_t nMaxEntries = 256;
+
+    static uint256 GetKey(const CTransaction& tx, const uint256& hashPrevBlock)
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << hashPrevBlock << tx.nTime;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            ss << txin.prevout;
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256& key, uint64_t& nCoinAge)
+    {
+        LOCK(cs);
+        std::map<uint256, uint64_t>::const_iterator it = mapCoinAge.find(key);
+        if (it == mapCoinAge.end())
+            return false;
+        nCoinAge = it->second;
+        return true;
+    }
+
+    void Add(const uint256& key, uint64_t nCoinAge)
+    {
+        LOCK(cs);
+        if (!mapCoinAge.insert(std::make_pair(key, nCoinAge)).second)
+            return;
+        vKeys.push_back(key);
+        while (vKeys.size() > nMaxEntries) {
+            mapCoinAge.erase(vKeys.front());
+            vKeys.pop_front();
+        }
+    }
+};
+
+static CCoinAgeCache coinAgeCache;
+
+bool TransactionGetCoinAge(const CTransaction& transaction, const CCoinsViewCache& view, const CBlockIndex* pindexPrev, uint64_t& nCoinAge)
 {
     arith_uint256 bnCentSecond = 0;  // coin age in the unit of cent-seconds
     nCoinAge = 0;
@@ -8530,31 +8941,50 @@ bool TransactionGetCoinAge(CTransaction& transaction, uint64_t& nCoinAge)
     if (transaction.IsCoinBase())
         return true;
 
+    if (!pindexPrev)
+        return false;
+
+    uint256 key = CCoinAgeCache::GetKey(transaction, pindexPrev->GetBlockHash());
+    if (coinAgeCache.Get(key, nCoinAge))
+        return true;
+
     BOOST_FOREACH(const CTxIn& txin, transaction.vin)
     {
-        // First try finding the previous transaction in database
-        CTransaction txPrev;
-        uint256 hashBlock = uint256();
-
-        if (!GetTransaction(txin.prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true))
-            continue;  // previous transaction not in main chain
+        CTxOut txoutPrev;
+        unsigned int nTimeTxPrev = 0;
+        const CBlockIndex* pblockindex = NULL;
+
+        // Inputs are read from the view, which does not need a disk read for
+        // coins stored with their transaction time
+        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+        if (coins && coins->nTime != 0 && coins->IsAvailable(txin.prevout.n))
+        {
+            txoutPrev = coins->vout[txin.prevout.n];
+            nTimeTxPrev = coins->nTime;
+            pblockindex = pindexPrev->GetAncestor(coins->nHeight);
+        }
+        else
+        {
+            CBlockIndex* pindexFrom = NULL;
+            if (!GetStakePrevout(txin.prevout, txoutPrev, nTimeTxPrev, pindexFrom))
+                continue;  // previous transaction not in main chain
+            pblockindex = pindexFrom;
+        }
 
-        if (transaction.nTime < txPrev.nTime)
+        if (transaction.nTime < nTimeTxPrev)
             return false;  // Transaction timestamp violation
 
-        if (mapBlockIndex.count(hashBlock) == 0)
+        if (!pblockindex)
             return false; //Block not found
 
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-
         if (pblockindex->nTime + Params().GetConsensus().nStakeMinAge > transaction.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-        bnCentSecond += arith_uint256(nValueIn) * (transaction.nTime-txPrev.nTime) / CENT;
+        int64_t nValueIn = txoutPrev.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (transaction.nTime-nTimeTxPrev) / CENT;
 
 
-        LogPrint("coinage", "coin age nValueIn=%d nTimeDiff=%d bnCentSecond=%s\n", nValueIn, transaction.nTime - txPrev.nTime, bnCentSecond.ToString());
+        LogPrint("coinage", "coin age nValueIn=%d nTimeDiff=%d bnCentSecond=%s\n", nValueIn, transaction.nTime - nTimeTxPrev, bnCentSecond.ToString());
     }
 
 
@@ -8562,9 +8992,17 @@ bool TransactionGetCoinAge(CTransaction& transaction, uint64_t& nCoinAge)
     LogPrint("coinage", "coin age bnCoinDay=%s\n", bnCoinDay.ToString());
     nCoinAge = bnCoinDay.GetLow64();
 
+    coinAgeCache.Add(key, nCoinAge);
+
     return true;
 }
 
+bool TransactionGetCoinAge(const CTransaction& transaction, uint64_t& nCoinAge)
+{
+    LOCK(cs_main);
+    return TransactionGetCoinAge(transaction, *pcoinsTip, chainActive.Tip(), nCoinAge);
+}
+
 using namespace std;
 
 // Get time weight
@@ -8611,52 +9049,38 @@ static int64_t GetStakeModifierSelectionInterval()
 }
 
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
+// already selected blocks in vSelected, and with timestamp up to
 // nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
+static bool SelectBlockFromCandidates(vector<CStakeModifierCandidate*>& vSortedByTimestamp, vector<bool>& vSelected,
     int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected)
 {
     bool fSelected = false;
     uint256 hashBest = uint256();
+    size_t nBest = 0;
     *pindexSelected = (const CBlockIndex*) 0;
-    BOOST_FOREACH(const PAIRTYPE(int64_t, uint256)& item, vSortedByTimestamp)
+    for (size_t i = 0; i < vSortedByTimestamp.size(); i++)
     {
-        if (!mapBlockIndex.count(item.second))
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString());
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop){
-//            LogPrint("stakemodifier", "SelectBlockFromCandidates: selection hash=%s index=%d proofhash=%s nStakeModifierPrev=%08x\n", hashBest.ToString(), pindex->nHeight, pindex->hashProof.ToString(), nStakeModifierPrev);
+        CStakeModifierCandidate* pcandidate = vSortedByTimestamp[i];
+        if (fSelected && pcandidate->nTime > nSelectionIntervalStop)
             break;
 
-        }
-
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (vSelected[i])
             continue;
-        // compute the selection hash by hashing its proof-hash and the
-        // previous proof-of-stake modifier
-        CDataStream ss(SER_GETHASH, 0);
-        ss << ArithToUint256(pindex->hashProof) << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-
 
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection = ArithToUint256(UintToArith256(hashSelection) >> 32);
+        const uint256& hashSelection = pcandidate->GetSelectionHash(nStakeModifierPrev);
 
-        if (fSelected && hashSelection < hashBest)
-        {
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
-        }
-        else if (!fSelected)
+        if (!fSelected || hashSelection < hashBest)
         {
             fSelected = true;
             hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            nBest = i;
         }
     }
+    if (fSelected)
+    {
+        vSelected[nBest] = true;
+        *pindexSelected = vSortedByTimestamp[nBest]->pindex;
+    }
     return fSelected;
 }
 
@@ -8691,39 +9115,33 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     if (nModifierTime / Params().GetConsensus().nModifierInterval >= pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval)
         return true;
 
-    // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256> > vSortedByTimestamp;
-    vSortedByTimestamp.reserve(64 * Params().GetConsensus().nModifierInterval / GetTargetSpacing(pindexPrev->nHeight));
+    // Candidate blocks sorted by timestamp, kept by the selection window
+    vector<CStakeModifierCandidate*> vSortedByTimestamp;
     int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval)
             * Params().GetConsensus().nModifierInterval - nSelectionInterval;
 //    LogPrint("stakemodifier", "nSelectionInterval = %d nSelectionIntervalStart = %d\n",nSelectionInterval,nSelectionIntervalStart);
 
-    const CBlockIndex* pindex = pindexPrev;
-    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
-    {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
-        pindex = pindex->pprev;
-    }
-    int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
-    reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-    sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
+    int nHeightFirstCandidate = 0;
+    stakeModifierWindow.GetCandidates(pindexPrev, nSelectionIntervalStart, vSortedByTimestamp, nHeightFirstCandidate);
 
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    map<uint256, const CBlockIndex*> mapSelectedBlocks;
+    vector<bool> vSelected(vSortedByTimestamp.size(), false);
+    vector<const CBlockIndex*> vSelectedBlocks;
+    const CBlockIndex* pindex = NULL;
     for (int nRound=0; nRound<min(64, (int)vSortedByTimestamp.size()); nRound++)
     {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, vSelected, nSelectionIntervalStop, nStakeModifier, &pindex))
             return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
         // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(make_pair(pindex->GetBlockHash(), pindex));
+        vSelectedBlocks.push_back(pindex);
 //        LogPrint("stakemodifier", "ComputeNextStakeModifier: selected round %d stop=%s height=%d bit=%d\n", nRound, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nSelectionIntervalStop), pindex->nHeight, pindex->GetStakeEntropyBit());
     }
 
@@ -8741,11 +9159,11 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        BOOST_FOREACH(const PAIRTYPE(uint256, const CBlockIndex*)& item, mapSelectedBlocks)
+        BOOST_FOREACH(const CBlockIndex* pindexSelected, vSelectedBlocks)
         {
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->IsProofOfStake()? "S" : "W");
+            strSelectionMap.replace(pindexSelected->nHeight - nHeightFirstCandidate, 1, pindexSelected->IsProofOfStake()? "S" : "W");
         }
 //        LogPrintf("ComputeNextStakeModifier: selection height [%d, %d] map %s\n", nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap);
     }
@@ -8757,10 +9175,10 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 }
 
 
-static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
 
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
 
@@ -8771,7 +9189,6 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
     targetProofOfStake.SetCompact(nBits);
 
     // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
     arith_uint512 bnWeight = arith_uint512(nValueIn);
 
     // We need to convert to uint512 to prevent overflow when multiplying by 1st block coins
@@ -8784,7 +9201,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nStakeModifier << nTimeBlockFrom << nTimeTxPrev << prevout.hash << prevout.n << nTimeTx;
     hashProofOfStake = UintToArith256(Hash(ss.begin(), ss.end()));
 
     if (fPrintProofOfStake)
@@ -8795,7 +9212,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeBlockFrom));
         LogPrint("stakemodifier","CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s bnTarget=%s nBits=%08x nValueIn=%d bnWeight=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString(), targetProofOfStake512.ToString(), nBits, nValueIn,bnWeight.ToString());
     }
 
@@ -8814,7 +9231,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeBlockFrom));
         LogPrint("stakemodifier","CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
@@ -8824,13 +9241,38 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
 bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, CBlockIndex& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
     // if (IsProtocolV2(pindexPrev->nHeight+1))
-        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, true);
+        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev.nTime, txPrev.vout[prevout.n].nValue, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, true);
     // else
         // return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
 }
 
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockIndex& blockFrom, unsigned int nTimeTxPrev, const CTxOut& txoutPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
+{
+    return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), nTimeTxPrev, txoutPrev.nValue, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, true);
+}
+
 //Check kernel hash target and coinstake signature
-bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, std::vector<CScriptCheck> *pvChecks, bool fCHeckSignature)
+bool CStakeCheck::operator()()
+{
+    const COutPoint& prevout = ptx->vin[0].prevout;
+
+    if (txoutPrev.scriptPubKey.IsColdStaking())
+        for(unsigned int i = 1; i < ptx->vout.size() - 1; i++) // First output is empty, last is CFund contribution
+            if(ptx->vout[i].scriptPubKey != txoutPrev.scriptPubKey) {
+                fFailed = true;
+                return error(strprintf("CheckProofOfStake(): Coinstake output %d tried to move cold staking coins to a non authorised script. (%s vs. %s)",
+                                       i, ScriptToAsmStr(txoutPrev.scriptPubKey), ScriptToAsmStr(ptx->vout[i].scriptPubKey)));
+            }
+
+    if (!CheckStakeKernelHashV2(pindexPrev, nBits, nTimeBlockFrom, nTimeTxPrev, txoutPrev.nValue, prevout, ptx->nTime, hashProofOfStake, targetProofOfStake, true)) {
+        fFailed = true;
+        return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", ptx->GetHash().ToString(), hashProofOfStake.ToString()); // may occur during initial download or if behind on block chain sync
+    }
+
+    return true;
+}
+
+bool PrepareStakeCheck(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, CStakeCheck& checkRet)
 {
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString());
@@ -8838,16 +9280,24 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    CTransaction txPrev;
-    uint256 hashBlock = uint256();
-    if (!GetTransaction(txin.prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true))
+    CTxOut txoutPrev;
+    unsigned int nTimeTxPrev = 0;
+    CBlockIndex* pblockindex = NULL;
+    if (!GetStakePrevout(txin.prevout, txoutPrev, nTimeTxPrev, pblockindex))
         return error("CheckProofOfStake() : INFO: read txPrev failed %s",txin.prevout.hash.GetHex());  // previous transaction not in main chain, may occur during initial download
 
-    if (txPrev.vout[txin.prevout.n].scriptPubKey.IsColdStaking())
-        for(unsigned int i = 1; i < tx.vout.size() - 1; i++) // First output is empty, last is CFund contribution
-            if(tx.vout[i].scriptPubKey != txPrev.vout[txin.prevout.n].scriptPubKey)
-                return error(strprintf("CheckProofOfStake(): Coinstake output %d tried to move cold staking coins to a non authorised script. (%s vs. %s)",
-                                       i, ScriptToAsmStr(txPrev.vout[txin.prevout.n].scriptPubKey), ScriptToAsmStr(tx.vout[i].scriptPubKey)));
+    if (!pblockindex)
+        return fDebug? error("CheckProofOfStake() : read block failed") : false; // unable to read block of previous transaction
+
+    checkRet = CStakeCheck(pindexPrev, nBits, pblockindex->GetBlockTime(), nTimeTxPrev, txoutPrev, tx);
+    return true;
+}
+
+bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, std::vector<CScriptCheck> *pvChecks, bool fCHeckSignature)
+{
+    CStakeCheck stakeCheck;
+    if (!PrepareStakeCheck(pindexPrev, tx, nBits, stakeCheck))
+        return false;
 
     if (pvChecks)
         pvChecks->reserve(tx.vin.size());
@@ -8870,18 +9320,11 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
             return error("CheckProofOfStake() : script-verify-failed %s",ScriptErrorString(check.GetScriptError()));
     }
 
-    if (mapBlockIndex.count(hashBlock) == 0)
-        return fDebug? error("CheckProofOfStake() : read block failed") : false; // unable to read block of previous transaction
-
-    CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
+    bool fValid = stakeCheck();
+    hashProofOfStake = stakeCheck.GetHashProofOfStake();
+    targetProofOfStake = stakeCheck.GetTargetProofOfStake();
 
-    if (txin.prevout.hash != txPrev.GetHash())
-        return error("CheckProofOfStake(): Coinstake input does not match previous output %s",txin.prevout.hash.GetHex());
-
-    if (!CheckStakeKernelHash(pindexPrev, nBits, *pblockindex, txPrev, txin.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, fDebug))
-        return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx.GetHash().ToString(), hashProofOfStake.ToString()); // may occur during initial download or if behind on block chain sync
-
-    return true;
+    return fValid;
 }
 
 // Check whether the coinstake timestamp meets protocol
@@ -8897,20 +9340,19 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
 {
     arith_uint256 hashProofOfStake, targetProofOfStake;
 
-    CTransaction txPrev;
-    uint256 hashBlock = uint256();
-    if (!GetTransaction(prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true)){
+    CTxOut txoutPrev;
+    unsigned int nTimeTxPrev = 0;
+    CBlockIndex* pblockindex = NULL;
+    if (!GetStakePrevout(prevout, txoutPrev, nTimeTxPrev, pblockindex)){
         LogPrintf("CheckKernel : Could not find previous transaction %s\n",prevout.hash.ToString());
         return false;
     }
 
-    if (mapBlockIndex.count(hashBlock) == 0){
-        LogPrintf("CheckKernel : Could not find block of previous transaction %s\n",hashBlock.ToString());
+    if (!pblockindex){
+        LogPrintf("CheckKernel : Could not find block of previous transaction %s\n",prevout.hash.ToString());
         return false;
     }
 
-    CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-
     if (pblockindex->GetBlockTime() + Params().GetConsensus().nStakeMinAge > nTime)
         return false;
 
@@ -8921,7 +9363,7 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
     if (!pwalletMain->mapWallet.count(prevout.hash))
         return("CheckProofOfStake(): Couldn't get Tx Index");
 
-    return CheckStakeKernelHash(pindexPrev, nBits, *pblockindex, txPrev, prevout, nTime, hashProofOfStake, targetProofOfStake);
+    return CheckStakeKernelHash(pindexPrev, nBits, *pblockindex, nTimeTxPrev, txoutPrev, prevout, nTime, hashProofOfStake, targetProofOfStake);
 }
 
 // staker's coin stake reward based on coin age spent (coin-days)
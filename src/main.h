@@ -21,6 +21,7 @@
 #include "versionbits.h"
 #include "spentindex.h"
 #include "addressindex.h"
+#include "coldstakingindex.h"
 #include "timestampindex.h"
 #include "wallet/walletdb.h"
 #include "txdb.h"
@@ -46,12 +47,17 @@
 static const int64_t MAX_MINT_PROOF_OF_STAKE = 0.1 * COIN;
 
 class CBlockIndex;
+class CAddressIndexCursor;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
 class CScriptCheck;
+class CStakeCheck;
+class CStakeModifierWindow;
+class CTxInUndo;
 class CTxMemPool;
+class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 
@@ -97,6 +103,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 2;
+/** Maximum number of header-checking threads allowed */
+static const int MAX_HEADERCHECK_THREADS = 16;
+/** -parheaders default (number of threads hashing and checking received headers, 0 = auto) */
+static const int DEFAULT_HEADERCHECK_THREADS = 2;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -145,6 +155,7 @@ static const bool DEFAULT_TXINDEX = false;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_COLDSTAKINGINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
@@ -189,9 +200,11 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nHeaderCheckThreads;
 extern bool fTxIndex;
 extern bool fAddressIndex;
 extern bool fSpentIndex;
+extern bool fColdStakingIndex;
 extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
@@ -279,6 +292,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header checking thread, see -parheaders */
+void ThreadHeaderCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -381,6 +396,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
+/** Same, also recording what is needed to undo it in txundo */
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
+/** Restore in view the output spent by the input undo belongs to. Returns false when view did not match the undo data. */
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out);
+/** Check that the outputs of tx confirmed at nHeight match coins exactly, filling in what the coins database does not keep */
+bool DisconnectedCoinsMatch(CCoins& coins, const CTransaction& tx, int nHeight);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
@@ -439,12 +460,20 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    CStakeCheck *pstake;
+    CFund::CTxCheck *pcfund;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0), pstake(0), pcfund(0) {}
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pstake(0), pcfund(0) { }
+    //! Run a proof-of-stake kernel check on the script check threads; the check must outlive the queue run
+    explicit CScriptCheck(CStakeCheck* pstakeIn) :
+        amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0), pstake(pstakeIn), pcfund(0) { }
+    //! Same for the context-free part of a community fund transaction check
+    explicit CScriptCheck(CFund::CTxCheck* pcfundIn) :
+        amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0), pstake(0), pcfund(pcfundIn) { }
 
     bool operator()();
 
@@ -457,19 +486,112 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pstake, check.pstake);
+        std::swap(pcfund, check.pcfund);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the kernel part of the proof-of-stake of a block: the
+ * cold staking output restrictions and the kernel hash against the weighted
+ * target. The kernel input is looked up by PrepareStakeCheck, so running the
+ * check needs no locks and it can be queued with the block's script checks.
+ */
+class CStakeCheck
+{
+private:
+    CBlockIndex* pindexPrev;
+    unsigned int nBits;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTxPrev;
+    CTxOut txoutPrev;
+    const CTransaction* ptx;
+    arith_uint256 hashProofOfStake;
+    arith_uint256 targetProofOfStake;
+    bool fFailed;
+
+public:
+    CStakeCheck() : pindexPrev(NULL), nBits(0), nTimeBlockFrom(0), nTimeTxPrev(0), ptx(NULL), fFailed(false) {}
+    CStakeCheck(CBlockIndex* pindexPrevIn, unsigned int nBitsIn, unsigned int nTimeBlockFromIn, unsigned int nTimeTxPrevIn, const CTxOut& txoutPrevIn, const CTransaction& txIn) :
+        pindexPrev(pindexPrevIn), nBits(nBitsIn), nTimeBlockFrom(nTimeBlockFromIn), nTimeTxPrev(nTimeTxPrevIn), txoutPrev(txoutPrevIn), ptx(&txIn), fFailed(false) {}
+
+    bool operator()();
+
+    //! Whether the check ran and failed (it is skipped when another check of the queue failed first)
+    bool HasFailed() const { return fFailed; }
+    const arith_uint256& GetHashProofOfStake() const { return hashProofOfStake; }
+    const arith_uint256& GetTargetProofOfStake() const { return targetProofOfStake; }
+};
+
+/** Number of headers hashed and checked by a single header check job */
+static const unsigned int HEADER_CHECK_BATCH_SIZE = 16;
+
+/**
+ * Closure representing the context-free part of the validation of a range of
+ * the headers of a headers message: computing their hashes and running
+ * CheckBlockHeader. Results are written to the per-header slots of the
+ * output vectors, so the closure itself never fails.
+ */
+class CHeaderCheck
+{
+private:
+    const std::vector<CBlockHeader>* pvHeaders;
+    std::vector<uint256>* pvHashes;
+    std::vector<unsigned char>* pvValid;
+    size_t nBegin;
+    size_t nEnd;
+    const Consensus::Params* pparams;
+
+public:
+    CHeaderCheck(): pvHeaders(NULL), pvHashes(NULL), pvValid(NULL), nBegin(0), nEnd(0), pparams(NULL) {}
+    CHeaderCheck(const std::vector<CBlockHeader>* pvHeadersIn, std::vector<uint256>* pvHashesIn, std::vector<unsigned char>* pvValidIn,
+                 size_t nBeginIn, size_t nEndIn, const Consensus::Params* pparamsIn) :
+        pvHeaders(pvHeadersIn), pvHashes(pvHashesIn), pvValid(pvValidIn), nBegin(nBeginIn), nEnd(nEndIn), pparams(pparamsIn) {}
+
+    bool operator()();
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pvHeaders, check.pvHeaders);
+        std::swap(pvHashes, check.pvHashes);
+        std::swap(pvValid, check.pvValid);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pparams, check.pparams);
+    }
+};
+
+/**
+ * Hash and run the context-free checks on a batch of headers, spread over the
+ * header checking threads (-parheaders). Does not require cs_main.
+ */
+void CheckBlockHeaders(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet, std::vector<unsigned char>& vValidRet, const Consensus::Params& consensusParams);
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool HashOnchainActive(const uint256 &hash);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &balance);
+/** Open a cursor over the address index entries of an address, NULL when the address index is not enabled */
+CAddressIndexCursor* GetAddressIndexCursor(uint160 addressHash, int type, int start = 0, int end = 0,
+                                           const CAddressIndexKey* pkeyAfter = NULL);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Unspent cold staking outputs delegated to the staking key with hash stakingKey */
+bool GetColdStakingUnspent(uint160 stakingKey,
+                           std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &unspentOutputs);
+/** Cold staking index entries for the outputs of tx confirmed at nHeight, or erasing them when fErase */
+void IndexColdStakingOutputs(const CTransaction& tx, int nHeight, bool fErase,
+                             std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex);
+/** Cold staking index entries erasing the outputs spent by tx, which must still be in view */
+void IndexColdStakingSpends(const CTransaction& tx, const CCoinsViewCache& view,
+                            std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex);
+/** Cold staking index entry for the output ApplyTxInUndo restored into view from undo */
+void IndexColdStakingUndo(const CTxInUndo& undo, const COutPoint& out, const CCoinsViewCache& view,
+                          std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &coldStakingIndex);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -478,8 +600,8 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 /** Functions for validating blocks and updating the block tree */
 
-/** Context-independent validity checks */
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Context-independent validity checks. phash optionally passes the already computed header hash. */
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, const uint256* phash = NULL);
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 
 /** Context-dependent validity checks.
@@ -571,6 +693,9 @@ extern CCoinsViewCache *pcoinsTip;
 extern CBlockTreeDB *pblocktree;
 extern uint256 hashBestChain;
 
+/** Blocks of the active chain which can be selected for the next stake modifier (protected by cs_main). */
+extern CStakeModifierWindow stakeModifierWindow;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -597,7 +722,14 @@ static const unsigned int REJECT_ALREADY_KNOWN = 0x101;
 /** Transaction conflicts with a transaction already known */
 static const unsigned int REJECT_CONFLICT = 0x102;
 
-bool TransactionGetCoinAge(CTransaction& transaction, uint64_t& nCoinAge);
+/**
+ * Coin age of a coinstake spending outputs of view, in the chain ending at
+ * pindexPrev. Results are cached, so the staker and the validation of its
+ * block share the computation.
+ */
+bool TransactionGetCoinAge(const CTransaction& transaction, const CCoinsViewCache& view, const CBlockIndex* pindexPrev, uint64_t& nCoinAge);
+/** Coin age of a coinstake spending outputs of the active chain */
+bool TransactionGetCoinAge(const CTransaction& transaction, uint64_t& nCoinAge);
 
 // MODIFIER_INTERVAL_RATIO:
 // ratio of group interval length between the last group and the first group
@@ -609,11 +741,16 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, CBlockIndex& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake=false);
+// Same, given the time and output of the previous transaction as kept in the UTXO set
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockIndex& blockFrom, unsigned int nTimeTxPrev, const CTxOut& txoutPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake=false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, std::vector<CScriptCheck> *pvChecks, bool fCHeckSignature = false);
 
+// Look up the kernel input of a coinstake and prepare the check of its kernel
+bool PrepareStakeCheck(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, CStakeCheck& checkRet);
+
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx);
 
@@ -639,6 +776,8 @@ static const unsigned int MAX_STANDARD_TX_SIZE = MAX_BLOCK_SIZE_GEN/5;
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 
 void CountVotes(CValidationState& state, CBlockIndex *pindexNew, bool fUndo);
+/** Snapshot the current voting cycle at pindexNew for cfundstats, done by CountVotes. Returns false when its votes could not be read. */
+bool UpdateCycleStats(CBlockIndex *pindexNew);
 
 bool IsSigHFEnabled(const Consensus::Params &consensus, const CBlockIndex *pindexPrev);
 
@@ -25,6 +25,7 @@
 #include "primitives/transaction.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "stakingstats.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -36,6 +37,7 @@
 #include "kernel.h"
 
 #include <algorithm>
+#include <boost/make_shared.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -253,7 +255,7 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bo
 
         UniValue strDZeel(UniValue::VARR);
         std::vector<CFund::CPaymentRequest> vec;
-        if(pblocktree->GetPaymentRequestIndex(vec))
+        if(pcfundstate->GetPaymentRequestsByState(CFund::ACCEPTED, vec))
         {
             BOOST_FOREACH(const CFund::CPaymentRequest& prequest, vec) {
                 if (mapBlockIndex.count(prequest.blockhash) == 0)
@@ -733,8 +735,264 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 // Internal Staker
 //
 
+/**
+ * Complete a proof-of-stake block template with a coinstake of wallet and
+ * sign it. pblock is only changed when it succeeds.
+ */
+static bool SignBlockWithCoinStake(CBlock *pblock, CWallet& wallet, CMutableTransaction& txCoinStake, const CKey& key)
+{
+    if (txCoinStake.nTime < chainActive.Tip()->GetPastTimeLimit()+1)
+        return false;
+
+    CBlock block = *pblock;
+    std::vector<CTransaction> vtx = block.vtx;
+    CTransaction txNew;
+
+    // make sure coinstake would meet timestamp protocol
+    //    as it would be the same as the block timestamp
+    block.vtx[0].nTime = block.nTime = txCoinStake.nTime;
+
+    // we have to make sure that we have no future timestamps in
+    //    our transactions set
+    for (vector<CTransaction>::iterator it = vtx.begin(); it != vtx.end();)
+        if (it->nTime > block.nTime) { it = vtx.erase(it); } else { ++it; }
+
+    txCoinStake.nVersion = CTransaction::TXDZEEL_VERSION_V2;
+    txCoinStake.strDZeel = sCoinStakeStrDZeel == "" ?
+                GetArg("-stakervote","") + ";" + std::to_string(CLIENT_VERSION) :
+                sCoinStakeStrDZeel;
+
+    for(unsigned int i = 0; i < vCoinStakeOutputs.size(); i++)
+    {
+        CTxOut forcedTxOut;
+        if (!DecodeHexTxOut(forcedTxOut, vCoinStakeOutputs[i]))
+            LogPrintf("Tried to force a wrong transaction output in the coinstake: %s\n", vCoinStakeOutputs[i]);
+        else
+            txCoinStake.vout.insert(txCoinStake.vout.end(), forcedTxOut);
+    }
+
+    for(unsigned int i = 0; i < vCoinStakeInputs.size(); i++)
+    {
+        CTxIn forcedTxIn;
+        if (!DecodeHexTxIn(forcedTxIn, vCoinStakeInputs[i]))
+            LogPrintf("Tried to force a wrong transaction input in the coinstake: %s\n", vCoinStakeInputs[i]);
+        else
+            txCoinStake.vin.insert(txCoinStake.vin.end(), forcedTxIn);
+    }
+
+    // After the changes, we need to resign inputs.
+
+    CTransaction txNewConst(txCoinStake);
+    for(unsigned int i = 0; i < txCoinStake.vin.size(); i++)
+    {
+        bool signSuccess;
+        uint256 prevHash = txCoinStake.vin[i].prevout.hash;
+        uint32_t n = txCoinStake.vin[i].prevout.n;
+        if (!wallet.mapWallet.count(prevHash))
+            return error("SignBlockWithCoinStake() : coinstake input %s is not in wallet %s", prevHash.ToString(), wallet.strWalletFile);
+        CWalletTx& prevTx = wallet.mapWallet[prevHash];
+        const CScript& scriptPubKey = prevTx.vout[n].scriptPubKey;
+        SignatureData sigdata;
+        signSuccess = ProduceSignature(TransactionSignatureCreator(&wallet, &txNewConst, i, prevTx.vout[n].nValue, SIGHASH_ALL), scriptPubKey, sigdata, true);
+
+        if (!signSuccess) {
+            return false;
+        } else {
+            UpdateTransaction(txCoinStake, i, sigdata);
+        }
+    }
+
+    *static_cast<CTransaction*>(&txNew) = CTransaction(txCoinStake);
+    block.vtx.insert(block.vtx.begin() + 1, txNew);
+
+    for(unsigned int i = 0; i < vForcedTransactions.size(); i++)
+    {
+        CTransaction forcedTx;
+        if (!DecodeHexTx(forcedTx, vForcedTransactions[i]))
+            LogPrintf("Tried to force a wrong transaction in a block: %s\n", vForcedTransactions[i]);
+        else
+            block.vtx.insert(block.vtx.begin() + 2, forcedTx);
+    }
+
+
+    block.vtx[0].UpdateHash();
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    if (!key.Sign(block.GetHash(), block.vchBlockSig))
+        return false;
+
+    *pblock = block;
+    return true;
+}
+
 extern unsigned int nMinerSleep;
 
+/** Seconds after which a block template is rebuilt to pick up new mempool transactions */
+static const int64_t STAKER_TEMPLATE_REFRESH = 60;
+
+// Events which can change the outcome of the next stake attempt
+static boost::mutex csStakerEvent;
+static boost::condition_variable cvStakerEvent;
+static bool fStakerEvent = false;
+//! Number of transaction changes reported by the staking wallets, which may change their stake candidates
+static unsigned int nStakerWalletChanges = 0;
+
+static void WakeStaker(bool fWalletChanged)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csStakerEvent);
+        fStakerEvent = true;
+        if (fWalletChanged)
+            nStakerWalletChanges++;
+    }
+    cvStakerEvent.notify_all();
+}
+
+static void StakerNotifyBlockTip(bool fInitialDownload, const CBlockIndex *pindexNew)
+{
+    WakeStaker(false);
+}
+
+static void StakerNotifyTransactionChanged(CWallet *wallet, const uint256 &hashTx, ChangeType status)
+{
+    WakeStaker(true);
+}
+
+static unsigned int GetStakerWalletChanges()
+{
+    boost::unique_lock<boost::mutex> lock(csStakerEvent);
+    return nStakerWalletChanges;
+}
+
+/** Sleep until a stake event happens or nMillis elapse */
+static void WaitForStakerEvent(int64_t nMillis)
+{
+    boost::unique_lock<boost::mutex> lock(csStakerEvent);
+    boost::system_time const timeout = boost::get_system_time() + boost::posix_time::milliseconds(nMillis);
+    while (!fStakerEvent)
+    {
+        if (!cvStakerEvent.timed_wait(lock, timeout))
+            break;
+    }
+    fStakerEvent = false;
+}
+
+//! Kernel hashing state of the candidates of all the staking wallets, kept across slots on the same tip
+static CStakeKernelSearch stakeKernelSearch;
+
+// Staking activity per wallet file
+static CCriticalSection cs_stakingStats;
+static std::map<std::string, CStakingWalletStats> mapStakingStats;
+
+std::vector<CWallet*> GetStakingWallets()
+{
+    std::vector<CWallet*> vpwallet;
+    if (pwalletMain)
+        vpwallet.push_back(pwalletMain);
+    vpwallet.insert(vpwallet.end(), vpwalletStaking.begin(), vpwalletStaking.end());
+    return vpwallet;
+}
+
+CStakingWalletStats GetStakingWalletStats(const std::string& strWalletFile)
+{
+    LOCK(cs_stakingStats);
+    std::map<std::string, CStakingWalletStats>::const_iterator it = mapStakingStats.find(strWalletFile);
+    if (it == mapStakingStats.end())
+        return CStakingWalletStats();
+    return it->second;
+}
+
+static std::vector<CWallet*> GetUnlockedStakingWallets()
+{
+    std::vector<CWallet*> vpwallet = GetStakingWallets();
+    for (std::vector<CWallet*>::iterator it = vpwallet.begin(); it != vpwallet.end();)
+        if ((*it)->IsLocked()) { it = vpwallet.erase(it); } else { ++it; }
+    return vpwallet;
+}
+
+/**
+ * Search the kernels of all the wallets at nSlot in a single pass over the
+ * tip context, and sign pblock with the coinstake of the first kernel whose
+ * wallet can stake it. Returns that wallet, or NULL. The work done is
+ * recorded in round.
+ */
+static CWallet* StakeWithWallets(CBlock* pblock, const CBlockIndex* pindexPrev, int64_t nFees, unsigned int nSlot, const std::vector<CWallet*>& vpwallet, CStakingRound& round)
+{
+    // The coins of every wallet, and for every kernel candidate its wallet and coin
+    std::vector<std::vector<std::pair<const CWalletTx*,unsigned int> > > vWalletCoins(vpwallet.size());
+    std::vector<std::pair<size_t, size_t> > vOwners;
+    std::vector<CStakeKernelInput> vInputs;
+    for (size_t i = 0; i < vpwallet.size(); i++)
+    {
+        std::vector<CStakeKernelInput> vWalletInputs;
+        vpwallet[i]->GetStakeKernelInputs(nSlot, vWalletCoins[i], vWalletInputs);
+        for (size_t j = 0; j < vWalletInputs.size(); j++)
+            vOwners.push_back(std::make_pair(i, j));
+        vInputs.insert(vInputs.end(), vWalletInputs.begin(), vWalletInputs.end());
+
+        LOCK(cs_stakingStats);
+        CStakingWalletStats& stats = mapStakingStats[vpwallet[i]->strWalletFile];
+        stats.nSlots++;
+        stats.nInputs = vWalletInputs.size();
+    }
+
+    round.nInputs = vInputs.size();
+    if (vInputs.empty())
+        return NULL;
+
+    int64_t nStart = GetTimeMicros();
+    stakeKernelSearch.SetTip(pindexPrev, pblock->nBits);
+    stakeKernelSearch.SetInputs(vInputs);
+
+    const std::vector<unsigned int> vSearchTimes(1, nSlot);
+    size_t nKernel = 0;
+    unsigned int nTimeKernel = 0;
+    round.nCheckKernel = 0;
+    while (pindexPrev == pindexBestHeader && stakeKernelSearch.Search(vSearchTimes, nKernel, nTimeKernel))
+    {
+        round.nCheckKernel += GetTimeMicros() - nStart;
+        boost::this_thread::interruption_point();
+
+        CWallet* pwallet = vpwallet[vOwners[nKernel].first];
+        const std::vector<std::pair<const CWalletTx*,unsigned int> >& vCoins = vWalletCoins[vOwners[nKernel].first];
+        LogPrint("coinstake", "NavCoinStaker : kernel found in %s\n", pwallet->strWalletFile);
+        {
+            LOCK(cs_stakingStats);
+            mapStakingStats[pwallet->strWalletFile].nKernels++;
+        }
+
+        CKey key;
+        CMutableTransaction txCoinStake;
+        nStart = GetTimeMicros();
+        bool fCreated = pwallet->CreateCoinStake(*pwallet, pindexPrev, vCoins, vCoins[vOwners[nKernel].second], nTimeKernel, nFees, txCoinStake, key);
+        round.nCreateCoinStake = std::max(round.nCreateCoinStake, (int64_t)0) + GetTimeMicros() - nStart;
+        if (fCreated)
+        {
+            nStart = GetTimeMicros();
+            bool fSigned = SignBlockWithCoinStake(pblock, *pwallet, txCoinStake, key);
+            round.nSignBlock = std::max(round.nSignBlock, (int64_t)0) + GetTimeMicros() - nStart;
+            if (fSigned)
+                return pwallet;
+        }
+
+        // The wallet can not stake this kernel, search the remaining candidates
+        nStart = GetTimeMicros();
+        vOwners.erase(vOwners.begin() + nKernel);
+        vInputs.erase(vInputs.begin() + nKernel);
+        stakeKernelSearch.SetInputs(vInputs);
+    }
+    round.nCheckKernel += GetTimeMicros() - nStart;
+
+    return NULL;
+}
+
+/** Milliseconds until the coinstake timestamp mask allows a new timestamp */
+static int64_t GetMillisToNextStakeSlot()
+{
+    int64_t nNow = GetTimeMillis() + GetTimeOffset() * 1000;
+    int64_t nNextSlot = ((nNow / 1000) & ~STAKE_TIMESTAMP_MASK) + STAKE_TIMESTAMP_MASK + 1;
+    return std::max((int64_t)1, nNextSlot * 1000 - nNow);
+}
+
 void NavCoinStaker(const CChainParams& chainparams)
 {
     LogPrintf("NavCoinStaker started\n");
@@ -744,6 +1002,25 @@ void NavCoinStaker(const CChainParams& chainparams)
     boost::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript);
 
+    // Sleep between stake slots, unless the tip or a staking wallet changes
+    boost::signals2::scoped_connection connBlockTip(uiInterface.NotifyBlockTip.connect(&StakerNotifyBlockTip));
+    std::vector<boost::shared_ptr<boost::signals2::scoped_connection> > vConnWallets;
+    BOOST_FOREACH(CWallet* pwallet, GetStakingWallets())
+        vConnWallets.push_back(boost::make_shared<boost::signals2::scoped_connection>(pwallet->NotifyTransactionChanged.connect(&StakerNotifyTransactionChanged)));
+
+    // The template is kept until the tip changes or it misses too many mempool transactions
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    uint64_t nTemplateFees = 0;
+    uint256 hashTemplateTip;
+    unsigned int nTemplateTransactionsUpdated = 0;
+    int64_t nTemplateTime = 0;
+    // Slot of the last search, and the tip and wallet changes it was searched with
+    int64_t nLastSearchSlot = 0;
+    uint256 hashLastSearchTip;
+    unsigned int nLastSearchWalletChanges = 0;
+    // Duration of the last template build, reported with the next round
+    int64_t nCreateNewBlockTime = -1;
+
     try {
         // Throw an error if no script was provided.  This can happen
         // due to some internal error but also if the keypool is empty.
@@ -769,13 +1046,17 @@ void NavCoinStaker(const CChainParams& chainparams)
 
             while (!fStaking)
             {
+                stakingStats.Pause();
                 MilliSleep(1000);
             }
 
-            while (pwalletMain->IsLocked())
+            std::vector<CWallet*> vpwallet = GetUnlockedStakingWallets();
+            while (vpwallet.empty())
             {
+                stakingStats.Pause();
                 nLastCoinStakeSearchInterval = 0;
                 MilliSleep(1000);
+                vpwallet = GetUnlockedStakingWallets();
             }
 
             if (nLastTime != 0 && nLastSteadyTime != 0)
@@ -789,12 +1070,15 @@ void NavCoinStaker(const CChainParams& chainparams)
                     LogPrintf("*** System clock change detected. Staking will be paused until the clock is synced again.\n");
                 }
                 if(fIncorrectTime) {
+                    // All the servers are queried at once, so a sync takes one round trip
                     if(!NtpClockSync()) {
                         MilliSleep(10000);
                         continue;
                     } else {
+                        CNtpStatus status = GetNtpStatus();
                         fIncorrectTime = false;
-                        LogPrintf("*** Starting staking thread again.\n");
+                        LogPrintf("*** Starting staking thread again (clock offset %.3fsec., error %.3fsec.).\n",
+                                  status.nOffset / 1000000.0, status.nError / 1000000.0);
                     }
                 }
             }
@@ -803,32 +1087,101 @@ void NavCoinStaker(const CChainParams& chainparams)
             nLastSteadyTime = GetSteadyTime();
 
             //
-            // Create new block
+            // Create new block, when the last one is stale
             //
-            uint64_t nFees = 0;
+            const CBlockIndex* pindexPrev;
+            {
+                LOCK(cs_main);
+                pindexPrev = chainActive.Tip();
+            }
+            uint256 hashTip = pindexPrev->GetBlockHash();
 
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, true, &nFees));
-            if (!pblocktemplate.get())
+            if (!pblocktemplate.get() || hashTip != hashTemplateTip ||
+                (mempool.GetTransactionsUpdated() != nTemplateTransactionsUpdated && GetTime() - nTemplateTime > STAKER_TEMPLATE_REFRESH))
             {
-                LogPrintf("Error in NavCoinStaker: Keypool ran out, please call keypoolrefill before restarting the staking thread\n");
-                return;
+                if (hashTip != hashTemplateTip)
+                {
+                    LOCK(cs_main);
+                    stakingStats.UpdateStakes(chainActive, COINBASE_MATURITY);
+                }
+
+                int64_t nStart = GetTimeMicros();
+                nTemplateTransactionsUpdated = mempool.GetTransactionsUpdated();
+                nTemplateFees = 0;
+                pblocktemplate.reset(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, true, &nTemplateFees));
+                nCreateNewBlockTime = GetTimeMicros() - nStart;
+                if (!pblocktemplate.get())
+                {
+                    LogPrintf("Error in NavCoinStaker: Keypool ran out, please call keypoolrefill before restarting the staking thread\n");
+                    return;
+                }
+                hashTemplateTip = pblocktemplate->block.hashPrevBlock;
+                nTemplateTime = GetTime();
             }
-            CBlock *pblock = &pblocktemplate->block;
 
-            //LogPrint("coinstake","Running NavCoinStaker with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-            //     ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
+            // The tip moved while the template was built
+            if (hashTemplateTip != hashTip)
+                continue;
 
-            //Trying to sign a block
-            if (SignBlock(pblock, *pwalletMain, nFees))
+            // Only timestamps of a new slot, a new stake modifier or new candidates
+            // can give a kernel not tried yet
+            int64_t nSlot = GetAdjustedTime() & ~STAKE_TIMESTAMP_MASK;
+            unsigned int nWalletChanges = GetStakerWalletChanges();
+            if (nSlot <= nLastSearchSlot && hashTip == hashLastSearchTip && nWalletChanges == nLastSearchWalletChanges)
             {
-                LogPrint("coinstake", "PoS Block signed\n");
+                WaitForStakerEvent(GetMillisToNextStakeSlot());
+                continue;
+            }
+            nLastSearchSlot = nSlot;
+            hashLastSearchTip = hashTip;
+            nLastSearchWalletChanges = nWalletChanges;
+
+            // Signing changes the block, the template is kept intact for the next slots
+            CBlock block = pblocktemplate->block;
+
+            //LogPrint("coinstake","Running NavCoinStaker with %u transactions in block (%u bytes)\n", block.vtx.size(),
+            //     ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+
+            CStakingRound round;
+            round.nSlot = nSlot;
+            round.nHeight = pindexPrev->nHeight;
+            round.nCreateNewBlock = nCreateNewBlockTime;
+            nCreateNewBlockTime = -1;
+
+            //Trying to sign a block with one of the wallets
+            CWallet* pwalletStake = StakeWithWallets(&block, pindexPrev, nTemplateFees, nSlot, vpwallet, round);
+            nLastCoinStakeSearchInterval = STAKE_TIMESTAMP_MASK + 1;
+            round.fFound = pwalletStake != NULL;
+            if (pwalletStake)
+            {
+                LogPrint("coinstake", "PoS Block signed by %s\n", pwalletStake->strWalletFile);
                 SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                CheckStake(pblock, *pwalletMain, chainparams);
+                int64_t nStart = GetTimeMicros();
+                round.fAccepted = CheckStake(&block, *pwalletStake, chainparams);
+                round.nCheckStake = GetTimeMicros() - nStart;
+                if (round.fAccepted)
+                {
+                    {
+                        LOCK(cs_stakingStats);
+                        CStakingWalletStats& stats = mapStakingStats[pwalletStake->strWalletFile];
+                        stats.nStakes++;
+                        stats.nLastStakeTime = block.nTime;
+                    }
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+                    if (mi != mapBlockIndex.end())
+                        stakingStats.AddStake(mi->second);
+                }
                 SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                MilliSleep(500);
+                stakingStats.AddRound(round);
+                pblocktemplate.reset();
+                MilliSleep(nMinerSleep);
             }
             else
-                MilliSleep(nMinerSleep);
+            {
+                stakingStats.AddRound(round);
+                WaitForStakerEvent(GetMillisToNextStakeSlot());
+            }
 
         }
     }
@@ -844,122 +1197,6 @@ void NavCoinStaker(const CChainParams& chainparams)
     }
 }
 
-#ifdef ENABLE_WALLET
-bool SignBlock(CBlock *pblock, CWallet& wallet, int64_t nFees)
-{
-  std::vector<CTransaction> vtx = pblock->vtx;
-  // if we are trying to sign
-  //    something except proof-of-stake block template
-  if (!vtx[0].vout[0].IsEmpty()){
-      LogPrintf("SignBlock() : Trying to sign malformed proof-of-stake block template\n");
-      return false;
-  }
-
-  // if we are trying to sign
-  //    a complete proof-of-stake block
-  if (pblock->IsProofOfStake())
-      return true;
-
-  static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
-
-  CKey key;
-  CMutableTransaction txCoinStake;
-  CTransaction txNew;
-  int nBestHeight = chainActive.Tip()->nHeight;
-
-  txCoinStake.nTime = GetAdjustedTime();
-  txCoinStake.nTime &= ~STAKE_TIMESTAMP_MASK;
-
-  int64_t nSearchTime = txCoinStake.nTime; // search to current time
-
-  if (nSearchTime > nLastCoinStakeSearchTime)
-  {
-
-      int64_t nSearchInterval = nBestHeight+1 > 0 ? 1 : nSearchTime - nLastCoinStakeSearchTime;
-      if (wallet.CreateCoinStake(wallet, pblock->nBits, nSearchInterval, nFees, txCoinStake, key))
-      {
-
-          if (txCoinStake.nTime >= chainActive.Tip()->GetPastTimeLimit()+1)
-          {
-              // make sure coinstake would meet timestamp protocol
-              //    as it would be the same as the block timestamp
-              pblock->vtx[0].nTime = pblock->nTime = txCoinStake.nTime;
-
-              // we have to make sure that we have no future timestamps in
-              //    our transactions set
-              for (vector<CTransaction>::iterator it = vtx.begin(); it != vtx.end();)
-                  if (it->nTime > pblock->nTime) { it = vtx.erase(it); } else { ++it; }
-
-              txCoinStake.nVersion = CTransaction::TXDZEEL_VERSION_V2;
-              txCoinStake.strDZeel = sCoinStakeStrDZeel == "" ?
-                          GetArg("-stakervote","") + ";" + std::to_string(CLIENT_VERSION) :
-                          sCoinStakeStrDZeel;
-
-              for(unsigned int i = 0; i < vCoinStakeOutputs.size(); i++)
-              {
-                  CTxOut forcedTxOut;
-                  if (!DecodeHexTxOut(forcedTxOut, vCoinStakeOutputs[i]))
-                      LogPrintf("Tried to force a wrong transaction output in the coinstake: %s\n", vCoinStakeOutputs[i]);
-                  else
-                      txCoinStake.vout.insert(txCoinStake.vout.end(), forcedTxOut);
-              }
-
-              for(unsigned int i = 0; i < vCoinStakeInputs.size(); i++)
-              {
-                  CTxIn forcedTxIn;
-                  if (!DecodeHexTxIn(forcedTxIn, vCoinStakeInputs[i]))
-                      LogPrintf("Tried to force a wrong transaction input in the coinstake: %s\n", vCoinStakeInputs[i]);
-                  else
-                      txCoinStake.vin.insert(txCoinStake.vin.end(), forcedTxIn);
-              }
-
-              // After the changes, we need to resign inputs.
-
-              CTransaction txNewConst(txCoinStake);
-              for(unsigned int i = 0; i < txCoinStake.vin.size(); i++)
-              {
-                  bool signSuccess;
-                  uint256 prevHash = txCoinStake.vin[i].prevout.hash;
-                  uint32_t n = txCoinStake.vin[i].prevout.n;
-                  assert(pwalletMain->mapWallet.count(prevHash));
-                  CWalletTx& prevTx = pwalletMain->mapWallet[prevHash];
-                  const CScript& scriptPubKey = prevTx.vout[n].scriptPubKey;
-                  SignatureData sigdata;
-                  signSuccess = ProduceSignature(TransactionSignatureCreator(&wallet, &txNewConst, i, prevTx.vout[n].nValue, SIGHASH_ALL), scriptPubKey, sigdata, true);
-
-                  if (!signSuccess) {
-                      return false;
-                  } else {
-                      UpdateTransaction(txCoinStake, i, sigdata);
-                  }
-              }
-
-              *static_cast<CTransaction*>(&txNew) = CTransaction(txCoinStake);
-              pblock->vtx.insert(pblock->vtx.begin() + 1, txNew);
-
-              for(unsigned int i = 0; i < vForcedTransactions.size(); i++)
-              {
-                  CTransaction forcedTx;
-                  if (!DecodeHexTx(forcedTx, vForcedTransactions[i]))
-                      LogPrintf("Tried to force a wrong transaction in a block: %s\n", vForcedTransactions[i]);
-                  else
-                      pblock->vtx.insert(pblock->vtx.begin() + 2, forcedTx);
-              }
-
-
-              pblock->vtx[0].UpdateHash();
-              pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
-              return key.Sign(pblock->GetHash(), pblock->vchBlockSig);
-          }
-      }
-      nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-      nLastCoinStakeSearchTime = nSearchTime;
-  }
-
-  return false;
-}
-#endif
-
 bool CheckStake(CBlock* pblock, CWallet& wallet, const CChainParams& chainparams)
 {
     arith_uint256 proofHash = arith_uint256(0), hashTarget = arith_uint256(0);
@@ -223,11 +223,30 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 // NAVCoin - Mining/Staking thread
-bool SignBlock(CBlock *pblock, CWallet& wallet, int64_t nFees);
 /** Check mined proof-of-stake block */
 bool CheckStake(CBlock* pblock, CWallet& wallet, const CChainParams& chainparams);
 void NavCoinStaker(const CChainParams& chainparams);
 
+/** Staking activity of one wallet */
+struct CStakingWalletStats
+{
+    //! Stake slots searched while the wallet was unlocked
+    uint64_t nSlots;
+    //! Kernel candidates of the last search
+    unsigned int nInputs;
+    //! Kernels found
+    uint64_t nKernels;
+    //! Blocks staked and accepted
+    uint64_t nStakes;
+    int64_t nLastStakeTime;
+
+    CStakingWalletStats() : nSlots(0), nInputs(0), nKernels(0), nStakes(0), nLastStakeTime(0) {}
+};
+
+/** The main wallet followed by the -stakingwallet wallets */
+std::vector<CWallet*> GetStakingWallets();
+CStakingWalletStats GetStakingWalletStats(const std::string& strWalletFile);
+
 void SetStaking(bool mode);
 void SetCoinBaseOutputs(std::vector<std::string> v);
 void SetCoinStakeInputs(std::vector<std::string> v);
@@ -4,112 +4,315 @@
 
 #include "init.h"
 #include "ntpclient.h"
+#include "crypto/common.h"
 #include "random.h"
+#include "scheduler.h"
+#include "sync.h"
 #include "timedata.h"
 #include "util.h"
 
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 
+#include <boost/bind.hpp>
+
 using namespace boost;
 using namespace boost::asio;
 
-bool CNtpClient::getTimestamp(uint64_t &timeRecv)
+/** Seconds between 01/01/1900 (NTP era 0) and 01/01/1970 */
+static const int64_t NTP_UNIX_EPOCH = 2208988800LL;
+
+/** Convert a NTP timestamp to microseconds since 01/01/1970 */
+static int64_t ReadNtpTimestamp(const unsigned char *p)
 {
+    int64_t nSeconds = ReadBE32(p);
+    // Timestamps before 1970 belong to the next era, which starts in 2036
+    if (nSeconds < NTP_UNIX_EPOCH)
+        nSeconds += 0x100000000LL;
+    int64_t nMicros = ((uint64_t)ReadBE32(p + 4) * 1000000) >> 32;
+    return (nSeconds - NTP_UNIX_EPOCH) * 1000000 + nMicros;
+}
 
-    io_service io_service;
+static void WriteNtpTimestamp(unsigned char *p, int64_t nTime)
+{
+    WriteBE32(p, (uint32_t)(nTime / 1000000 + NTP_UNIX_EPOCH));
+    WriteBE32(p + 4, (uint32_t)(((uint64_t)(nTime % 1000000) << 32) / 1000000));
+}
 
-    LogPrint("ntp", "[NTP] Opening socket to NTP server %s.\n", sHostName);
-    try
+/** A request to one NTP server, driven by the io_service of the client */
+class CNtpQuery
+{
+    string sHostName;
+    ip::udp::resolver resolver;
+    ip::udp::socket socket;
+    ip::udp::endpoint receiver_endpoint;
+    ip::udp::endpoint sender_endpoint;
+    boost::array<unsigned char, 48> sendBuf;
+    boost::array<unsigned char, 48> recvBuf;
+    int64_t nTimeSent;
+    int& nPending;
+    deadline_timer& timer;
+    bool fDone;
+
+    void Finish()
     {
+        if (fDone)
+            return;
+        fDone = true;
+        // The last answer makes the client return without waiting for the timeout
+        if (--nPending == 0)
+            timer.cancel();
+    }
 
-        ip::udp::resolver resolver(io_service);
-        ip::udp::resolver::query query(boost::asio::ip::udp::v4(), sHostName, "ntp");
+public:
+    bool fValid;
+    CNtpSample sample;
 
-        ip::udp::endpoint receiver_endpoint = *resolver.resolve(query);
+    CNtpQuery(io_service& io_service, const string& server, int& nPendingIn, deadline_timer& timerIn) :
+        sHostName(server), resolver(io_service), socket(io_service), nTimeSent(0),
+        nPending(nPendingIn), timer(timerIn), fDone(false), fValid(false) { }
 
-        ip::udp::socket socket(io_service);
-        socket.open(ip::udp::v4());
+    void Start()
+    {
+        LogPrint("ntp", "[NTP] Opening socket to NTP server %s.\n", sHostName);
+        ip::udp::resolver::query query(ip::udp::v4(), sHostName, "123");
+        resolver.async_resolve(query, boost::bind(&CNtpQuery::HandleResolve, this,
+                                                  asio::placeholders::error, asio::placeholders::iterator));
+    }
 
-        boost::array<unsigned char, 48> sendBuf = {{010,0,0,0,0,0,0,0,0}};
+    void HandleResolve(const system::error_code& ec, ip::udp::resolver::iterator it)
+    {
+        if (ec || it == ip::udp::resolver::iterator())
+        {
+            LogPrintf("[NTP] Could not open socket to NTP server %s (%s)\n", sHostName, ec.message());
+            return Finish();
+        }
+        receiver_endpoint = *it;
+
+        system::error_code ecOpen;
+        socket.open(ip::udp::v4(), ecOpen);
+        if (ecOpen)
+        {
+            LogPrintf("[NTP] Could not open socket to NTP server %s (%s)\n", sHostName, ecOpen.message());
+            return Finish();
+        }
 
-        socket.send_to(boost::asio::buffer(sendBuf), receiver_endpoint);
+        // Version 3 client request, our clock goes in the transmit timestamp
+        sendBuf.fill(0);
+        sendBuf[0] = 0x1b;
+        nTimeSent = GetTimeMicros();
+        WriteNtpTimestamp(&sendBuf[40], nTimeSent);
 
-        boost::array<uint32_t, 1024> recvBuf;
-        ip::udp::endpoint sender_endpoint;
+        socket.async_send_to(asio::buffer(sendBuf), receiver_endpoint,
+                             boost::bind(&CNtpQuery::HandleSend, this,
+                                         asio::placeholders::error, asio::placeholders::bytes_transferred));
+    }
 
-        try
+    void HandleSend(const system::error_code& ec, size_t nBytes)
+    {
+        if (ec)
         {
+            LogPrintf("[NTP] Could not send request to NTP server %s (%s)\n", sHostName, ec.message());
+            return Finish();
+        }
+        socket.async_receive_from(asio::buffer(recvBuf), sender_endpoint,
+                                  boost::bind(&CNtpQuery::HandleReceive, this,
+                                              asio::placeholders::error, asio::placeholders::bytes_transferred));
+    }
 
-            fd_set fileDescriptorSet;
-            struct timeval timeStruct;
+    void HandleReceive(const system::error_code& ec, size_t nBytes)
+    {
+        int64_t nTimeReceived = GetTimeMicros();
 
-            timeStruct.tv_sec = GetArg("-ntptimeout", DEFAULT_NTP_TIMEOUT);
-            timeStruct.tv_usec = 0;
-            FD_ZERO(&fileDescriptorSet);
+        if (ec)
+        {
+            LogPrintf("[NTP] Could not read clock from NTP server %s (%s)\n", sHostName, ec.message());
+            return Finish();
+        }
 
-            int nativeSocket = socket.native();
+        // Answers which do not match our request (stale or spoofed) are skipped
+        if (nBytes < recvBuf.size() || sender_endpoint != receiver_endpoint ||
+            !std::equal(&recvBuf[24], &recvBuf[32], &sendBuf[40]))
+        {
+            LogPrint("ntp", "[NTP] Ignoring unexpected answer from %s\n", sender_endpoint.address().to_string());
+            return HandleSend(ec, 0);
+        }
 
-            FD_SET(nativeSocket,&fileDescriptorSet);
+        // Unsynchronized servers (leap indicator 3) and kiss-o'-death packets (stratum 0)
+        if ((recvBuf[0] >> 6) == 3 || recvBuf[1] == 0 || (recvBuf[0] & 7) != 4)
+        {
+            LogPrintf("[NTP] Received wrong clock from NTP server %s (unsynchronized server)\n", sHostName);
+            return Finish();
+        }
 
-            select(nativeSocket+1,&fileDescriptorSet,NULL,NULL,&timeStruct);
+        int64_t nTimeServerReceived = ReadNtpTimestamp(&recvBuf[32]);
+        int64_t nTimeServerSent = ReadNtpTimestamp(&recvBuf[40]);
+        if (nTimeServerSent < nTimeServerReceived)
+        {
+            LogPrintf("[NTP] Received wrong clock from NTP server %s (bad timestamp format)\n", sHostName);
+            return Finish();
+        }
 
-            if(!FD_ISSET(nativeSocket,&fileDescriptorSet))
-            {
+        int64_t nOffset = ((nTimeSent - nTimeServerReceived) + (nTimeReceived - nTimeServerSent)) / 2;
+        int64_t nDelay = std::max((int64_t)0, (nTimeReceived - nTimeSent) - (nTimeServerSent - nTimeServerReceived));
+        sample = CNtpSample(sHostName, nOffset, nDelay);
+        fValid = true;
 
-                LogPrint("ntp", "[NTP] Could not read socket from NTP server %s (Read timeout)\n", sHostName);
+        LogPrint("ntp", "[NTP] Received timestamp from %s: offset %dus, delay %dus\n", sHostName, nOffset, nDelay);
+        Finish();
+    }
 
-            }
-            else
-            {
+    void Cancel()
+    {
+        system::error_code ec;
+        resolver.cancel();
+        socket.close(ec);
+    }
+};
 
-                socket.receive_from(boost::asio::buffer(recvBuf), sender_endpoint);
+static void HandleNtpTimeout(const system::error_code& ec, std::vector<CNtpQuery*>* pvQueries, bool* pfTimedOut)
+{
+    // Cancelled once every server answered
+    if (ec == asio::error::operation_aborted)
+        return;
+    *pfTimedOut = true;
+    for (unsigned int i = 0; i < pvQueries->size(); i++)
+        (*pvQueries)[i]->Cancel();
+}
 
-                timeRecv = ntohl((uint32_t)recvBuf[8]);
+void CNtpClient::getSamples(int64_t nTimeout, vector<CNtpSample>& vSamplesRet)
+{
+    vSamplesRet.clear();
+    if (vServers.empty())
+        return;
 
-                if(timeRecv > 2208988800U) // Sanity check
-                {
+    io_service io_service;
+    deadline_timer timer(io_service);
+    int nPending = vServers.size();
+    bool fTimedOut = false;
 
-                    timeRecv-= 2208988800U;  // Substract 01/01/1970 == 2208988800U
-                    LogPrint("ntp", "[NTP] Received timestamp: %ll\n", (uint64_t)timeRecv);
+    std::vector<CNtpQuery*> vQueries;
+    for (unsigned int i = 0; i < vServers.size(); i++)
+        vQueries.push_back(new CNtpQuery(io_service, vServers[i], nPending, timer));
 
-                    return true;
+    timer.expires_from_now(posix_time::seconds(nTimeout));
+    timer.async_wait(boost::bind(&HandleNtpTimeout, asio::placeholders::error, &vQueries, &fTimedOut));
 
-                }
-                else
-                {
+    for (unsigned int i = 0; i < vQueries.size(); i++)
+        vQueries[i]->Start();
 
-                    LogPrintf("[NTP] Received wrong clock from NTP server %s (bad timestamp format)\n", sHostName);
+    try
+    {
+        // Answers arriving after the timeout are ignored. A name resolution
+        // still running is not: asio resolves on a thread of its own, which
+        // the io_service joins when it is destroyed, so a slow getaddrinfo
+        // can make this return later than nTimeout
+        while (nPending > 0 && !fTimedOut && io_service.run_one() > 0) { }
+    }
+    catch (std::exception& e)
+    {
+        LogPrintf("[NTP] Error while querying NTP servers (%s)\n", e.what());
+    }
 
-                }
+    for (unsigned int i = 0; i < vQueries.size(); i++)
+    {
+        if (vQueries[i]->fValid)
+            vSamplesRet.push_back(vQueries[i]->sample);
+    }
 
-            }
+    for (unsigned int i = 0; i < vQueries.size(); i++)
+        vQueries[i]->Cancel();
+    io_service.stop();
+    for (unsigned int i = 0; i < vQueries.size(); i++)
+        delete vQueries[i];
+}
 
-        }
-        catch (std::exception& e)
-        {
+static int64_t MedianOf(std::vector<int64_t> v)
+{
+    assert(!v.empty());
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
 
-             LogPrintf("[NTP] Could not read clock from NTP server %s (%s)\n", sHostName, e.what());
+bool EstimateNtpOffset(vector<CNtpSample>& vSamples, unsigned int nMinSamples, int64_t& nOffsetRet, int64_t& nErrorRet)
+{
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+        vSamples[i].fUsed = false;
 
-        }
+    if (vSamples.empty() || vSamples.size() < nMinSamples)
+        return false;
 
-    }
-    catch (std::exception& e)
+    std::vector<int64_t> vOffsets;
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+        vOffsets.push_back(vSamples[i].nOffset);
+    int64_t nMedian = MedianOf(vOffsets);
+
+    // Three times the median absolute deviation (scaled to a standard
+    // deviation), widened by the round trip uncertainty of each measurement
+    std::vector<int64_t> vDeviations;
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+        vDeviations.push_back(abs64(vSamples[i].nOffset - nMedian));
+    int64_t nMaxDistance = std::max((int64_t)MIN_NTP_OUTLIER_DISTANCE, MedianOf(vDeviations) * 3 * 3 / 2);
+
+    std::vector<int64_t> vUsed;
+    for (unsigned int i = 0; i < vSamples.size(); i++)
     {
+        if (abs64(vSamples[i].nOffset - nMedian) <= nMaxDistance + vSamples[i].nDelay / 2)
+        {
+            vSamples[i].fUsed = true;
+            vUsed.push_back(vSamples[i].nOffset);
+        }
+    }
 
-        LogPrintf("[NTP] Could not open socket to NTP server %s (%s)\n", sHostName, e.what());
+    if (vUsed.empty() || vUsed.size() < nMinSamples)
+        return false;
 
+    nOffsetRet = MedianOf(vUsed);
+    nErrorRet = 0;
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+    {
+        if (vSamples[i].fUsed)
+            nErrorRet = std::max(nErrorRet, abs64(vSamples[i].nOffset - nOffsetRet) + vSamples[i].nDelay / 2);
     }
 
-    return false;
+    return true;
+}
+
+static CCriticalSection cs_ntpSync;
+static CCriticalSection cs_ntpStatus;
+static CNtpStatus ntpStatus;
+static unsigned int nNtpAttempts = 0;
+static bool fNtpLastResult = false;
+
+CNtpStatus GetNtpStatus()
+{
+    LOCK(cs_ntpStatus);
+    return ntpStatus;
 }
 
 bool NtpClockSync()
 {
+    unsigned int nAttempts;
+    {
+        LOCK(cs_ntpStatus);
+        nAttempts = nNtpAttempts;
+    }
+
+    LOCK(cs_ntpSync);
+
+    {
+        // Another thread synced while we were waiting, its result is recent enough
+        LOCK(cs_ntpStatus);
+        if (nNtpAttempts != nAttempts)
+            return fNtpLastResult;
+    }
+
     LogPrintf("[NTP] Starting clock sync...\n");
 
     std::vector<std::string> vNtpServers;
-    std::vector<int64_t> vResults;
+    std::vector<CNtpSample> vSamples;
 
     if (mapMultiArgs["-ntpserver"].size() > 0)
     {
@@ -120,91 +323,70 @@ bool NtpClockSync()
         vNtpServers = vDefaultNtpServers;
     }
 
-    string sReport = "";
-    string sPrevServer = "";
-    int64_t nPrevMeasure = -1;
+    unsigned int nMin = GetArg("-ntpminmeasures", MINIMUM_NTP_MEASURE);
 
     random_shuffle(vNtpServers.begin(), vNtpServers.end(), GetRandInt);
+    if (vNtpServers.size() > std::max((unsigned int)MAX_NTP_QUERIES, nMin))
+        vNtpServers.resize(std::max((unsigned int)MAX_NTP_QUERIES, nMin));
 
-    unsigned int nMeasureCount = 0;
+    if (ShutdownRequested())
+        return false;
 
-    for(unsigned int i = 0; i < vNtpServers.size(); i++)
-    {
-        string s = vNtpServers[i];
-        CNtpClient ntpClient(s);
-        uint64_t nTimestamp = 0;
+    CNtpClient ntpClient(vNtpServers);
+    ntpClient.getSamples(GetArg("-ntptimeout", DEFAULT_NTP_TIMEOUT), vSamples);
 
-        if (ShutdownRequested())
-            return false;
+    int64_t nOffset = 0, nError = 0;
+    bool fOk = EstimateNtpOffset(vSamples, nMin, nOffset, nError);
+
+    string sReport = "";
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+    {
+        sReport += strprintf("%s[%+.3fsec.%s] ", vSamples[i].sServer, vSamples[i].nOffset / 1000000.0,
+                             vSamples[i].fUsed ? "" : " outlier");
+    }
 
-        if(ntpClient.getTimestamp(nTimestamp))
+    {
+        LOCK(cs_ntpStatus);
+        nNtpAttempts++;
+        ntpStatus.nLastAttempt = GetTimeNow();
+        ntpStatus.vSamples = vSamples;
+        if (fOk)
         {
-            int64_t nClockDrift = GetTimeNow() - nTimestamp;
-            nMeasureCount++;
-
-            // We push if its the first entry
-            if(nMeasureCount == 1)
-            {
-                vResults.push_back(nClockDrift);
-
-                string sign = "";
-                if(nClockDrift > 0)
-                    sign = "+";
-
-                sReport += s + "[" + sign + to_string(nClockDrift) + "sec.] ";
-            }
-            // or if n.measure is odd, including prev measure too
-            else if (nMeasureCount % 2 == 1)
-            {
-                vResults.push_back(nClockDrift);
-
-                string sign = "";
-                if(nClockDrift > 0)
-                    sign = "+";
-
-                sReport += s + "[" + sign + to_string(nClockDrift) + "sec.] ";
-
-                vResults.push_back(nPrevMeasure);
-
-                sign = "";
-                if(nPrevMeasure > 0)
-                    sign = "+";
-
-                sReport += sPrevServer + "[" + sign + to_string(nPrevMeasure) + "sec.] ";
-            }
-            else
-            {
-                nPrevMeasure = nClockDrift;
-                sPrevServer = s;
-            }
-
-            if (vResults.size() >= 5)
-                break;
+            ntpStatus.nOffset = nOffset;
+            ntpStatus.nError = nError;
+            ntpStatus.nLastSync = ntpStatus.nLastAttempt;
+            ntpStatus.nSyncs++;
         }
+        // Without a minimum number of measures a failed sync does not stop staking
+        fNtpLastResult = fOk || nMin == 0;
     }
 
-    assert(vResults.size() % 2 == 1 || vResults.size() == 0);
-
-    unsigned int nMin = GetArg("-ntpminmeasures", MINIMUM_NTP_MEASURE);
-
-    if (vResults.size() >= nMin)
+    if (fOk)
     {
         LogPrintf("[NTP] Measured: %s\n", sReport);
 
-        static CMedianFilter<int64_t> vNtpTimeOffsets(vResults.size(), 0);
-
-        for(unsigned int i = 0; i < vResults.size(); i++)
-        {
-            vNtpTimeOffsets.input(vResults[i]);
-        }
-
-        SetNtpTimeOffset(vNtpTimeOffsets.median());
+        SetNtpTimeOffset((nOffset >= 0 ? nOffset + 500000 : nOffset - 500000) / 1000000);
 
-        LogPrintf("[NTP] Calculated offset from median: %d\n", GetNtpTimeOffset());
-        return true;
+        LogPrintf("[NTP] Calculated offset: %d (%.3fsec., error %.3fsec.)\n", GetNtpTimeOffset(),
+                  nOffset / 1000000.0, nError / 1000000.0);
     }
-    else
+    else if (sReport != "")
     {
-        return false;
+        LogPrintf("[NTP] Not enough consistent measures: %s\n", sReport);
     }
+
+    return fNtpLastResult;
+}
+
+static void PeriodicNtpClockSync()
+{
+    if (!NtpClockSync())
+        LogPrintf("[NTP] Periodic clock sync failed, keeping offset %d\n", GetNtpTimeOffset());
+}
+
+void StartNtpClockSync(CScheduler& scheduler)
+{
+    int64_t nInterval = GetArg("-ntpsyncinterval", DEFAULT_NTP_SYNC_INTERVAL);
+    if (nInterval > 0)
+        scheduler.scheduleEvery(&PeriodicNtpClockSync, nInterval);
 }
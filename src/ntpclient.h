@@ -8,21 +8,86 @@
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 
+#include <stdint.h>
 #include <string>
 #include <iostream>
+#include <vector>
 
 #define DEFAULT_NTP_TIMEOUT 5
+#define DEFAULT_NTP_SYNC_INTERVAL 1800
+/** Number of servers queried at once in a clock sync */
+#define MAX_NTP_QUERIES 8
+/** Measurements closer than this to the median offset are never outliers (microseconds) */
+#define MIN_NTP_OUTLIER_DISTANCE 500000
 
 using namespace std;
 
+class CScheduler;
+
+/** A clock measurement against one NTP server */
+struct CNtpSample
+{
+    string sServer;
+    //! Local clock minus server clock, corrected for the round trip (microseconds)
+    int64_t nOffset;
+    //! Round trip delay of the request, without the server processing time (microseconds)
+    int64_t nDelay;
+    //! Whether the measurement was kept by the outlier rejection
+    bool fUsed;
+
+    CNtpSample() : nOffset(0), nDelay(0), fUsed(false) { }
+    CNtpSample(const string& server, int64_t nOffsetIn, int64_t nDelayIn) :
+        sServer(server), nOffset(nOffsetIn), nDelay(nDelayIn), fUsed(false) { }
+};
+
+/** Queries a set of NTP servers concurrently */
 class CNtpClient
 {
-    string sHostName;
+    vector<string> vServers;
   public:
-    CNtpClient(string server) : sHostName(server) { }
-    bool getTimestamp(uint64_t&);
+    CNtpClient(const vector<string>& servers) : vServers(servers) { }
+    CNtpClient(const string& server) : vServers(1, server) { }
+
+    /**
+     * Send a request to every server at once and collect the answers which
+     * arrive within nTimeout seconds. Returns as soon as all servers answered,
+     * or after the timeout once pending name resolutions completed.
+     */
+    void getSamples(int64_t nTimeout, vector<CNtpSample>& vSamplesRet);
 };
 
+/**
+ * Combine the measurements of several servers into one clock offset.
+ * Measurements too far from the median are rejected, the others are marked
+ * as used. nErrorRet bounds the distance between the returned offset and
+ * the round trip intervals of the used measurements. Returns false when
+ * fewer than nMinSamples measurements are left.
+ */
+bool EstimateNtpOffset(vector<CNtpSample>& vSamples, unsigned int nMinSamples, int64_t& nOffsetRet, int64_t& nErrorRet);
+
+/** Outcome of the last clock syncs */
+struct CNtpStatus
+{
+    //! Offset and error of the last successful sync (microseconds)
+    int64_t nOffset;
+    int64_t nError;
+    int64_t nLastSync;
+    int64_t nLastAttempt;
+    unsigned int nSyncs;
+    vector<CNtpSample> vSamples;
+
+    CNtpStatus() : nOffset(0), nError(0), nLastSync(0), nLastAttempt(0), nSyncs(0) { }
+};
+
+CNtpStatus GetNtpStatus();
+
+/**
+ * Measure the clock against the NTP servers and apply the offset. When
+ * another sync is already running, wait for it and return its result.
+ */
 bool NtpClockSync();
 
+/** Keep the clock in sync every -ntpsyncinterval seconds. */
+void StartNtpClockSync(CScheduler& scheduler);
+
 #endif // NTPCLIENT_H
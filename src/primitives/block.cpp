@@ -24,6 +24,38 @@ uint256 CBlockHeader::GetPoWHash() const
  return Hash9(BEGIN(nVersion), END(nNonce));
 }
 
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet)
+{
+    // nVersion through nNonce, as hashed by GetPoWHash
+    static const size_t nHeaderSize = 80;
+
+    vHashesRet.resize(vHeaders.size());
+
+    std::vector<size_t> vLegacy;
+    std::vector<unsigned char> vData;
+    vLegacy.reserve(vHeaders.size());
+    vData.reserve(vHeaders.size() * nHeaderSize);
+
+    for (size_t i = 0; i < vHeaders.size(); i++)
+    {
+        const CBlockHeader& header = vHeaders[i];
+        if (header.nVersion > 6) {
+            vHashesRet[i] = header.GetHash();
+        } else {
+            vLegacy.push_back(i);
+            vData.insert(vData.end(), BEGIN(header.nVersion), END(header.nNonce));
+        }
+    }
+
+    if (vLegacy.empty())
+        return;
+
+    std::vector<uint256> vLegacyHashes(vLegacy.size());
+    HashX13Batch(&vData[0], nHeaderSize, vLegacy.size(), &vLegacyHashes[0]);
+    for (size_t i = 0; i < vLegacy.size(); i++)
+        vHashesRet[vLegacy[i]] = vLegacyHashes[i];
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
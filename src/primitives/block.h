@@ -214,6 +214,12 @@ struct CBlockLocator
 
 };
 
+/**
+ * Compute the hashes of a batch of block headers. The X13 hashes of legacy
+ * headers (nVersion <= 6) go through the batch X13 API.
+ */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet);
+
 /** Compute the consensus-critical block weight (see BIP 141). */
 int64_t GetBlockWeight(const CBlock& tx);
 
@@ -139,11 +139,9 @@ void CFund_Voting::Refresh()
 
     {
     std::vector<CFund::CProposal> vec;
-    if(pblocktree->GetProposalIndex(vec))
+    if(pcfundstate->GetProposalsByState(CFund::NIL, vec))
     {
         BOOST_FOREACH(const CFund::CProposal& proposal, vec) {
-            if (proposal.fState != CFund::NIL)
-                continue;
             QListWidget* whereToAdd = ui->notvotingList;
             auto it = std::find_if( vAddedProposalVotes.begin(), vAddedProposalVotes.end(),
                                     [&proposal](const std::pair<std::string, bool>& element){ return element.first == proposal.hash.ToString();} );
@@ -167,11 +165,9 @@ void CFund_Voting::Refresh()
 
     {
     std::vector<CFund::CPaymentRequest> vec;
-    if(pblocktree->GetPaymentRequestIndex(vec))
+    if(pcfundstate->GetPaymentRequestsByState(CFund::NIL, vec))
     {
         BOOST_FOREACH(const CFund::CPaymentRequest& prequest, vec) {
-            if (prequest.fState != CFund::NIL)
-                continue;
             QListWidget* whereToAdd = ui->notvotingList;
             auto it = std::find_if( vAddedPaymentRequestVotes.begin(), vAddedPaymentRequestVotes.end(),
                                     [&prequest](const std::pair<std::string, int>& element){ return element.first == prequest.hash.ToString();} );
@@ -1810,11 +1810,9 @@ void NavCoinGUI::updateStakingStatus()
             bool fFoundPaymentRequest = false;
             {
                 std::vector<CFund::CProposal> vec;
-                if(pblocktree->GetProposalIndex(vec))
+                if(pcfundstate->GetProposalsByState(CFund::NIL, vec))
                 {
                     BOOST_FOREACH(const CFund::CProposal& proposal, vec) {
-                        if (proposal.fState != CFund::NIL)
-                            continue;
                         auto it = std::find_if( vAddedProposalVotes.begin(), vAddedProposalVotes.end(),
                                                 [&proposal](const std::pair<std::string, int>& element){ return element.first == proposal.hash.ToString();} );
                         if (it == vAddedProposalVotes.end()) {
@@ -1826,11 +1824,9 @@ void NavCoinGUI::updateStakingStatus()
             }
             {
                 std::vector<CFund::CPaymentRequest> vec;
-                if(pblocktree->GetPaymentRequestIndex(vec))
+                if(pcfundstate->GetPaymentRequestsByState(CFund::NIL, vec))
                 {
                     BOOST_FOREACH(const CFund::CPaymentRequest& prequest, vec) {
-                        if (prequest.fState != CFund::NIL)
-                            continue;
                         auto it = std::find_if( vAddedPaymentRequestVotes.begin(), vAddedPaymentRequestVotes.end(),
                                                 [&prequest](const std::pair<std::string, int>& element){ return element.first == prequest.hash.ToString();} );
                         if (it == vAddedPaymentRequestVotes.end()) {
@@ -895,13 +895,14 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 UniValue listproposals(const UniValue& params, bool fHelp)
 {
 
-     if (fHelp)
+     if (fHelp || params.size() > 2)
         throw runtime_error(
-            "listproposals \"filter\"\n"
+            "listproposals \"filter\" ( \"address\" )\n"
             "\nList the proposals and all the relating data including payment requests and status.\n"
             "\nNote passing no argument returns all proposals regardless of state.\n"
             "\nArguments:\n"
-            "\n1. \"filter\" (string, optional)   \"accepted\" | \"rejected\" | \"expired\" | \"pending\"\n"
+            "\n1. \"filter\" (string, optional)   \"accepted\" | \"rejected\" | \"expired\" | \"pending\" | \"\"\n"
+            "\n2. \"address\" (string, optional)  Only list the proposals paying to this address\n"
             "\nExamples:\n"
             + HelpExampleCli("listproposal", "accepted")
             + HelpExampleRpc("listproposal", "")
@@ -914,7 +915,7 @@ UniValue listproposals(const UniValue& params, bool fHelp)
     bool showRejected = false;
     bool showExpired = false;
     bool showPending = false;
-    if(params.size() == 1) {
+    if(params.size() >= 1) {
         if(params[0].get_str() == "accepted") {
             showAccepted = true;
             showAll = false;
@@ -933,8 +934,28 @@ UniValue listproposals(const UniValue& params, bool fHelp)
         }
     }
 
+    // Proposals only become EXPIRED once they are expired, so the full list
+    // skips them; pending ones are found by state alone. The other filters
+    // depend on the votes and read every proposal.
     std::vector<CFund::CProposal> vec;
-    if(pblocktree->GetProposalIndex(vec))
+    bool fRead;
+    if(params.size() == 2) {
+        fRead = pcfundstate->GetProposalsByAddress(params[1].get_str(), vec);
+    } else if(showAll || showPending) {
+        std::set<CFund::flags> states;
+        states.insert(CFund::NIL);
+        states.insert(CFund::PENDING_VOTING_PREQ);
+        states.insert(CFund::PENDING_FUNDS);
+        if(showAll) {
+            states.insert(CFund::ACCEPTED);
+            states.insert(CFund::REJECTED);
+        }
+        fRead = pcfundstate->GetProposalsByStates(states, vec);
+    } else {
+        fRead = pcfundstate->GetProposalIndex(vec);
+    }
+
+    if(fRead)
     {
         BOOST_FOREACH(const CFund::CProposal& proposal, vec) {
             if((showAll && (!proposal.IsExpired(pindexBestHeader->GetBlockTime())
@@ -965,67 +986,25 @@ UniValue cfundstats(const UniValue& params, bool fHelp)
             + HelpExampleRpc("cfundstats", "")
         );
 
-    CFund::CProposal proposal; CFund::CPaymentRequest prequest;
-
-    int nBlocks = (chainActive.Tip()->nHeight % Params().GetConsensus().nBlocksPerVotingCycle) + 1;
-    CBlockIndex* pindexblock = chainActive.Tip();
-
-    std::map<uint256, bool> vSeen;
-    std::map<uint256, std::pair<int, int>> vCacheProposalsRPC;
-    std::map<uint256, std::pair<int, int>> vCachePaymentRequestRPC;
-
-    vCacheProposalsRPC.clear();
-    vCachePaymentRequestRPC.clear();
-
-    while(nBlocks > 0 && pindexblock != NULL) {
-        vSeen.clear();
-        for(unsigned int i = 0; i < pindexblock->vProposalVotes.size(); i++) {
-            if(!CFund::FindProposal(pindexblock->vProposalVotes[i].first, proposal))
-                continue;
-            if(vSeen.count(pindexblock->vProposalVotes[i].first) == 0) {
-                if(vCacheProposalsRPC.count(pindexblock->vProposalVotes[i].first) == 0)
-                    vCacheProposalsRPC[pindexblock->vProposalVotes[i].first] = make_pair(0, 0);
-                if(pindexblock->vProposalVotes[i].second)
-                    vCacheProposalsRPC[pindexblock->vProposalVotes[i].first].first += 1;
-                else
-                    vCacheProposalsRPC[pindexblock->vProposalVotes[i].first].second += 1;
-                vSeen[pindexblock->vProposalVotes[i].first]=true;
-            }
-        }
-        for(unsigned int i = 0; i < pindexblock->vPaymentRequestVotes.size(); i++) {
-            if(!CFund::FindPaymentRequest(pindexblock->vPaymentRequestVotes[i].first, prequest))
-                continue;
-            if(!CFund::FindProposal(prequest.proposalhash, proposal))
-                continue;
-            if (mapBlockIndex.count(proposal.blockhash) == 0)
-                continue;
-            CBlockIndex* pindexblockparent = mapBlockIndex[proposal.blockhash];
-            if(pindexblockparent == NULL)
-                continue;
-            if(vSeen.count(pindexblock->vPaymentRequestVotes[i].first) == 0) {
-                if(vCachePaymentRequestRPC.count(pindexblock->vPaymentRequestVotes[i].first) == 0)
-                    vCachePaymentRequestRPC[pindexblock->vPaymentRequestVotes[i].first] = make_pair(0, 0);
-                if(pindexblock->vPaymentRequestVotes[i].second)
-                    vCachePaymentRequestRPC[pindexblock->vPaymentRequestVotes[i].first].first += 1;
-                else
-                    vCachePaymentRequestRPC[pindexblock->vPaymentRequestVotes[i].first].second += 1;
-                vSeen[pindexblock->vPaymentRequestVotes[i].first]=true;
-            }
-        }
-        pindexblock = pindexblock->pprev;
-        nBlocks--;
+    // Kept up to date by CountVotes, only missing until the first block is connected
+    CFund::CCycleStats stats;
+    if (!pcfundstate->GetCycleStats(stats)) {
+        LOCK(cs_main);
+        if (!UpdateCycleStats(chainActive.Tip()))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Could not read the votes of the current voting cycle");
+        pcfundstate->GetCycleStats(stats);
     }
 
     UniValue ret(UniValue::VOBJ);
     UniValue cf(UniValue::VOBJ);
-    cf.push_back(Pair("available",      ValueFromAmount(pindexBestHeader->nCFSupply)));
-    cf.push_back(Pair("locked",         ValueFromAmount(pindexBestHeader->nCFLocked)));
+    cf.push_back(Pair("available",      ValueFromAmount(stats.nCFSupply)));
+    cf.push_back(Pair("locked",         ValueFromAmount(stats.nCFLocked)));
     ret.push_back(Pair("funds", cf));
     UniValue vp(UniValue::VOBJ);
-    int starting = chainActive.Tip()->nHeight - (chainActive.Tip()->nHeight % Params().GetConsensus().nBlocksPerVotingCycle);
+    int starting = stats.nHeight - (stats.nHeight % Params().GetConsensus().nBlocksPerVotingCycle);
     vp.push_back(Pair("starting",       starting));
     vp.push_back(Pair("ending",         starting+Params().GetConsensus().nBlocksPerVotingCycle-1));
-    vp.push_back(Pair("current",        chainActive.Tip()->nHeight));
+    vp.push_back(Pair("current",        stats.nHeight));
     UniValue consensus(UniValue::VOBJ);
     consensus.push_back(Pair("blocksPerVotingCycle",Params().GetConsensus().nBlocksPerVotingCycle));
     if (!IsReducedCFundQuorumEnabled(pindexBestHeader, Params().GetConsensus())){
@@ -1045,32 +1024,23 @@ UniValue cfundstats(const UniValue& params, bool fHelp)
     UniValue votesProposals(UniValue::VARR);
     UniValue votesPaymentRequests(UniValue::VARR);
 
-    std::map<uint256, std::pair<int, int>>::iterator it;
-    for(it = vCacheProposalsRPC.begin(); it != vCacheProposalsRPC.end(); it++) {
-        CFund::CProposal proposal;
-        if(!CFund::FindProposal(it->first, proposal))
-            continue;
+    BOOST_FOREACH(const CFund::CCycleVotes& votes, stats.vProposals) {
         UniValue op(UniValue::VOBJ);
-        op.push_back(Pair("str", proposal.strDZeel));
-        op.push_back(Pair("hash", proposal.hash.ToString()));
-        op.push_back(Pair("amount", ValueFromAmount(proposal.nAmount)));
-        op.push_back(Pair("yes", it->second.first));
-        op.push_back(Pair("no", it->second.second));
+        op.push_back(Pair("str", votes.strDZeel));
+        op.push_back(Pair("hash", votes.hash.ToString()));
+        op.push_back(Pair("amount", ValueFromAmount(votes.nAmount)));
+        op.push_back(Pair("yes", votes.nVotesYes));
+        op.push_back(Pair("no", votes.nVotesNo));
         votesProposals.push_back(op);
     }
-    for(it = vCachePaymentRequestRPC.begin(); it != vCachePaymentRequestRPC.end(); it++) {
-        CFund::CPaymentRequest prequest; CFund::CProposal proposal;
-        if(!CFund::FindPaymentRequest(it->first, prequest))
-            continue;
-        if(!CFund::FindProposal(prequest.proposalhash, proposal))
-            continue;
+    BOOST_FOREACH(const CFund::CCycleVotes& votes, stats.vPaymentRequests) {
         UniValue op(UniValue::VOBJ);
-        op.push_back(Pair("hash", prequest.hash.ToString()));
-        op.push_back(Pair("proposalDesc", proposal.strDZeel));
-        op.push_back(Pair("desc", prequest.strDZeel));
-        op.push_back(Pair("amount", ValueFromAmount(prequest.nAmount)));
-        op.push_back(Pair("yes", it->second.first));
-        op.push_back(Pair("no", it->second.second));
+        op.push_back(Pair("hash", votes.hash.ToString()));
+        op.push_back(Pair("proposalDesc", votes.strProposalDZeel));
+        op.push_back(Pair("desc", votes.strDZeel));
+        op.push_back(Pair("amount", ValueFromAmount(votes.nAmount)));
+        op.push_back(Pair("yes", votes.nVotesYes));
+        op.push_back(Pair("no", votes.nVotesNo));
         votesPaymentRequests.push_back(op);
     }
     vp.push_back(Pair("votedProposals",       votesProposals));
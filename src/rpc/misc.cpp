@@ -11,6 +11,7 @@
 #include "netbase.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -601,6 +602,71 @@ bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
     return a.second.blockHeight < b.second.blockHeight;
 }
 
+bool getPagingFromParams(const UniValue& params, int &offset, int &limit, std::string &after)
+{
+    offset = 0;
+    limit = 0;
+    after.clear();
+
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue offsetValue = find_value(params[0].get_obj(), "offset");
+    UniValue afterValue = find_value(params[0].get_obj(), "after");
+
+    if (limitValue.isNum()) {
+        limit = limitValue.get_int();
+        if (limit <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+    }
+    if (offsetValue.isNum()) {
+        offset = offsetValue.get_int();
+        if (offset < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Offset is expected to be zero or greater");
+        }
+    }
+    if (afterValue.isStr()) {
+        after = afterValue.get_str();
+    }
+
+    return !limitValue.isNull() || !offsetValue.isNull() || !afterValue.isNull();
+}
+
+template<typename T>
+std::string encodeAddressIndexToken(const T &position)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << position;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template<typename T>
+void decodeAddressIndexToken(const std::string &token, T &position)
+{
+    if (!IsHex(token)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+    }
+    std::vector<unsigned char> data(ParseHex(token));
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    try {
+        ss >> position;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+    }
+}
+
+CAddressIndexCursor* openAddressIndexCursor(const std::pair<uint160, int> &address, int start, int end,
+                                            const CAddressIndexKey* pkeyAfter = NULL)
+{
+    CAddressIndexCursor* pcursor = GetAddressIndexCursor(address.first, address.second, start, end, pkeyAfter);
+    if (!pcursor) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    return pcursor;
+}
+
 bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
                    std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b) {
     return a.second.time < b.second.time;
@@ -779,6 +845,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number) Return at most this many deltas\n"
+            "  \"offset\" (number) Skip this many deltas first\n"
+            "  \"after\" (string) Continue after the deltas of a previous call, as given by its \"next\"\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -790,6 +859,11 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nWhen limit, offset or after are given (or with chainInfo), an object is returned instead:\n"
+            "{\n"
+            "  \"deltas\"  (array) The deltas as above\n"
+            "  \"next\"  (string) Continuation token, only present when more deltas follow\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -825,36 +899,63 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int offset = 0;
+    int limit = 0;
+    std::string after;
+    bool fPaging = getPagingFromParams(params, offset, limit, after);
+
+    // Deltas are returned address by address, the continuation token holds
+    // the position of the last returned delta
+    std::pair<uint32_t, CAddressIndexKey> position(0, CAddressIndexKey());
+    if (!after.empty()) {
+        decodeAddressIndexToken(after, position);
+        if (position.first >= addresses.size()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+        }
+    }
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+    UniValue deltas(UniValue::VARR);
+    int count = 0;
+    bool fMore = false;
+
+    for (uint32_t n = position.first; n < addresses.size() && !fMore; n++) {
+        const CAddressIndexKey* pkeyAfter = (!after.empty() && n == position.first) ? &position.second : NULL;
+        boost::scoped_ptr<CAddressIndexCursor> pcursor(openAddressIndexCursor(addresses[n], start, end, pkeyAfter));
+
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            CAddressIndexKey key;
+            CAmount value;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(value)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+            if (offset > 0) {
+                offset--;
+                continue;
+            }
+            if (limit > 0 && count == limit) {
+                fMore = true;
+                break;
             }
-        }
-    }
 
-    UniValue deltas(UniValue::VARR);
+            std::string address;
+            if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+            }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("satoshis", value));
+            delta.push_back(Pair("txid", key.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)key.index));
+            delta.push_back(Pair("blockindex", (int)key.txindex));
+            delta.push_back(Pair("height", key.blockHeight));
+            delta.push_back(Pair("address", address));
+            deltas.push_back(delta);
+
+            position = std::make_pair(n, key);
+            count++;
         }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
     }
 
     UniValue result(UniValue::VOBJ);
@@ -881,6 +982,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
+        if (fMore)
+            result.push_back(Pair("next", encodeAddressIndexToken(position)));
+
+        return result;
+    } else if (fPaging) {
+        result.push_back(Pair("deltas", deltas));
+        if (fMore)
+            result.push_back(Pair("next", encodeAddressIndexToken(position)));
 
         return result;
     } else {
@@ -906,6 +1015,8 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (number) The number of transactions of each address, added up\n"
+            "  \"lastheight\"  (number) The height of the last block with a transaction of the address(es)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
@@ -918,27 +1029,27 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
+    uint64_t txcount = 0;
+    int lastheight = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance((*it).first, (*it).second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += value.balance;
+        received += value.received;
+        txcount += value.txCount;
+        lastheight = std::max(lastheight, value.lastHeight);
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txcount));
+    result.push_back(Pair("lastheight", lastheight));
 
     return result;
 
@@ -959,12 +1070,20 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number) Return at most this many txids\n"
+            "  \"offset\" (number) Skip this many txids first\n"
+            "  \"after\" (string) Continue after the txids of a previous call, as given by its \"next\"\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nWhen limit, offset or after are given, an object is returned instead:\n"
+            "{\n"
+            "  \"txids\"  (array) The txids as above, in block order also for several addresses\n"
+            "  \"next\"  (string) Continuation token, only present when more txids follow\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -987,43 +1106,109 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int offset = 0;
+    int limit = 0;
+    std::string after;
+    bool fPaging = getPagingFromParams(params, offset, limit, after);
+
+    // The histories of all addresses are merged in block order, the
+    // continuation token holds the height and block position of the last
+    // returned transaction
+    std::pair<int, unsigned int> position(0, 0);
+    if (!after.empty()) {
+        decodeAddressIndexToken(after, position);
+        if (position.first <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid continuation token");
+        }
+    }
 
+    std::vector<boost::shared_ptr<CAddressIndexCursor> > cursors;
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
+        if (!after.empty()) {
+            cursors.push_back(boost::shared_ptr<CAddressIndexCursor>(openAddressIndexCursor(*it, position.first, end > 0 && start > 0 ? end : 0)));
+        } else if (start > 0 && end > 0) {
+            cursors.push_back(boost::shared_ptr<CAddressIndexCursor>(openAddressIndexCursor(*it, start, end)));
         } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
+            cursors.push_back(boost::shared_ptr<CAddressIndexCursor>(openAddressIndexCursor(*it, 0, 0)));
         }
     }
 
-    std::set<std::pair<int, std::string> > txids;
-    UniValue result(UniValue::VARR);
+    UniValue txids(UniValue::VARR);
+    int count = 0;
+    bool fMore = false;
+
+    // Without paging, the txids of several addresses are ordered by txid
+    // within each height, as they always were
+    bool fSortByTxid = !fPaging && addresses.size() > 1;
+    std::set<std::string> heightTxids;
+    int nHeightTxids = 0;
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Find the next transaction of any of the addresses
+        bool fFound = false;
+        std::pair<int, unsigned int> next;
+        uint256 txhash;
+        for (unsigned int i = 0; i < cursors.size(); i++) {
+            CAddressIndexKey key;
+            if (!cursors[i]->GetKey(key))
+                continue;
+            std::pair<int, unsigned int> current(key.blockHeight, key.txindex);
+            if (!fFound || current < next) {
+                next = current;
+                txhash = key.txhash;
+                fFound = true;
+            }
+        }
+        if (!fFound)
+            break;
+
+        // Skip the other entries of this transaction
+        for (unsigned int i = 0; i < cursors.size(); i++) {
+            CAddressIndexKey key;
+            while (cursors[i]->GetKey(key) && key.blockHeight == next.first && key.txindex == next.second)
+                cursors[i]->Next();
+        }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
+        if (!after.empty() && next <= position)
+            continue;
+        if (offset > 0) {
+            offset--;
+            continue;
+        }
+        if (limit > 0 && count == limit) {
+            fMore = true;
+            break;
+        }
 
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
+        if (fSortByTxid) {
+            if (next.first != nHeightTxids) {
+                for (std::set<std::string>::const_iterator it = heightTxids.begin(); it != heightTxids.end(); it++)
+                    txids.push_back(*it);
+                heightTxids.clear();
+                nHeightTxids = next.first;
             }
+            heightTxids.insert(txhash.GetHex());
+        } else {
+            txids.push_back(txhash.GetHex());
         }
+        position = next;
+        count++;
     }
 
-    if (addresses.size() > 1) {
-        for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
-        }
+    for (std::set<std::string>::const_iterator it = heightTxids.begin(); it != heightTxids.end(); it++)
+        txids.push_back(*it);
+
+    if (fPaging) {
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (fMore)
+            result.push_back(Pair("next", encodeAddressIndexToken(position)));
+        return result;
     }
 
-    return result;
+    return txids;
 
 }
 
@@ -1075,6 +1260,124 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+bool getStakingKeyFromParam(const UniValue& param, uint160& stakingKey)
+{
+    CNavCoinAddress address(param.get_str());
+    CKeyID keyID;
+
+    // A cold staking address is accepted for its staking key
+    if (address.IsColdStakingAddress(Params())) {
+        if (!address.GetStakingKeyID(keyID))
+            return false;
+    } else if (!address.GetKeyID(keyID)) {
+        return false;
+    }
+
+    stakingKey = keyID;
+    return true;
+}
+
+UniValue getcoldstakingutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getcoldstakingutxos \"stakingaddress\"\n"
+            "\nReturns the unspent cold staking outputs delegated to a staking key (requires coldstakingindex to be enabled).\n"
+            "\nArguments:\n"
+            "1. \"stakingaddress\"  (string, required) The address of the staking key, or a cold staking address using it\n"
+            "\nResult\n"
+            "[\n"
+            "  {\n"
+            "    \"spendingaddress\"  (string) The address of the spending key\n"
+            "    \"txid\"  (string) The output txid\n"
+            "    \"outputIndex\"  (number) The output index\n"
+            "    \"satoshis\"  (number) The number of satoshis of the output\n"
+            "    \"height\"  (number) The block height\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoldstakingutxos", "\"NP1pz1mCyTntuTN5cyYL9QkY2WHBFFCYDb\"")
+            + HelpExampleRpc("getcoldstakingutxos", "\"NP1pz1mCyTntuTN5cyYL9QkY2WHBFFCYDb\"")
+            );
+
+    uint160 stakingKey;
+    if (!getStakingKeyFromParam(params[0], stakingKey))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid staking address");
+
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > unspentOutputs;
+    if (!GetColdStakingUnspent(stakingKey, unspentOutputs))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for staking address");
+
+    UniValue utxos(UniValue::VARR);
+
+    for (std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("spendingaddress", CNavCoinAddress(CKeyID(it->second.spendingKey)).ToString()));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        utxos.push_back(output);
+    }
+
+    return utxos;
+}
+
+UniValue getcoldstakingweight(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getcoldstakingweight \"stakingaddress\"\n"
+            "\nReturns the coins delegated to a staking key and how many of them can stake now (requires coldstakingindex to be enabled).\n"
+            "\nArguments:\n"
+            "1. \"stakingaddress\"  (string, required) The address of the staking key, or a cold staking address using it\n"
+            "\nResult\n"
+            "{\n"
+            "  \"outputs\"  (number) The number of unspent cold staking outputs\n"
+            "  \"spendingaddresses\"  (number) The number of distinct spending keys delegating to the staking key\n"
+            "  \"satoshis\"  (number) The total of the outputs\n"
+            "  \"weight\"  (number) The total of the outputs old enough to stake\n"
+            "  \"height\"  (number) The height of the chain tip\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoldstakingweight", "\"NP1pz1mCyTntuTN5cyYL9QkY2WHBFFCYDb\"")
+            + HelpExampleRpc("getcoldstakingweight", "\"NP1pz1mCyTntuTN5cyYL9QkY2WHBFFCYDb\"")
+            );
+
+    uint160 stakingKey;
+    if (!getStakingKeyFromParam(params[0], stakingKey))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid staking address");
+
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > unspentOutputs;
+    if (!GetColdStakingUnspent(stakingKey, unspentOutputs))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for staking address");
+
+    LOCK(cs_main);
+
+    // The kernel ages coins from the time of the block which includes them
+    int64_t nTimeMature = GetAdjustedTime() - Params().GetConsensus().nStakeMinAge;
+    CAmount nTotal = 0;
+    CAmount nWeight = 0;
+    std::set<uint160> setSpendingKeys;
+
+    for (std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+        nTotal += it->second.satoshis;
+        setSpendingKeys.insert(it->second.spendingKey);
+        const CBlockIndex* pindex = chainActive[it->second.blockHeight];
+        if (pindex && pindex->GetBlockTime() <= nTimeMature)
+            nWeight += it->second.satoshis;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("outputs", (int)unspentOutputs.size()));
+    result.push_back(Pair("spendingaddresses", (int)setSpendingKeys.size()));
+    result.push_back(Pair("satoshis", nTotal));
+    result.push_back(Pair("weight", nWeight));
+    result.push_back(Pair("height", (int)chainActive.Height()));
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1092,6 +1395,10 @@ static const CRPCCommand commands[] =
     { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
     { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
 
+    /* Cold staking index */
+    { "coldstakingindex",   "getcoldstakingutxos",    &getcoldstakingutxos,    false },
+    { "coldstakingindex",   "getcoldstakingweight",   &getcoldstakingweight,   false },
+
     /* Blockchain */
     { "blockchain",         "getspentinfo",           &getspentinfo,           false },
 
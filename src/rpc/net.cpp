@@ -10,7 +10,9 @@
 #include "miner.h"
 #include "net.h"
 #include "netbase.h"
+#include "ntpclient.h"
 #include "protocol.h"
+#include "stakingstats.h"
 #include "sync.h"
 #include "timedata.h"
 #include "ui_interface.h"
@@ -434,6 +436,64 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getntpinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getntpinfo ( sync )\n"
+            "\nReturns the state of the clock sync with the NTP servers.\n"
+            "\nArguments:\n"
+            "1. sync            (boolean, optional, default=false) Sync the clock before answering\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"ntptimeoffset\": n,      (numeric) Offset applied to the clock, in seconds\n"
+            "  \"offset\": n,             (numeric) Measured offset of the local clock, in milliseconds\n"
+            "  \"error\": n,              (numeric) Bound of the error of the measured offset, in milliseconds\n"
+            "  \"lastsync\": t,           (numeric) Time of the last successful sync\n"
+            "  \"lastattempt\": t,        (numeric) Time of the last sync attempt\n"
+            "  \"syncs\": n,              (numeric) Number of successful syncs\n"
+            "  \"measures\": [           (array) Answers to the last sync attempt\n"
+            "    {\n"
+            "      \"server\": \"host\",   (string) The NTP server\n"
+            "      \"offset\": n,         (numeric) Local clock minus server clock, in milliseconds\n"
+            "      \"delay\": n,          (numeric) Round trip delay, in milliseconds\n"
+            "      \"used\": true|false   (boolean) False if rejected as an outlier\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getntpinfo", "")
+            + HelpExampleCli("getntpinfo", "true")
+            + HelpExampleRpc("getntpinfo", "")
+       );
+
+    if (params.size() > 0 && params[0].get_bool())
+        NtpClockSync();
+
+    CNtpStatus status = GetNtpStatus();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("ntptimeoffset", GetNtpTimeOffset()));
+    obj.push_back(Pair("offset", status.nOffset / 1000.0));
+    obj.push_back(Pair("error", status.nError / 1000.0));
+    obj.push_back(Pair("lastsync", status.nLastSync));
+    obj.push_back(Pair("lastattempt", status.nLastAttempt));
+    obj.push_back(Pair("syncs", (int)status.nSyncs));
+    UniValue measures(UniValue::VARR);
+    BOOST_FOREACH(const CNtpSample& sample, status.vSamples)
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("server", sample.sServer));
+        entry.push_back(Pair("offset", sample.nOffset / 1000.0));
+        entry.push_back(Pair("delay", sample.nDelay / 1000.0));
+        entry.push_back(Pair("used", sample.fUsed));
+        measures.push_back(entry);
+    }
+    obj.push_back(Pair("measures", measures));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -665,6 +725,174 @@ UniValue getstakinginfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+static UniValue StakingTimingToJSON(const CStakingTiming& timing)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", timing.nCount));
+    obj.push_back(Pair("avg", timing.GetAverage() / 1000.0));
+    obj.push_back(Pair("max", timing.nMax / 1000.0));
+    return obj;
+}
+
+UniValue getstakingstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getstakingstats ( rounds )\n"
+            "\nReturns staking instrumentation: the work of the staker per stake slot and the fate of its blocks.\n"
+            "\nArguments:\n"
+            "1. rounds          (numeric, optional, default=0) Number of recent rounds to list\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"rounds\": n,             (numeric) Stake slots searched since startup\n"
+            "  \"slotsmissed\": n,        (numeric) Stake slots skipped while staking was enabled and unlocked\n"
+            "  \"coverage\": x.xxx,       (numeric) Fraction of the stake slots searched\n"
+            "  \"inputs\": x.xxx,         (numeric) Average number of UTXOs examined per round\n"
+            "  \"kernelrate\": x.xxx,     (numeric) Kernels hashed per second of kernel search\n"
+            "  \"stakes\": n,             (numeric) Blocks signed\n"
+            "  \"accepted\": n,           (numeric) Blocks accepted by the node\n"
+            "  \"orphaned\": n,           (numeric) Accepted blocks which were reorganized out of the chain\n"
+            "  \"pending\": n,            (numeric) Accepted blocks which can still be orphaned\n"
+            "  \"timings\": {             (object) Durations over the last rounds, in milliseconds\n"
+            "    \"createnewblock\": { \"count\": n, \"avg\": x.xxx, \"max\": x.xxx },\n"
+            "    \"checkkernel\": { ... },\n"
+            "    \"createcoinstake\": { ... },\n"
+            "    \"signblock\": { ... },\n"
+            "    \"checkstake\": { ... }\n"
+            "  },\n"
+            "  \"lastrounds\": [          (array) The last rounds, if requested\n"
+            "    {\n"
+            "      \"slot\": t,           (numeric) Time of the stake slot\n"
+            "      \"height\": n,         (numeric) Height of the tip searched on\n"
+            "      \"inputs\": n,         (numeric) UTXOs examined\n"
+            "      \"createnewblock\": x.xxx, (numeric) Durations in milliseconds, -1 when the step did not run\n"
+            "      \"checkkernel\": x.xxx,\n"
+            "      \"createcoinstake\": x.xxx,\n"
+            "      \"signblock\": x.xxx,\n"
+            "      \"checkstake\": x.xxx,\n"
+            "      \"found\": true|false,\n"
+            "      \"accepted\": true|false\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakingstats", "")
+            + HelpExampleCli("getstakingstats", "10")
+            + HelpExampleRpc("getstakingstats", "10")
+       );
+
+    int nCount = params.size() > 0 ? params[0].get_int() : 0;
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative number of rounds");
+
+    {
+        LOCK(cs_main);
+        stakingStats.UpdateStakes(chainActive, COINBASE_MATURITY);
+    }
+    CStakingSummary summary = stakingStats.GetSummary();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("rounds", summary.nRounds));
+    obj.push_back(Pair("slotsmissed", summary.nSlotsMissed));
+    uint64_t nSlots = summary.nRounds + summary.nSlotsMissed;
+    obj.push_back(Pair("coverage", nSlots ? (double)summary.nRounds / nSlots : 0.0));
+    obj.push_back(Pair("inputs", summary.nRounds ? (double)summary.nInputs / summary.nRounds : 0.0));
+
+    std::vector<CStakingRound> vRounds = stakingStats.GetRounds(DEFAULT_STAKING_ROUNDS);
+    uint64_t nKernels = 0;
+    int64_t nSearchTime = 0;
+    BOOST_FOREACH(const CStakingRound& round, vRounds)
+    {
+        if (round.nCheckKernel < 0)
+            continue;
+        nKernels += round.nInputs;
+        nSearchTime += round.nCheckKernel;
+    }
+    obj.push_back(Pair("kernelrate", nSearchTime ? nKernels * 1000000.0 / nSearchTime : 0.0));
+
+    obj.push_back(Pair("stakes", summary.nStakes));
+    obj.push_back(Pair("accepted", summary.nAccepted));
+    obj.push_back(Pair("orphaned", summary.nOrphaned));
+    obj.push_back(Pair("pending", summary.nPending));
+
+    UniValue timings(UniValue::VOBJ);
+    timings.push_back(Pair("createnewblock", StakingTimingToJSON(summary.createNewBlock)));
+    timings.push_back(Pair("checkkernel", StakingTimingToJSON(summary.checkKernel)));
+    timings.push_back(Pair("createcoinstake", StakingTimingToJSON(summary.createCoinStake)));
+    timings.push_back(Pair("signblock", StakingTimingToJSON(summary.signBlock)));
+    timings.push_back(Pair("checkstake", StakingTimingToJSON(summary.checkStake)));
+    obj.push_back(Pair("timings", timings));
+
+    if (nCount > 0)
+    {
+        UniValue rounds(UniValue::VARR);
+        BOOST_FOREACH(const CStakingRound& round, stakingStats.GetRounds(nCount))
+        {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("slot", round.nSlot));
+            entry.push_back(Pair("height", round.nHeight));
+            entry.push_back(Pair("inputs", (uint64_t)round.nInputs));
+            entry.push_back(Pair("createnewblock", round.nCreateNewBlock < 0 ? -1.0 : round.nCreateNewBlock / 1000.0));
+            entry.push_back(Pair("checkkernel", round.nCheckKernel < 0 ? -1.0 : round.nCheckKernel / 1000.0));
+            entry.push_back(Pair("createcoinstake", round.nCreateCoinStake < 0 ? -1.0 : round.nCreateCoinStake / 1000.0));
+            entry.push_back(Pair("signblock", round.nSignBlock < 0 ? -1.0 : round.nSignBlock / 1000.0));
+            entry.push_back(Pair("checkstake", round.nCheckStake < 0 ? -1.0 : round.nCheckStake / 1000.0));
+            entry.push_back(Pair("found", round.fFound));
+            entry.push_back(Pair("accepted", round.fAccepted));
+            rounds.push_back(entry);
+        }
+        obj.push_back(Pair("lastrounds", rounds));
+    }
+
+    return obj;
+}
+
+UniValue liststakingwallets(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "liststakingwallets\n"
+            "\nReturns the wallets the staker searches kernels for: the main wallet and the -stakingwallet wallets.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"wallet\": \"file\",      (string) The wallet file\n"
+            "    \"locked\": true|false,   (boolean) Locked wallets do not stake, only the main wallet can be locked\n"
+            "    \"weight\": n,            (numeric) The stake weight of the wallet\n"
+            "    \"slots\": n,             (numeric) Stake slots searched\n"
+            "    \"inputs\": n,            (numeric) Kernel candidates in the last search\n"
+            "    \"kernels\": n,           (numeric) Kernels found\n"
+            "    \"stakes\": n,            (numeric) Blocks staked and accepted\n"
+            "    \"laststake\": t          (numeric) Time of the last block staked\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("liststakingwallets", "")
+            + HelpExampleRpc("liststakingwallets", "")
+       );
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(CWallet* pwallet, GetStakingWallets())
+    {
+        CStakingWalletStats stats = GetStakingWalletStats(pwallet->strWalletFile);
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("wallet", pwallet->strWalletFile));
+        obj.push_back(Pair("locked", pwallet->IsLocked()));
+        obj.push_back(Pair("weight", (uint64_t)pwallet->GetStakeWeight()));
+        obj.push_back(Pair("slots", stats.nSlots));
+        obj.push_back(Pair("inputs", (uint64_t)stats.nInputs));
+        obj.push_back(Pair("kernels", stats.nKernels));
+        obj.push_back(Pair("stakes", stats.nStakes));
+        obj.push_back(Pair("laststake", stats.nLastStakeTime));
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
 UniValue listanonservers(const UniValue& params, bool fHelp)
 {
   UniValue obj(UniValue::VARR);
@@ -706,6 +934,8 @@ static const CRPCCommand commands[] =
     { "network",            "getconnectioncount",     &getconnectioncount,     true  },
     { "network",            "getstakesubsidy",        &getstakesubsidy,        true  },
     { "network",            "getstakinginfo",         &getstakinginfo,         true  },
+    { "network",            "getstakingstats",        &getstakingstats,        true  },
+    { "network",            "liststakingwallets",     &liststakingwallets,     true  },
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
     { "network",            "addnode",                &addnode,                true  },
@@ -714,6 +944,7 @@ static const CRPCCommand commands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
+    { "network",            "getntpinfo",             &getntpinfo,             true  },
     { "network",            "setban",                 &setban,                 true  },
     { "network",            "listbanned",             &listbanned,             true  },
     { "network",            "listanonservers",        &listanonservers,        true  },
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakingstats.h"
+
+#include "chain.h"
+#include "pos.h"
+#include "validationinterface.h"
+
+#include <algorithm>
+
+CStakingStats stakingStats;
+
+void CStakingTiming::Add(int64_t nTime)
+{
+    nCount++;
+    nTotal += nTime;
+    nMax = std::max(nMax, nTime);
+}
+
+CStakingStats::CStakingStats(unsigned int nMaxRoundsIn) : nMaxRounds(nMaxRoundsIn)
+{
+    Clear();
+}
+
+void CStakingStats::Clear()
+{
+    LOCK(cs);
+    vRounds.clear();
+    nRounds = 0;
+    nSlotsMissed = 0;
+    nInputs = 0;
+    nStakes = 0;
+    nAccepted = 0;
+    nOrphaned = 0;
+    nLastSlot = 0;
+    mapPending.clear();
+}
+
+void CStakingStats::AddRound(const CStakingRound& round)
+{
+    {
+        LOCK(cs);
+        if (nLastSlot != 0 && round.nSlot > nLastSlot)
+            nSlotsMissed += (round.nSlot - nLastSlot) / (STAKE_TIMESTAMP_MASK + 1) - 1;
+        nLastSlot = std::max(nLastSlot, round.nSlot);
+
+        nRounds++;
+        nInputs += round.nInputs;
+        if (round.fFound)
+            nStakes++;
+
+        vRounds.push_back(round);
+        while (vRounds.size() > nMaxRounds)
+            vRounds.pop_front();
+    }
+
+    GetMainSignals().StakingRound(round);
+}
+
+void CStakingStats::Pause()
+{
+    LOCK(cs);
+    nLastSlot = 0;
+}
+
+void CStakingStats::AddStake(const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (mapPending.insert(std::make_pair(pindex->GetBlockHash(), pindex)).second)
+        nAccepted++;
+}
+
+void CStakingStats::UpdateStakes(const CChain& chain, int nSafeDepth)
+{
+    LOCK(cs);
+    for (std::map<uint256, const CBlockIndex*>::iterator it = mapPending.begin(); it != mapPending.end();)
+    {
+        const CBlockIndex* pindex = it->second;
+        if (chain.Contains(pindex)) {
+            if (chain.Height() - pindex->nHeight < nSafeDepth) {
+                ++it;
+                continue;
+            }
+        } else if (chain.Height() >= pindex->nHeight) {
+            // Another block took its place
+            nOrphaned++;
+        } else {
+            // The chain went back below it, it can still come back
+            ++it;
+            continue;
+        }
+        mapPending.erase(it++);
+    }
+}
+
+CStakingSummary CStakingStats::GetSummary() const
+{
+    LOCK(cs);
+    CStakingSummary summary;
+    summary.nRounds = nRounds;
+    summary.nSlotsMissed = nSlotsMissed;
+    summary.nInputs = nInputs;
+    summary.nStakes = nStakes;
+    summary.nAccepted = nAccepted;
+    summary.nOrphaned = nOrphaned;
+    summary.nPending = mapPending.size();
+
+    for (std::deque<CStakingRound>::const_iterator it = vRounds.begin(); it != vRounds.end(); ++it)
+    {
+        if (it->nCreateNewBlock >= 0)
+            summary.createNewBlock.Add(it->nCreateNewBlock);
+        if (it->nCheckKernel >= 0)
+            summary.checkKernel.Add(it->nCheckKernel);
+        if (it->nCreateCoinStake >= 0)
+            summary.createCoinStake.Add(it->nCreateCoinStake);
+        if (it->nSignBlock >= 0)
+            summary.signBlock.Add(it->nSignBlock);
+        if (it->nCheckStake >= 0)
+            summary.checkStake.Add(it->nCheckStake);
+    }
+    return summary;
+}
+
+std::vector<CStakingRound> CStakingStats::GetRounds(unsigned int nCount) const
+{
+    LOCK(cs);
+    nCount = std::min(nCount, (unsigned int)vRounds.size());
+    return std::vector<CStakingRound>(vRounds.end() - nCount, vRounds.end());
+}
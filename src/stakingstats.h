@@ -0,0 +1,145 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_STAKINGSTATS_H
+#define NAVCOIN_STAKINGSTATS_H
+
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+class CChain;
+
+/** Number of staking rounds kept for the averages and getstakingstats */
+static const unsigned int DEFAULT_STAKING_ROUNDS = 1000;
+
+/**
+ * One round of the staker: the search of one stake slot. Durations are in
+ * microseconds, -1 when the step did not run in the round.
+ */
+struct CStakingRound
+{
+    int64_t nSlot;
+    int nHeight;
+    //! Kernel candidates (UTXOs) examined
+    uint32_t nInputs;
+    int64_t nCreateNewBlock;
+    //! Kernel search, i.e. CheckKernel over every candidate
+    int64_t nCheckKernel;
+    int64_t nCreateCoinStake;
+    int64_t nSignBlock;
+    int64_t nCheckStake;
+    bool fFound;
+    bool fAccepted;
+
+    CStakingRound() : nSlot(0), nHeight(0), nInputs(0), nCreateNewBlock(-1), nCheckKernel(-1),
+                      nCreateCoinStake(-1), nSignBlock(-1), nCheckStake(-1), fFound(false), fAccepted(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nSlot);
+        READWRITE(nHeight);
+        READWRITE(nInputs);
+        READWRITE(nCreateNewBlock);
+        READWRITE(nCheckKernel);
+        READWRITE(nCreateCoinStake);
+        READWRITE(nSignBlock);
+        READWRITE(nCheckStake);
+        READWRITE(fFound);
+        READWRITE(fAccepted);
+    }
+};
+
+/** Count, average and maximum duration of one staking step */
+struct CStakingTiming
+{
+    uint64_t nCount;
+    int64_t nTotal;
+    int64_t nMax;
+
+    CStakingTiming() : nCount(0), nTotal(0), nMax(0) {}
+
+    void Add(int64_t nTime);
+    double GetAverage() const { return nCount ? (double)nTotal / nCount : 0; }
+};
+
+/** Totals since startup, and timings over the last rounds */
+struct CStakingSummary
+{
+    uint64_t nRounds;
+    uint64_t nSlotsMissed;
+    uint64_t nInputs;
+    uint64_t nStakes;
+    uint64_t nAccepted;
+    uint64_t nOrphaned;
+    uint64_t nPending;
+    CStakingTiming createNewBlock;
+    CStakingTiming checkKernel;
+    CStakingTiming createCoinStake;
+    CStakingTiming signBlock;
+    CStakingTiming checkStake;
+
+    CStakingSummary() : nRounds(0), nSlotsMissed(0), nInputs(0), nStakes(0), nAccepted(0), nOrphaned(0), nPending(0) {}
+};
+
+/**
+ * Staking instrumentation. The staker reports every round, and the blocks it
+ * got accepted are followed until they are deep enough to be safe from
+ * reorgs, counting the ones which left the active chain as orphaned.
+ */
+class CStakingStats
+{
+private:
+    mutable CCriticalSection cs;
+    unsigned int nMaxRounds;
+    std::deque<CStakingRound> vRounds;
+
+    uint64_t nRounds;
+    uint64_t nSlotsMissed;
+    uint64_t nInputs;
+    uint64_t nStakes;
+    uint64_t nAccepted;
+    uint64_t nOrphaned;
+    //! Slot of the last round, 0 while the staker is paused
+    int64_t nLastSlot;
+    //! Accepted stakes which can still be orphaned
+    std::map<uint256, const CBlockIndex*> mapPending;
+
+public:
+    CStakingStats(unsigned int nMaxRoundsIn = DEFAULT_STAKING_ROUNDS);
+
+    /** Record a round. The slots skipped since the previous round are counted as missed. */
+    void AddRound(const CStakingRound& round);
+
+    /** The staker stopped searching on purpose (disabled, locked wallets): the next gap is not missed */
+    void Pause();
+
+    /** Follow an accepted stake */
+    void AddStake(const CBlockIndex* pindex);
+
+    /**
+     * Count the followed stakes which are not in chain anymore as orphaned, and
+     * stop following those nSafeDepth blocks deep.
+     */
+    void UpdateStakes(const CChain& chain, int nSafeDepth);
+
+    CStakingSummary GetSummary() const;
+
+    /** The last nCount rounds, oldest first */
+    std::vector<CStakingRound> GetRounds(unsigned int nCount) const;
+
+    void Clear();
+};
+
+extern CStakingStats stakingStats;
+
+#endif // NAVCOIN_STAKINGSTATS_H
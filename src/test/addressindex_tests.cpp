@@ -0,0 +1,155 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "random.h"
+#include "txdb.h"
+#include "test/test_navcoin.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+static std::vector<std::pair<CAddressIndexKey, CAmount> > ReadAll(CAddressIndexCursor* pcursor)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        CAddressIndexKey key;
+        CAmount nValue;
+        BOOST_CHECK(pcursor->GetKey(key));
+        BOOST_CHECK(pcursor->GetValue(nValue));
+        vEntries.push_back(std::make_pair(key, nValue));
+    }
+    return vEntries;
+}
+
+BOOST_AUTO_TEST_CASE(address_index_cursor)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint160 hashA = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"));
+    uint160 hashB = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d36"));
+
+    // Two entries per block for address A at heights 1..10, one for B
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int nHeight = 1; nHeight <= 10; nHeight++) {
+        uint256 txhash = GetRandHash();
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hashA, nHeight, 1, txhash, 0, false), nHeight * COIN));
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hashA, nHeight, 2, GetRandHash(), 1, true), -COIN));
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hashB, nHeight, 1, txhash, 1, false), COIN));
+    }
+    BOOST_CHECK(db.WriteAddressIndex(vEntries));
+
+    // The whole history of an address, in key order
+    boost::scoped_ptr<CAddressIndexCursor> pcursor(db.AddressIndexCursor(hashA, 1));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead = ReadAll(pcursor.get());
+    BOOST_CHECK_EQUAL(vRead.size(), 20U);
+    for (unsigned int i = 0; i < vRead.size(); i++) {
+        BOOST_CHECK(vRead[i].first.hashBytes == hashA);
+        BOOST_CHECK_EQUAL(vRead[i].first.blockHeight, (int)i / 2 + 1);
+        BOOST_CHECK_EQUAL(vRead[i].first.txindex, i % 2 + 1);
+    }
+
+    // Other address types are not included
+    pcursor.reset(db.AddressIndexCursor(hashA, 2));
+    BOOST_CHECK(!pcursor->Valid());
+
+    // A height range
+    pcursor.reset(db.AddressIndexCursor(hashA, 1, 4, 6));
+    vRead = ReadAll(pcursor.get());
+    BOOST_CHECK_EQUAL(vRead.size(), 6U);
+    BOOST_CHECK_EQUAL(vRead.front().first.blockHeight, 4);
+    BOOST_CHECK_EQUAL(vRead.back().first.blockHeight, 6);
+
+    // Resuming after an entry
+    CAddressIndexKey keyAfter = vEntries[9].first;
+    pcursor.reset(db.AddressIndexCursor(hashA, 1, 0, 0, &keyAfter));
+    vRead = ReadAll(pcursor.get());
+    BOOST_CHECK_EQUAL(vRead.size(), 13U);
+    BOOST_CHECK_EQUAL(vRead.front().first.blockHeight, 4);
+    BOOST_CHECK_EQUAL(vRead.front().first.txindex, 2U);
+
+    // The vector based read gives the same entries
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+    BOOST_CHECK(db.ReadAddressIndex(hashB, 1, vIndex, 2, 3));
+    BOOST_CHECK_EQUAL(vIndex.size(), 2U);
+    BOOST_CHECK(vIndex[0].first == vEntries[5].first);
+    BOOST_CHECK(vIndex[1].first == vEntries[8].first);
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_index)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint160 hash = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"));
+
+    // One block per height: a receive of 10, and from height 2 on a spend of 3 in another transaction
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAmount> > > vBlocks;
+    for (int nHeight = 1; nHeight <= 5; nHeight++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+        uint256 txhash = GetRandHash();
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, nHeight, 1, txhash, 0, false), 10 * COIN));
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, nHeight, 1, txhash, 1, false), 0));
+        if (nHeight > 1)
+            vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, nHeight, 2, GetRandHash(), 0, true), -3 * COIN));
+        vBlocks.push_back(vEntries);
+        BOOST_CHECK(db.WriteAddressIndex(vEntries));
+    }
+
+    CAddressBalanceValue value;
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 38 * COIN);
+    BOOST_CHECK_EQUAL(value.received, 50 * COIN);
+    BOOST_CHECK_EQUAL(value.txCount, 9U);
+    BOOST_CHECK_EQUAL(value.lastHeight, 5);
+
+    // Connecting a block again, as after an unclean shutdown, does not count it twice
+    BOOST_CHECK(db.WriteAddressIndex(vBlocks[2]));
+    BOOST_CHECK(db.WriteAddressIndex(vBlocks.back()));
+    CAddressBalanceValue again;
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, again));
+    BOOST_CHECK_EQUAL(again.balance, value.balance);
+    BOOST_CHECK_EQUAL(again.received, value.received);
+    BOOST_CHECK_EQUAL(again.txCount, value.txCount);
+    BOOST_CHECK_EQUAL(again.lastHeight, value.lastHeight);
+
+    // Disconnecting the last block restores the totals before it
+    BOOST_CHECK(db.EraseAddressIndex(vBlocks.back()));
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 31 * COIN);
+    BOOST_CHECK_EQUAL(value.received, 40 * COIN);
+    BOOST_CHECK_EQUAL(value.txCount, 7U);
+    BOOST_CHECK_EQUAL(value.lastHeight, 4);
+
+    // and disconnecting it again changes nothing
+    BOOST_CHECK(db.EraseAddressIndex(vBlocks.back()));
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, again));
+    BOOST_CHECK_EQUAL(again.balance, 31 * COIN);
+    BOOST_CHECK_EQUAL(again.txCount, 7U);
+
+    // Building the index from the entries gives the same totals
+    CAddressBalanceValue built;
+    BOOST_CHECK(db.BuildAddressBalanceIndex());
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, built));
+    BOOST_CHECK_EQUAL(built.balance, value.balance);
+    BOOST_CHECK_EQUAL(built.received, value.received);
+    BOOST_CHECK_EQUAL(built.txCount, value.txCount);
+    BOOST_CHECK_EQUAL(built.lastHeight, value.lastHeight);
+
+    // and building it again does not add to the existing totals
+    BOOST_CHECK(db.BuildAddressBalanceIndex());
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, built));
+    BOOST_CHECK_EQUAL(built.balance, value.balance);
+    BOOST_CHECK_EQUAL(built.txCount, value.txCount);
+
+    // Disconnecting everything removes the address
+    for (int i = 3; i >= 0; i--)
+        BOOST_CHECK(db.EraseAddressIndex(vBlocks[i]));
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, value));
+    BOOST_CHECK(value.IsNull());
+    BOOST_CHECK_EQUAL(value.lastHeight, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,325 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/cfund.h"
+#include "hash.h"
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+#include "test/test_navcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cfund_tests, TestingSetup)
+
+static CFund::CProposal MakeProposal(CAmount nFee, CFund::flags fState)
+{
+    CFund::CProposal proposal;
+    proposal.hash = GetRandHash();
+    proposal.nAmount = 100 * COIN;
+    proposal.nFee = nFee;
+    proposal.Address = "address";
+    proposal.nDeadline = 1000;
+    proposal.fState = fState;
+    proposal.nVersion = CFund::CProposal::CURRENT_VERSION;
+    return proposal;
+}
+
+BOOST_AUTO_TEST_CASE(cfund_state_cache)
+{
+    CFund::CStateCache cache(pblocktree);
+    BOOST_CHECK(cache.Load());
+
+    std::vector<std::pair<uint256, CFund::CProposal> > vUpdate;
+    CFund::CProposal a = MakeProposal(50 * COIN, CFund::NIL);
+    CFund::CProposal b = MakeProposal(70 * COIN, CFund::ACCEPTED);
+    CFund::CProposal c = MakeProposal(60 * COIN, CFund::NIL);
+    vUpdate.push_back(make_pair(a.hash, a));
+    vUpdate.push_back(make_pair(b.hash, b));
+    vUpdate.push_back(make_pair(c.hash, c));
+    BOOST_CHECK(cache.UpdateProposalIndex(vUpdate));
+
+    CFund::CProposal found;
+    BOOST_CHECK(cache.ReadProposalIndex(a.hash, found));
+    BOOST_CHECK_EQUAL(found.nFee, a.nFee);
+    BOOST_CHECK(!cache.ReadProposalIndex(GetRandHash(), found));
+
+    // Sorted by fee, like the database index
+    std::vector<CFund::CProposal> vProposals;
+    cache.GetProposalIndex(vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 3U);
+    BOOST_CHECK(vProposals[0].hash == b.hash);
+    BOOST_CHECK(vProposals[1].hash == c.hash);
+    BOOST_CHECK(vProposals[2].hash == a.hash);
+
+    // State index follows updates
+    vProposals.clear();
+    cache.GetProposalsByState(CFund::NIL, vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 2U);
+    c.fState = CFund::REJECTED;
+    vUpdate.clear();
+    vUpdate.push_back(make_pair(c.hash, c));
+    vUpdate.push_back(make_pair(a.hash, CFund::CProposal()));
+    cache.UpdateProposalIndex(vUpdate);
+    vProposals.clear();
+    cache.GetProposalsByState(CFund::NIL, vProposals);
+    BOOST_CHECK(vProposals.empty());
+    vProposals.clear();
+    cache.GetProposalsByState(CFund::REJECTED, vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 1U);
+    BOOST_CHECK(!cache.ReadProposalIndex(a.hash, found));
+
+    // Nothing reaches the database before a flush
+    CFund::CStateCache reloaded(pblocktree);
+    BOOST_CHECK(reloaded.Load());
+    BOOST_CHECK(!reloaded.ReadProposalIndex(b.hash, found));
+
+    std::vector<std::pair<uint256, CFund::CProposal> > vDirtyProposals;
+    std::vector<std::pair<uint256, CFund::CPaymentRequest> > vDirtyPaymentRequests;
+    cache.GetDirty(vDirtyProposals, vDirtyPaymentRequests);
+    BOOST_CHECK_EQUAL(vDirtyProposals.size(), 3U);
+    BOOST_CHECK(vDirtyPaymentRequests.empty());
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>(),
+                                           vDirtyProposals, vDirtyPaymentRequests));
+    cache.ClearDirty();
+
+    vDirtyProposals.clear();
+    cache.GetDirty(vDirtyProposals, vDirtyPaymentRequests);
+    BOOST_CHECK(vDirtyProposals.empty());
+
+    BOOST_CHECK(reloaded.Load());
+    BOOST_CHECK(reloaded.ReadProposalIndex(b.hash, found));
+    BOOST_CHECK(reloaded.ReadProposalIndex(c.hash, found));
+    BOOST_CHECK_EQUAL(found.fState, CFund::REJECTED);
+    BOOST_CHECK(!reloaded.ReadProposalIndex(a.hash, found));
+}
+
+BOOST_AUTO_TEST_CASE(cfund_state_cache_secondary_indexes)
+{
+    CFund::CStateCache cache(pblocktree);
+    BOOST_CHECK(cache.Load());
+
+    std::vector<std::pair<uint256, CFund::CProposal> > vUpdate;
+    CFund::CProposal a = MakeProposal(50 * COIN, CFund::NIL);
+    CFund::CProposal b = MakeProposal(70 * COIN, CFund::EXPIRED);
+    CFund::CProposal c = MakeProposal(60 * COIN, CFund::PENDING_FUNDS);
+    c.Address = "other";
+    vUpdate.push_back(make_pair(a.hash, a));
+    vUpdate.push_back(make_pair(b.hash, b));
+    vUpdate.push_back(make_pair(c.hash, c));
+    BOOST_CHECK(cache.UpdateProposalIndex(vUpdate));
+
+    std::set<CFund::flags> states;
+    states.insert(CFund::NIL);
+    states.insert(CFund::PENDING_FUNDS);
+    std::vector<CFund::CProposal> vProposals;
+    cache.GetProposalsByStates(states, vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 2U);
+    BOOST_CHECK(vProposals[0].hash == c.hash);
+    BOOST_CHECK(vProposals[1].hash == a.hash);
+
+    vProposals.clear();
+    cache.GetProposalsByAddress("address", vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 2U);
+    BOOST_CHECK(vProposals[0].hash == b.hash);
+    BOOST_CHECK(vProposals[1].hash == a.hash);
+
+    // Changing the address or removing the proposal moves it out of the index
+    a.Address = "other";
+    vUpdate.clear();
+    vUpdate.push_back(make_pair(a.hash, a));
+    vUpdate.push_back(make_pair(b.hash, CFund::CProposal()));
+    cache.UpdateProposalIndex(vUpdate);
+    vProposals.clear();
+    cache.GetProposalsByAddress("address", vProposals);
+    BOOST_CHECK(vProposals.empty());
+    vProposals.clear();
+    cache.GetProposalsByAddress("other", vProposals);
+    BOOST_CHECK_EQUAL(vProposals.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(cfund_cycle_stats)
+{
+    CFund::CStateCache cache(pblocktree);
+    BOOST_CHECK(cache.Load());
+
+    CFund::CCycleStats stats;
+    BOOST_CHECK(!cache.GetCycleStats(stats));
+
+    stats.nHeight = 20;
+    stats.nCFSupply = 5 * COIN;
+    CFund::CCycleVotes votes;
+    votes.hash = GetRandHash();
+    votes.nVotesYes = 3;
+    votes.nVotesNo = 1;
+    stats.vProposals.push_back(votes);
+    cache.SetCycleStats(stats);
+
+    CFund::CCycleStats read;
+    BOOST_CHECK(cache.GetCycleStats(read));
+    BOOST_CHECK_EQUAL(read.nHeight, 20);
+    BOOST_CHECK_EQUAL(read.nCFSupply, 5 * COIN);
+    BOOST_CHECK_EQUAL(read.vProposals.size(), 1U);
+    BOOST_CHECK(read.vProposals[0].hash == votes.hash);
+
+    // A reload starts without a snapshot
+    BOOST_CHECK(cache.Load());
+    BOOST_CHECK(!cache.GetCycleStats(read));
+}
+
+BOOST_AUTO_TEST_CASE(cfund_tx_check)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::string strAddress = CNavCoinAddress(key.GetPubKey().GetID()).ToString();
+
+    CMutableTransaction mtx;
+    mtx.nVersion = CTransaction::PROPOSAL_VERSION;
+    mtx.vout.resize(1);
+    CFund::SetScriptForCommunityFundContribution(mtx.vout[0].scriptPubKey);
+    mtx.vout[0].nValue = Params().GetConsensus().nProposalMinimalFee;
+    mtx.strDZeel = "{\"n\":1000000000,\"a\":\"" + strAddress + "\",\"d\":86400,\"s\":\"proposal\",\"v\":2}";
+    CTransaction tx(mtx);
+
+    CFund::CTxCheck check(tx);
+    BOOST_CHECK(check());
+    BOOST_CHECK(check.fValid);
+    BOOST_CHECK(check.fContribution);
+    BOOST_CHECK(check.proposal.hash == tx.GetHash());
+    BOOST_CHECK_EQUAL(check.proposal.nAmount, 1000000000);
+    BOOST_CHECK_EQUAL(check.proposal.Address, strAddress);
+    BOOST_CHECK_EQUAL(check.proposal.nDeadline, 86400U);
+    BOOST_CHECK_EQUAL(check.proposal.strDZeel, "proposal");
+    BOOST_CHECK_EQUAL(check.proposal.nFee, Params().GetConsensus().nProposalMinimalFee);
+    // The version is checked in context
+    BOOST_CHECK(CFund::IsValidProposal(check, 2));
+    BOOST_CHECK(!CFund::IsValidProposal(check, 1));
+
+    // Cached by transaction hash and kind of check
+    CFund::CTxCheckCache cache;
+    CFund::CTxCheck cached;
+    BOOST_CHECK(!cache.Get(tx, false, cached));
+    cache.Add(check);
+    BOOST_CHECK(cache.Get(tx, false, cached));
+    BOOST_CHECK(cached.ptx == &tx);
+    BOOST_CHECK(cached.fValid);
+    BOOST_CHECK_EQUAL(cached.proposal.Address, strAddress);
+    BOOST_CHECK(!cache.Get(tx, true, cached));
+
+    mtx.strDZeel = "{\"n\":1000000000}";
+    CTransaction txBad(mtx);
+    CFund::CTxCheck checkBad(txBad);
+    BOOST_CHECK(checkBad());
+    BOOST_CHECK(!checkBad.fValid);
+    BOOST_CHECK(!CFund::IsValidProposal(checkBad, 2));
+
+    // Payment requests keep the key which signed them
+    uint256 proposalhash = GetRandHash();
+    std::string strSecret = "I kindly ask to withdraw 100NAV from the proposal " + proposalhash.ToString() + ". Payment request id: request";
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << strSecret;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.SignCompact(ss.GetHash(), vchSig));
+
+    CMutableTransaction mtxRequest;
+    mtxRequest.nVersion = CTransaction::PAYMENT_REQUEST_VERSION;
+    mtxRequest.strDZeel = "{\"n\":100,\"s\":\"" + EncodeBase64(&vchSig[0], vchSig.size()) + "\",\"h\":\"" + proposalhash.ToString() +
+                          "\",\"i\":\"request\",\"v\":1}";
+    CTransaction txRequest(mtxRequest);
+
+    CFund::CTxCheck checkRequest(txRequest);
+    BOOST_CHECK(checkRequest());
+    BOOST_CHECK(checkRequest.fValid);
+    BOOST_CHECK(checkRequest.signer == key.GetPubKey().GetID());
+    BOOST_CHECK(checkRequest.prequest.proposalhash == proposalhash);
+    BOOST_CHECK_EQUAL(checkRequest.prequest.nAmount, 100);
+    // No such proposal
+    BOOST_CHECK(!CFund::IsValidPaymentRequest(checkRequest, 2));
+}
+
+BOOST_AUTO_TEST_CASE(cfund_vote_tally)
+{
+    uint256 p1 = GetRandHash(), p2 = GetRandHash(), r1 = GetRandHash();
+
+    CBlockVotes block1;
+    block1.vProposalVotes.push_back(make_pair(p1, true));
+    block1.vProposalVotes.push_back(make_pair(p1, false)); // only the first vote of a block counts
+    block1.vProposalVotes.push_back(make_pair(p2, false));
+    block1.vPaymentRequestVotes.push_back(make_pair(r1, true));
+
+    CBlockVotes block2;
+    block2.vProposalVotes.push_back(make_pair(p1, true));
+
+    CFund::CVoteTally tally;
+    tally.AddBlock(block1, 1);
+    tally.AddBlock(block2, 1);
+    BOOST_CHECK(tally.mapProposalVotes[p1] == make_pair(2, 0));
+    BOOST_CHECK(tally.mapProposalVotes[p2] == make_pair(0, 1));
+    BOOST_CHECK(tally.mapPaymentRequestVotes[r1] == make_pair(1, 0));
+
+    // Disconnecting drops the entries which run out of votes
+    tally.AddBlock(block1, -1);
+    BOOST_CHECK(tally.mapProposalVotes[p1] == make_pair(1, 0));
+    BOOST_CHECK_EQUAL(tally.mapProposalVotes.count(p2), 0U);
+    BOOST_CHECK(tally.mapPaymentRequestVotes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(cfund_block_votes)
+{
+    uint256 hash = GetRandHash();
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.nStatus |= BLOCK_HAVE_DATA;
+
+    CBlockVotes votes;
+    BOOST_CHECK(!pblocktree->ReadBlockVotes(hash, votes));
+    BOOST_CHECK(votes.IsNull());
+
+    CBlockVotes written;
+    written.vProposalVotes.push_back(make_pair(GetRandHash(), true));
+    written.vPaymentRequestVotes.push_back(make_pair(GetRandHash(), false));
+    pblocktree->WriteBlockVotes(hash, written);
+    BOOST_CHECK(pblocktree->ReadBlockVotes(hash, votes));
+    BOOST_CHECK(votes.vProposalVotes == written.vProposalVotes);
+
+    std::vector<const CBlockIndex*> vBlocks(1, &index);
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks));
+
+    // Push the entry out of the cache with the votes of other blocks, so it
+    // is read from the database
+    for (size_t i = 0; i < CBlockTreeDB::nMaxCachedVotes; i++)
+        pblocktree->WriteBlockVotes(GetRandHash(), written);
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>()));
+    votes.SetNull();
+    BOOST_CHECK(pblocktree->ReadBlockVotes(hash, votes));
+    BOOST_CHECK(votes.vProposalVotes == written.vProposalVotes);
+    BOOST_CHECK(votes.vPaymentRequestVotes == written.vPaymentRequestVotes);
+
+    // Writing the block index again, as when its status changes, keeps the votes
+    index.nStatus &= ~BLOCK_HAVE_DATA;
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks));
+    for (size_t i = 0; i < CBlockTreeDB::nMaxCachedVotes; i++)
+        pblocktree->WriteBlockVotes(GetRandHash(), CBlockVotes());
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>()));
+    votes.SetNull();
+    BOOST_CHECK(pblocktree->ReadBlockVotes(hash, votes));
+    BOOST_CHECK(votes.vProposalVotes == written.vProposalVotes);
+
+    // Block index records still end with the, now empty, votes older versions read
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex legacy;
+    legacy.fLegacyVotes = true;
+    ss >> legacy;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(legacy.votes.IsNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
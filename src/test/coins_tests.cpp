@@ -7,6 +7,7 @@
 #include "script/standard.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
+#include "undo.h"
 #include "test/test_navcoin.h"
 #include "main.h"
 #include "consensus/validation.h"
@@ -415,4 +416,96 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+
+BOOST_AUTO_TEST_CASE(ccoins_time_serialization)
+{
+    // Entries without the transaction time leave it unknown
+    CDataStream ss1(ParseHex("0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e"), SER_DISK, CLIENT_VERSION);
+    CCoins cc1;
+    ss1 >> cc1;
+    BOOST_CHECK_EQUAL(cc1.nTime, 0U);
+    BOOST_CHECK_EQUAL(cc1.nHeight, 203998);
+
+    // and serialize to the same bytes
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << cc1;
+    BOOST_CHECK_EQUAL(HexStr(ss2.begin(), ss2.end()), "0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e");
+
+    // The transaction time is flagged in the header code and follows the height
+    cc1.nTime = 1500000000;
+    CDataStream ss3(SER_DISK, CLIENT_VERSION);
+    ss3 << cc1;
+    BOOST_CHECK_EQUAL(ss3.size(), ::GetSerializeSize(cc1, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK_EQUAL(HexStr(ss3.begin(), ss3.begin() + 4), "01beff04");
+    CCoins cc2;
+    ss3 >> cc2;
+    BOOST_CHECK(ss3.empty());
+    BOOST_CHECK_EQUAL(cc2.nTime, 1500000000U);
+    BOOST_CHECK_EQUAL(cc2.nHeight, 203998);
+    BOOST_CHECK(cc2 == cc1);
+
+    // Entries with and without the time are read correctly from the middle of a stream
+    CCoins cc3 = cc1;
+    cc3.nTime = 0;
+    BOOST_CHECK(cc3 != cc1);
+    CDataStream ss4(SER_DISK, CLIENT_VERSION);
+    ss4 << cc3 << cc1 << cc3;
+    CCoins cc4, cc5, cc6;
+    ss4 >> cc4 >> cc5 >> cc6;
+    BOOST_CHECK(ss4.empty());
+    BOOST_CHECK_EQUAL(cc4.nTime, 0U);
+    BOOST_CHECK_EQUAL(cc5.nTime, 1500000000U);
+    BOOST_CHECK_EQUAL(cc6.nTime, 0U);
+    BOOST_CHECK_EQUAL(cc6.nHeight, 203998);
+}
+
+BOOST_AUTO_TEST_CASE(disconnect_coins_without_time)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    CMutableTransaction mtx;
+    mtx.nTime = 1500000000;
+    mtx.vin.push_back(CTxIn(GetRandHash(), 0));
+    mtx.vout.push_back(CTxOut(10 * COIN, CScript() << OP_TRUE));
+    mtx.vout.push_back(CTxOut(20 * COIN, CScript() << OP_TRUE));
+    CTransaction tx(mtx);
+
+    // Coins written before the transaction time was stored
+    view.ModifyNewCoins(tx.GetHash(), false)->FromTx(tx, 10);
+    view.ModifyCoins(tx.GetHash())->nTime = 0;
+    {
+        CCoinsModifier outs = view.ModifyCoins(tx.GetHash());
+        BOOST_CHECK(DisconnectedCoinsMatch(*outs, tx, 10));
+        BOOST_CHECK_EQUAL(outs->nTime, 1500000000U);
+    }
+
+    // Coins restored from undo data, which does not carry the time
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.push_back(CTxIn(COutPoint(tx.GetHash(), 1)));
+    mtxSpend.vin.push_back(CTxIn(COutPoint(tx.GetHash(), 0)));
+    mtxSpend.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    CTransaction txSpend(mtxSpend);
+    CTxUndo undo;
+    UpdateCoins(txSpend, view, undo, 20);
+    BOOST_CHECK(view.AccessCoins(tx.GetHash()) == NULL);
+    for (unsigned int j = txSpend.vin.size(); j-- > 0;)
+        BOOST_CHECK(ApplyTxInUndo(undo.vprevout[j], view, txSpend.vin[j].prevout));
+    {
+        CCoinsModifier outs = view.ModifyCoins(tx.GetHash());
+        BOOST_CHECK_EQUAL(outs->nTime, 0U);
+        BOOST_CHECK(DisconnectedCoinsMatch(*outs, tx, 10));
+    }
+
+    // A known time or any output that differs is still a mismatch
+    {
+        CCoinsModifier outs = view.ModifyCoins(tx.GetHash());
+        outs->nTime = 1500000001;
+        BOOST_CHECK(!DisconnectedCoinsMatch(*outs, tx, 10));
+        outs->nTime = 0;
+        outs->vout[1].nValue = 21 * COIN;
+        BOOST_CHECK(!DisconnectedCoinsMatch(*outs, tx, 10));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
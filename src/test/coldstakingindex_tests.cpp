@@ -0,0 +1,138 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coldstakingindex.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "undo.h"
+#include "test/test_navcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coldstakingindex_tests, TestingSetup)
+
+static CScript ColdStakingScript(const uint160& stakingKey, const uint160& spendingKey)
+{
+    return CScript() << OP_COINSTAKE << OP_IF << OP_DUP << OP_HASH160 << ToByteVector(stakingKey) << OP_EQUALVERIFY << OP_CHECKSIG
+                     << OP_ELSE << OP_DUP << OP_HASH160 << ToByteVector(spendingKey) << OP_EQUALVERIFY << OP_CHECKSIG << OP_ENDIF;
+}
+
+static std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > ReadIndex(CBlockTreeDB& db, const uint160& stakingKey)
+{
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > vIndex;
+    BOOST_CHECK(db.ReadColdStakingIndex(stakingKey, vIndex));
+    return vIndex;
+}
+
+static CTransaction Spend(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(cold_staking_index_connect_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > vIndex;
+
+    uint160 stakingKey = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"));
+    uint160 spendingKey = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d36"));
+    uint160 otherKey = uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d37"));
+
+    // Two outputs delegated to stakingKey, one to another staking key and a plain one, confirmed at height 10
+    CMutableTransaction mtx;
+    mtx.vin.push_back(CTxIn(GetRandHash(), 0));
+    mtx.vout.push_back(CTxOut(10 * COIN, ColdStakingScript(stakingKey, spendingKey)));
+    mtx.vout.push_back(CTxOut(20 * COIN, ColdStakingScript(stakingKey, spendingKey)));
+    mtx.vout.push_back(CTxOut(30 * COIN, ColdStakingScript(otherKey, spendingKey)));
+    mtx.vout.push_back(CTxOut(40 * COIN, CScript() << OP_TRUE));
+    CTransaction txDelegate(mtx);
+    view.ModifyNewCoins(txDelegate.GetHash(), false)->FromTx(txDelegate, 10);
+    IndexColdStakingOutputs(txDelegate, 10, false, vIndex);
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+
+    std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > vRead = ReadIndex(db, stakingKey);
+    BOOST_REQUIRE_EQUAL(vRead.size(), 2U);
+    for (unsigned int i = 0; i < vRead.size(); i++) {
+        BOOST_CHECK(vRead[i].first.txhash == txDelegate.GetHash());
+        BOOST_CHECK_EQUAL(vRead[i].first.index, i);
+        BOOST_CHECK_EQUAL(vRead[i].second.satoshis, (i + 1) * 10 * COIN);
+        BOOST_CHECK(vRead[i].second.spendingKey == spendingKey);
+        BOOST_CHECK_EQUAL(vRead[i].second.blockHeight, 10);
+    }
+    BOOST_CHECK_EQUAL(ReadIndex(db, otherKey).size(), 1U);
+
+    // Spend the first output at height 20, the other staking key keeps its output
+    CTransaction txSpend1 = Spend(COutPoint(txDelegate.GetHash(), 0));
+    CTxUndo undo1;
+    vIndex.clear();
+    IndexColdStakingSpends(txSpend1, view, vIndex);
+    UpdateCoins(txSpend1, view, undo1, 20);
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+    vRead = ReadIndex(db, stakingKey);
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vRead[0].first.index, 1U);
+    BOOST_CHECK_EQUAL(ReadIndex(db, otherKey).size(), 1U);
+
+    // Spend all that is left of the transaction at height 30. The undo data of
+    // the last input, a cold staking output of stakingKey, carries the height
+    CMutableTransaction mtxSpend2;
+    for (unsigned int i = txDelegate.vout.size() - 1; i > 0; i--)
+        mtxSpend2.vin.push_back(CTxIn(COutPoint(txDelegate.GetHash(), i)));
+    mtxSpend2.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    CTransaction txSpend2(mtxSpend2);
+    CTxUndo undo2;
+    vIndex.clear();
+    IndexColdStakingSpends(txSpend2, view, vIndex);
+    UpdateCoins(txSpend2, view, undo2, 30);
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+    BOOST_CHECK(ReadIndex(db, stakingKey).empty());
+    BOOST_CHECK(ReadIndex(db, otherKey).empty());
+    BOOST_CHECK(view.AccessCoins(txDelegate.GetHash()) == NULL);
+    BOOST_CHECK_EQUAL(undo2.vprevout.back().nHeight, 10U);
+
+    // Disconnecting the last spend restores the outputs at the height of the
+    // undo data, for its last input, and of the coins restored from it, for the others
+    vIndex.clear();
+    for (unsigned int j = txSpend2.vin.size(); j-- > 0;) {
+        BOOST_CHECK(ApplyTxInUndo(undo2.vprevout[j], view, txSpend2.vin[j].prevout));
+        IndexColdStakingUndo(undo2.vprevout[j], txSpend2.vin[j].prevout, view, vIndex);
+    }
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+    vRead = ReadIndex(db, stakingKey);
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vRead[0].first.index, 1U);
+    BOOST_CHECK_EQUAL(vRead[0].second.satoshis, 20 * COIN);
+    BOOST_CHECK(vRead[0].second.spendingKey == spendingKey);
+    BOOST_CHECK_EQUAL(vRead[0].second.blockHeight, 10);
+    vRead = ReadIndex(db, otherKey);
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vRead[0].second.blockHeight, 10);
+
+    // Disconnecting the first spend, whose undo data has no height
+    BOOST_CHECK_EQUAL(undo1.vprevout[0].nHeight, 0U);
+    vIndex.clear();
+    BOOST_CHECK(ApplyTxInUndo(undo1.vprevout[0], view, txSpend1.vin[0].prevout));
+    IndexColdStakingUndo(undo1.vprevout[0], txSpend1.vin[0].prevout, view, vIndex);
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+    vRead = ReadIndex(db, stakingKey);
+    BOOST_REQUIRE_EQUAL(vRead.size(), 2U);
+    BOOST_CHECK_EQUAL(vRead[0].first.index, 0U);
+    BOOST_CHECK_EQUAL(vRead[0].second.blockHeight, 10);
+
+    // Disconnecting the delegation removes its outputs
+    vIndex.clear();
+    IndexColdStakingOutputs(txDelegate, 10, true, vIndex);
+    BOOST_CHECK(db.UpdateColdStakingIndex(vIndex));
+    BOOST_CHECK(ReadIndex(db, stakingKey).empty());
+    BOOST_CHECK(ReadIndex(db, otherKey).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "hash.h"
+#include "hashblock.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_navcoin.h"
 
@@ -124,4 +128,34 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(x13_batch)
+{
+    const CBlock& genesis = Params(CBaseChainParams::MAIN).GenesisBlock();
+    BOOST_CHECK_EQUAL(genesis.GetPoWHash().GetHex(), "00006a4e3e18c71c6d48ad6c261e2254fa764cf29607a4357c99b712dfbb8e6a");
+
+    // Mix of legacy X13 and SHA256d headers, more than a batch worth
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.push_back(genesis.GetBlockHeader());
+    for (int i = 0; i < 3 * (int)X13_BATCH_SIZE + 3; i++) {
+        CBlockHeader header;
+        header.nVersion = i % 5 == 0 ? 7 : 6;
+        header.hashPrevBlock = GetRandHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = insecure_rand();
+        header.nBits = insecure_rand();
+        header.nNonce = insecure_rand();
+        vHeaders.push_back(header);
+    }
+
+    std::vector<uint256> vHashes;
+    GetBlockHeaderHashes(vHeaders, vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), vHeaders.size());
+    for (unsigned int i = 0; i < vHeaders.size(); i++)
+        BOOST_CHECK(vHashes[i] == vHeaders[i].GetHash());
+
+    // Empty input
+    std::vector<unsigned char> vEmpty;
+    BOOST_CHECK(Hash9(vEmpty.begin(), vEmpty.end()) == HashX13(NULL, 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
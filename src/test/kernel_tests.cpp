@@ -0,0 +1,219 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+#include "pos.h"
+#include "random.h"
+#include "test/test_navcoin.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+static void CheckAgainstReference(unsigned int nBits)
+{
+    uint256 hashTip = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashTip;
+    indexPrev.nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+
+    std::vector<CStakeKernelInput> vInputs;
+    std::vector<CTransaction> vTxPrev;
+    for (int i = 0; i < 64; i++) {
+        CMutableTransaction txPrev;
+        txPrev.nTime = 1500000000 + i;
+        txPrev.vout.resize(i % 3 + 1);
+        txPrev.vout.back().nValue = (GetRand(100000) + 1) * COIN;
+        vTxPrev.push_back(CTransaction(txPrev));
+        vInputs.push_back(CStakeKernelInput(COutPoint(vTxPrev.back().GetHash(), txPrev.vout.size() - 1),
+                                            txPrev.nTime + 30, txPrev.nTime, txPrev.vout.back().nValue));
+    }
+
+    CStakeKernelSearch search;
+    search.SetTip(&indexPrev, nBits);
+    search.SetInputs(vInputs);
+
+    const unsigned int nTimeStart = 1500000000 + Params().GetConsensus().nStakeMinAge;
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        CBlockIndex indexFrom;
+        indexFrom.nTime = vInputs[i].nTimeBlockFrom;
+        for (unsigned int nTimeTx = nTimeStart; nTimeTx < nTimeStart + 1024; nTimeTx += STAKE_TIMESTAMP_MASK + 1) {
+            arith_uint256 hashProofOfStake, targetProofOfStake;
+            bool fExpected = CheckStakeKernelHash(&indexPrev, nBits, indexFrom, vTxPrev[i], vInputs[i].prevout, nTimeTx, hashProofOfStake, targetProofOfStake);
+
+            uint256 hash;
+            BOOST_CHECK_EQUAL(search.CheckKernel(i, nTimeTx, &hash), fExpected);
+            if (vInputs[i].nTimeBlockFrom + Params().GetConsensus().nStakeMinAge <= nTimeTx)
+                BOOST_CHECK(UintToArith256(hash) == hashProofOfStake);
+        }
+    }
+
+    // The search returns the first candidate with a valid kernel
+    std::vector<unsigned int> vTimes;
+    vTimes.push_back(nTimeStart + 512);
+    size_t nExpected = vInputs.size();
+    for (size_t i = 0; i < vInputs.size() && nExpected == vInputs.size(); i++)
+        if (search.CheckKernel(i, vTimes[0]))
+            nExpected = i;
+
+    size_t nIndex;
+    unsigned int nTime;
+    BOOST_CHECK_EQUAL(search.Search(vTimes, nIndex, nTime), nExpected != vInputs.size());
+    if (nExpected != vInputs.size()) {
+        BOOST_CHECK_EQUAL(nIndex, nExpected);
+        BOOST_CHECK_EQUAL(nTime, vTimes[0]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_matches_reference)
+{
+    CheckAgainstReference(0x1d00ffff);
+    CheckAgainstReference(0x1e00ffff);
+    CheckAgainstReference(0x1f00ffff);
+    CheckAgainstReference(0x207fffff);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_tip_change)
+{
+    uint256 hashTip = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashTip;
+    indexPrev.nStakeModifier = 1;
+
+    std::vector<CStakeKernelInput> vInputs;
+    vInputs.push_back(CStakeKernelInput(COutPoint(GetRandHash(), 0), 1500000000, 1500000000, 1000 * COIN));
+
+    CStakeKernelSearch search;
+    search.SetTip(&indexPrev, 0x1e00ffff);
+    search.SetInputs(vInputs);
+    BOOST_CHECK_EQUAL(search.GetInputs().size(), 1U);
+
+    // A new tip invalidates the precomputed kernels
+    uint256 hashNewTip = GetRandHash();
+    CBlockIndex indexNew;
+    indexNew.phashBlock = &hashNewTip;
+    indexNew.nStakeModifier = 2;
+    search.SetTip(&indexNew, 0x1e00ffff);
+    BOOST_CHECK(search.GetInputs().empty());
+}
+
+BOOST_AUTO_TEST_CASE(stake_check_matches_reference)
+{
+    uint256 hashTip = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashTip;
+    indexPrev.nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+
+    CScript scriptColdStaking = CScript() << OP_COINSTAKE << OP_IF << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG
+                                  << OP_ELSE << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG << OP_ENDIF;
+    BOOST_CHECK(scriptColdStaking.IsColdStaking());
+    CScript scriptOther = CScript() << OP_TRUE;
+
+    const unsigned int nTimeTx = 1500000000 + Params().GetConsensus().nStakeMinAge + 64;
+    for (int i = 0; i < 32; i++) {
+        bool fColdStaking = i % 4 == 0;
+        CMutableTransaction txPrev;
+        txPrev.nTime = 1500000000 + i;
+        txPrev.vout.resize(1);
+        txPrev.vout[0].nValue = (GetRand(100000) + 1) * COIN;
+        txPrev.vout[0].scriptPubKey = fColdStaking ? scriptColdStaking : scriptOther;
+        CTransaction txPrevConst(txPrev);
+
+        CBlockIndex indexFrom;
+        indexFrom.nTime = txPrev.nTime + 30;
+
+        // Coinstakes of cold staking coins may only pay back to the same script
+        CMutableTransaction txStake;
+        txStake.nTime = nTimeTx;
+        txStake.vin.push_back(CTxIn(txPrevConst.GetHash(), 0));
+        txStake.vout.resize(3);
+        txStake.vout[1].scriptPubKey = i % 8 == 0 ? scriptOther : txPrev.vout[0].scriptPubKey;
+        CTransaction txStakeConst(txStake);
+
+        unsigned int nBits = i % 2 ? 0x1e00ffff : 0x207fffff;
+        arith_uint256 hashProofOfStake, targetProofOfStake;
+        bool fExpected = CheckStakeKernelHash(&indexPrev, nBits, indexFrom, txPrevConst, txStakeConst.vin[0].prevout, nTimeTx, hashProofOfStake, targetProofOfStake);
+        if (fColdStaking && i % 8 == 0)
+            fExpected = false;
+
+        // The check runs the same way on its own and through the script check queue
+        CStakeCheck check(&indexPrev, nBits, indexFrom.GetBlockTime(), txPrev.nTime, txPrev.vout[0], txStakeConst);
+        CScriptCheck scriptCheck(&check);
+        CScriptCheck queued;
+        queued.swap(scriptCheck);
+        BOOST_CHECK_EQUAL(queued(), fExpected);
+        BOOST_CHECK_EQUAL(check.HasFailed(), !fExpected);
+        if (!(fColdStaking && i % 8 == 0))
+            BOOST_CHECK(check.GetHashProofOfStake() == hashProofOfStake);
+    }
+}
+
+static void CheckWindowAgainstWalk(CStakeModifierWindow& window, const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart)
+{
+    std::vector<std::pair<int64_t, uint256> > vExpected;
+    const CBlockIndex* pindex = pindexPrev;
+    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart) {
+        vExpected.push_back(std::make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
+        pindex = pindex->pprev;
+    }
+    int nHeightExpected = pindex ? (pindex->nHeight + 1) : 0;
+    std::sort(vExpected.begin(), vExpected.end());
+
+    std::vector<CStakeModifierCandidate*> vCandidates;
+    int nHeightFirstCandidate = -1;
+    window.GetCandidates(pindexPrev, nSelectionIntervalStart, vCandidates, nHeightFirstCandidate);
+    BOOST_CHECK_EQUAL(nHeightFirstCandidate, nHeightExpected);
+    BOOST_REQUIRE_EQUAL(vCandidates.size(), vExpected.size());
+    for (unsigned int i = 0; i < vCandidates.size(); i++) {
+        BOOST_CHECK_EQUAL(vCandidates[i]->nTime, vExpected[i].first);
+        BOOST_CHECK(vCandidates[i]->pindex->GetBlockHash() == vExpected[i].second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_window_matches_walk)
+{
+    // A main chain and a fork from height 150, with timestamps out of order
+    std::vector<uint256> vHashes(300);
+    std::vector<CBlockIndex> vIndex(300);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        bool fFork = i >= 200;
+        int nHeight = fFork ? 150 + (i - 200) + 1 : i;
+        vHashes[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = nHeight;
+        vIndex[i].nTime = 1500000000 + nHeight * 30 + GetRand(90);
+        vIndex[i].pprev = nHeight == 0 ? NULL : (fFork && i == 200 ? &vIndex[150] : &vIndex[i - 1]);
+        vIndex[i].BuildSkip();
+    }
+
+    CStakeModifierWindow window;
+    const int64_t nInterval = 600;
+    for (unsigned int i = 0; i < 200; i++)
+        CheckWindowAgainstWalk(window, &vIndex[i], vIndex[i].GetBlockTime() - nInterval);
+
+    // Reorganize to the fork, and back to the main chain
+    for (unsigned int i = 200; i < vIndex.size(); i++)
+        CheckWindowAgainstWalk(window, &vIndex[i], vIndex[i].GetBlockTime() - nInterval);
+    CheckWindowAgainstWalk(window, &vIndex[199], vIndex[199].GetBlockTime() - nInterval);
+
+    // A wider interval reaches back past the start of the window
+    CheckWindowAgainstWalk(window, &vIndex[199], vIndex[199].GetBlockTime() - 100 * nInterval);
+    CheckWindowAgainstWalk(window, &vIndex[120], vIndex[120].GetBlockTime() - nInterval);
+
+    // The selection hash does not depend on the order it is computed in
+    std::vector<CStakeModifierCandidate*> vCandidates;
+    int nHeightFirstCandidate;
+    window.GetCandidates(&vIndex[199], vIndex[199].GetBlockTime() - nInterval, vCandidates, nHeightFirstCandidate);
+    BOOST_REQUIRE(!vCandidates.empty());
+    uint256 hashFirst = vCandidates[0]->GetSelectionHash(1);
+    vCandidates[0]->GetSelectionHash(2);
+    BOOST_CHECK(vCandidates[0]->GetSelectionHash(1) == hashFirst);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,54 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ntpclient.h"
+#include "test/test_navcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(ntpclient_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(ntp_offset_estimation)
+{
+    std::vector<CNtpSample> vSamples;
+    int64_t nOffset = 0, nError = 0;
+
+    // Not enough measures
+    BOOST_CHECK(!EstimateNtpOffset(vSamples, 3, nOffset, nError));
+    vSamples.push_back(CNtpSample("a", 2000000, 40000));
+    vSamples.push_back(CNtpSample("b", 2010000, 20000));
+    BOOST_CHECK(!EstimateNtpOffset(vSamples, 3, nOffset, nError));
+
+    // The median of the measures, the error covers their round trips
+    vSamples.push_back(CNtpSample("c", 1990000, 60000));
+    BOOST_CHECK(EstimateNtpOffset(vSamples, 3, nOffset, nError));
+    BOOST_CHECK_EQUAL(nOffset, 2000000);
+    BOOST_CHECK_EQUAL(nError, 40000);
+    for (unsigned int i = 0; i < vSamples.size(); i++)
+        BOOST_CHECK(vSamples[i].fUsed);
+
+    // A server far off the others is rejected and does not move the offset
+    vSamples.push_back(CNtpSample("d", -3600000000LL, 30000));
+    vSamples.push_back(CNtpSample("e", 2005000, 10000));
+    BOOST_CHECK(EstimateNtpOffset(vSamples, 3, nOffset, nError));
+    BOOST_CHECK(!vSamples[3].fUsed);
+    BOOST_CHECK_EQUAL(nOffset, (2000000 + 2005000) / 2);
+    BOOST_CHECK(nError < 100000);
+
+    // Rejected measures do not count for the minimum
+    BOOST_CHECK(!EstimateNtpOffset(vSamples, 5, nOffset, nError));
+
+    // Measures with a long round trip are less likely to be outliers
+    vSamples.clear();
+    vSamples.push_back(CNtpSample("a", 0, 10000));
+    vSamples.push_back(CNtpSample("b", 10000, 10000));
+    vSamples.push_back(CNtpSample("c", 20000, 10000));
+    vSamples.push_back(CNtpSample("d", 1500000, 10000));
+    vSamples.push_back(CNtpSample("e", 1500000, 2500000));
+    BOOST_CHECK(EstimateNtpOffset(vSamples, 3, nOffset, nError));
+    BOOST_CHECK(!vSamples[3].fUsed);
+    BOOST_CHECK(vSamples[4].fUsed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
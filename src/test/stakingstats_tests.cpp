@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakingstats.h"
+
+#include "chain.h"
+#include "pos.h"
+#include "test/test_navcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakingstats_tests, BasicTestingSetup)
+
+static CStakingRound MakeRound(int64_t nSlot, uint32_t nInputs, int64_t nCheckKernel)
+{
+    CStakingRound round;
+    round.nSlot = nSlot;
+    round.nInputs = nInputs;
+    round.nCheckKernel = nCheckKernel;
+    return round;
+}
+
+BOOST_AUTO_TEST_CASE(staking_slot_coverage)
+{
+    const int64_t nSlot = STAKE_TIMESTAMP_MASK + 1;
+    CStakingStats stats(3);
+
+    stats.AddRound(MakeRound(100 * nSlot, 10, 1000));
+    stats.AddRound(MakeRound(101 * nSlot, 10, 3000));
+    // Two slots skipped
+    stats.AddRound(MakeRound(104 * nSlot, 12, 2000));
+
+    CStakingSummary summary = stats.GetSummary();
+    BOOST_CHECK_EQUAL(summary.nRounds, 3U);
+    BOOST_CHECK_EQUAL(summary.nSlotsMissed, 2U);
+    BOOST_CHECK_EQUAL(summary.nInputs, 32U);
+    BOOST_CHECK_EQUAL(summary.checkKernel.nCount, 3U);
+    BOOST_CHECK_EQUAL(summary.checkKernel.nMax, 3000);
+    BOOST_CHECK_EQUAL(summary.checkKernel.GetAverage(), 2000);
+    // Steps which did not run are not timed
+    BOOST_CHECK_EQUAL(summary.createNewBlock.nCount, 0U);
+
+    // A pause is not a miss
+    stats.Pause();
+    stats.AddRound(MakeRound(200 * nSlot, 12, 2000));
+    summary = stats.GetSummary();
+    BOOST_CHECK_EQUAL(summary.nRounds, 4U);
+    BOOST_CHECK_EQUAL(summary.nSlotsMissed, 2U);
+
+    // Only the last rounds are kept
+    std::vector<CStakingRound> vRounds = stats.GetRounds(10);
+    BOOST_CHECK_EQUAL(vRounds.size(), 3U);
+    BOOST_CHECK_EQUAL(vRounds.front().nSlot, 101 * nSlot);
+    BOOST_CHECK_EQUAL(vRounds.back().nSlot, 200 * nSlot);
+    BOOST_CHECK_EQUAL(stats.GetRounds(1).size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(staking_orphaned_stakes)
+{
+    // A chain of 10 blocks and a fork of 5 blocks from height 5
+    std::vector<uint256> vHashes(15);
+    std::vector<CBlockIndex> vBlocks(15);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vHashes[i] = ArithToUint256(arith_uint256(i + 1));
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].nHeight = i < 10 ? i : i - 5;
+        vBlocks[i].pprev = i == 0 ? NULL : i == 10 ? &vBlocks[4] : &vBlocks[i - 1];
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocks[9]);
+
+    CStakingStats stats;
+    stats.AddStake(&vBlocks[2]);
+    stats.AddStake(&vBlocks[6]);
+    stats.AddStake(&vBlocks[9]);
+    stats.AddStake(&vBlocks[9]);
+    BOOST_CHECK_EQUAL(stats.GetSummary().nAccepted, 3U);
+
+    // The stakes 5 blocks deep are safe
+    stats.UpdateStakes(chain, 5);
+    CStakingSummary summary = stats.GetSummary();
+    BOOST_CHECK_EQUAL(summary.nOrphaned, 0U);
+    BOOST_CHECK_EQUAL(summary.nPending, 2U);
+
+    // A reorg to a shorter fork keeps the stake above it pending
+    chain.SetTip(&vBlocks[11]);
+    stats.UpdateStakes(chain, 5);
+    summary = stats.GetSummary();
+    BOOST_CHECK_EQUAL(summary.nOrphaned, 1U);
+    BOOST_CHECK_EQUAL(summary.nPending, 1U);
+
+    // Until the fork reaches its height
+    chain.SetTip(&vBlocks[14]);
+    stats.UpdateStakes(chain, 5);
+    summary = stats.GetSummary();
+    BOOST_CHECK_EQUAL(summary.nOrphaned, 2U);
+    BOOST_CHECK_EQUAL(summary.nPending, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
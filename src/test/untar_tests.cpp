@@ -0,0 +1,238 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/navcoin-config.h"
+#endif
+
+#include "untar.h"
+
+#include "crypto/sha256.h"
+#include "random.h"
+#include "test/test_navcoin.h"
+#include "utilstrencodings.h"
+
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+BOOST_FIXTURE_TEST_SUITE(untar_tests, BasicTestingSetup)
+
+static void AppendEntry(std::string& archive, const std::string& name, char type, const std::string& data)
+{
+    char header[512];
+    memset(header, 0, sizeof(header));
+    strncpy(header, name.c_str(), 100);
+    snprintf(header + 100, 8, "%07o", 0644);
+    snprintf(header + 124, 12, "%011o", (unsigned int)data.size());
+    header[156] = type;
+    memset(header + 148, ' ', 8);
+    unsigned int nChecksum = 0;
+    for (int i = 0; i < 512; i++)
+        nChecksum += (unsigned char)header[i];
+    snprintf(header + 148, 8, "%06o", nChecksum);
+
+    archive.append(header, sizeof(header));
+    archive.append(data);
+    archive.append((512 - data.size() % 512) % 512, '\0');
+}
+
+static std::string RandomData(size_t nSize)
+{
+    std::string data(nSize, '\0');
+    for (size_t i = 0; i < nSize; i++)
+        data[i] = (char)insecure_rand();
+    return data;
+}
+
+static std::string ReadFile(const boost::filesystem::path& path)
+{
+    boost::filesystem::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+struct TestArchive
+{
+    std::string archive;
+    std::vector<std::pair<std::string, std::string> > vFiles;
+
+    TestArchive()
+    {
+        vFiles.push_back(std::make_pair("blocks/blk00000.dat", RandomData(100000)));
+        vFiles.push_back(std::make_pair("blocks/index/CURRENT", std::string("MANIFEST-000002\n")));
+        vFiles.push_back(std::make_pair("chainstate/000003.ldb", RandomData(1024)));
+        vFiles.push_back(std::make_pair("chainstate/LOCK", std::string()));
+
+        AppendEntry(archive, "blocks/", '5', "");
+        for (unsigned int i = 0; i < vFiles.size(); i++)
+            AppendEntry(archive, vFiles[i].first, '0', vFiles[i].second);
+        AppendEntry(archive, "wallet.dat", '0', "wallet");
+        archive.append(1024, '\0');
+        // Padding up to the record size is ignored
+        archive.append(4096, '\0');
+    }
+
+    void Check(const boost::filesystem::path& path) const
+    {
+        for (unsigned int i = 0; i < vFiles.size(); i++) {
+            BOOST_CHECK(boost::filesystem::exists(path / vFiles[i].first));
+            BOOST_CHECK(ReadFile(path / vFiles[i].first) == vFiles[i].second);
+        }
+        BOOST_CHECK(!boost::filesystem::exists(path / "wallet.dat"));
+    }
+};
+
+static boost::filesystem::path CreateTempDir()
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_navcoin_untar_%%%%-%%%%");
+    boost::filesystem::create_directories(path);
+    return path;
+}
+
+static bool WriteInChunks(CBootstrapStream& stream, const std::string& data)
+{
+    size_t nPos = 0;
+    while (nPos < data.size()) {
+        size_t nChunk = std::min(data.size() - nPos, (size_t)(insecure_rand() % 3000 + 1));
+        if (!stream.Write(data.data() + nPos, nChunk))
+            return false;
+        nPos += nChunk;
+    }
+    return true;
+}
+
+static std::string SHA256Hex(const std::string& data)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)data.data(), data.size()).Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+BOOST_AUTO_TEST_CASE(tar_extract_in_chunks)
+{
+    TestArchive test;
+    for (int i = 0; i < 4; i++) {
+        boost::filesystem::path path = CreateTempDir();
+        {
+            CBootstrapStream stream(path);
+            BOOST_CHECK(WriteInChunks(stream, test.archive));
+            BOOST_CHECK(stream.IsFinished());
+            BOOST_CHECK_EQUAL(stream.GetSize(), test.archive.size());
+            BOOST_CHECK_EQUAL(stream.GetSHA256(), SHA256Hex(test.archive));
+        }
+        test.Check(path);
+        boost::filesystem::remove_all(path);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tar_extract_failures)
+{
+    TestArchive test;
+    boost::filesystem::path path = CreateTempDir();
+
+    // A truncated archive is never finished
+    {
+        CTarExtractor extractor(path);
+        BOOST_CHECK(extractor.Write(test.archive.data(), 1000));
+        BOOST_CHECK(!extractor.IsFinished());
+    }
+
+    // A corrupted header fails the extraction
+    {
+        std::string archive = test.archive;
+        archive[0] ^= 1;
+        CBootstrapStream stream(path);
+        BOOST_CHECK(!WriteInChunks(stream, archive));
+        BOOST_CHECK(stream.HasFailed());
+        BOOST_CHECK(!stream.IsFinished());
+    }
+
+    // Entries which would end up outside of the destination are refused
+    const char *vNames[] = {"/tmp/blk00000.dat", "../blk00000.dat", "blocks/../../blk00000.dat", "blocks\\..\\..\\x", "C:x"};
+    for (unsigned int i = 0; i < sizeof(vNames) / sizeof(vNames[0]); i++) {
+        std::string archive;
+        AppendEntry(archive, vNames[i], '0', "data");
+        archive.append(1024, '\0');
+        CBootstrapStream stream(path / "dest");
+        BOOST_CHECK(!stream.Write(archive.data(), archive.size()));
+        BOOST_CHECK(!stream.Finish());
+    }
+    BOOST_CHECK(!boost::filesystem::exists(path / "blk00000.dat"));
+    boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(tar_extract_normalizes_names)
+{
+    std::string archive;
+    AppendEntry(archive, "./", '5', "");
+    AppendEntry(archive, "./blocks/", '5', "");
+    AppendEntry(archive, ".//blocks/./blk00000.dat", '0', "block");
+    AppendEntry(archive, "./wallet.dat", '0', "wallet");
+    AppendEntry(archive, "././wallet.dat", '0', "wallet");
+    archive.append(1024, '\0');
+
+    boost::filesystem::path path = CreateTempDir();
+    {
+        CBootstrapStream stream(path);
+        BOOST_CHECK(stream.Write(archive.data(), archive.size()));
+        BOOST_CHECK(stream.Finish());
+    }
+    BOOST_CHECK(ReadFile(path / "blocks" / "blk00000.dat") == "block");
+    BOOST_CHECK(!boost::filesystem::exists(path / "wallet.dat"));
+    boost::filesystem::remove_all(path);
+}
+
+#if HAVE_ZLIB
+BOOST_AUTO_TEST_CASE(tar_extract_gzip)
+{
+    TestArchive test;
+    // The last file inflates to far more than a single output buffer
+    test.archive.resize(test.archive.size() - 5120);
+    test.vFiles.push_back(std::make_pair("chainstate/000004.ldb", std::string(1000000, 'x')));
+    AppendEntry(test.archive, test.vFiles.back().first, '0', test.vFiles.back().second);
+    test.archive.append(1024, '\0');
+
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    BOOST_REQUIRE(deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string compressed(deflateBound(&zstream, test.archive.size()), '\0');
+    zstream.next_in = (Bytef*)test.archive.data();
+    zstream.avail_in = test.archive.size();
+    zstream.next_out = (Bytef*)&compressed[0];
+    zstream.avail_out = compressed.size();
+    BOOST_REQUIRE(deflate(&zstream, Z_FINISH) == Z_STREAM_END);
+    compressed.resize(zstream.total_out);
+    deflateEnd(&zstream);
+
+    boost::filesystem::path path = CreateTempDir();
+    {
+        CBootstrapStream stream(path);
+        BOOST_CHECK(WriteInChunks(stream, compressed));
+        BOOST_CHECK(stream.Finish());
+        BOOST_CHECK_EQUAL(stream.GetSHA256(), SHA256Hex(compressed));
+    }
+    test.Check(path);
+    boost::filesystem::remove_all(path);
+
+    // A last chunk which inflates to many output buffers is extracted completely
+    path = CreateTempDir();
+    {
+        CBootstrapStream stream(path);
+        size_t nHead = compressed.size() / 2;
+        BOOST_CHECK(stream.Write(compressed.data(), nHead));
+        BOOST_CHECK(stream.Write(compressed.data() + nHead, compressed.size() - nHead));
+        BOOST_CHECK(stream.Finish());
+    }
+    test.Check(path);
+    boost::filesystem::remove_all(path);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
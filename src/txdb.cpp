@@ -21,12 +21,16 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_PROPINDEX = 'o';
 static const char DB_PREQINDEX = 'r';
+static const char DB_CFUND_VOTES = 'V';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'w';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'q';
+static const char DB_COLDSTAKINGINDEX = 'k';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_BLOCK_VOTES = 'v';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
@@ -142,7 +146,10 @@ void CCoinsViewDBCursor::Next()
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                                  const std::vector<std::pair<uint256, CFund::CProposal> >& proposals,
+                                  const std::vector<std::pair<uint256, CFund::CPaymentRequest> >& prequests,
+                                  const CFund::CVoteTally* pvoteTally) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_FILES, it->first), *it->second);
@@ -151,7 +158,104 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
-    return WriteBatch(batch, true);
+    // Votes are not part of the block index records, so they are written
+    // as staged without reading anything back
+    LOCK(cs_votes);
+    for (std::map<uint256, CBlockVotes>::const_iterator it=mapPendingVotes.begin(); it != mapPendingVotes.end(); it++) {
+        batch.Write(make_pair(DB_BLOCK_VOTES, it->first), it->second);
+    }
+    for (std::vector<std::pair<uint256,CFund::CProposal> >::const_iterator it=proposals.begin(); it!=proposals.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_PROPINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_PROPINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<uint256,CFund::CPaymentRequest> >::const_iterator it=prequests.begin(); it!=prequests.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_PREQINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_PREQINDEX, it->first), it->second);
+        }
+    }
+    if (pvoteTally)
+        batch.Write(DB_CFUND_VOTES, *pvoteTally);
+    if (!WriteBatch(batch, true))
+        return false;
+
+    for (std::map<uint256, CBlockVotes>::const_iterator it=mapPendingVotes.begin(); it != mapPendingVotes.end(); it++) {
+        CacheBlockVotes(it->first, it->second);
+    }
+    mapPendingVotes.clear();
+    return true;
+}
+
+void CBlockTreeDB::CacheBlockVotes(const uint256 &hash, const CBlockVotes &votes) {
+    AssertLockHeld(cs_votes);
+    std::map<uint256, std::list<std::pair<uint256, CBlockVotes> >::iterator>::iterator mi = mapCachedVotes.find(hash);
+    if (mi != mapCachedVotes.end())
+        lruVotes.erase(mi->second);
+    lruVotes.push_front(std::make_pair(hash, votes));
+    mapCachedVotes[hash] = lruVotes.begin();
+    while (lruVotes.size() > nMaxCachedVotes) {
+        mapCachedVotes.erase(lruVotes.back().first);
+        lruVotes.pop_back();
+    }
+}
+
+void CBlockTreeDB::WriteBlockVotes(const uint256 &hash, const CBlockVotes &votes) {
+    LOCK(cs_votes);
+    mapPendingVotes[hash] = votes;
+}
+
+bool CBlockTreeDB::ReadBlockVotes(const uint256 &hash, CBlockVotes &votes) {
+    LOCK(cs_votes);
+    std::map<uint256, CBlockVotes>::const_iterator pi = mapPendingVotes.find(hash);
+    if (pi != mapPendingVotes.end()) {
+        votes = pi->second;
+        return true;
+    }
+
+    std::map<uint256, std::list<std::pair<uint256, CBlockVotes> >::iterator>::iterator mi = mapCachedVotes.find(hash);
+    if (mi != mapCachedVotes.end()) {
+        lruVotes.splice(lruVotes.begin(), lruVotes, mi->second);
+        votes = mi->second->second;
+        return true;
+    }
+
+    if (!Read(make_pair(DB_BLOCK_VOTES, hash), votes)) {
+        votes.SetNull();
+        return false;
+    }
+    CacheBlockVotes(hash, votes);
+    return true;
+}
+
+bool CBlockTreeDB::BuildBlockVotesIndex() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBBatch> pbatch(new CDBBatch(*this));
+    unsigned int nBlocks = 0;
+
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+            break;
+        CDiskBlockIndex diskindex;
+        diskindex.fLegacyVotes = true;
+        if (!pcursor->GetValue(diskindex))
+            return error("%s: failed to read block index %s", __func__, key.second.ToString());
+        pbatch->Write(make_pair(DB_BLOCK_VOTES, key.second), diskindex.votes);
+        if (++nBlocks % 10000 == 0) {
+            if (!WriteBatch(*pbatch))
+                return false;
+            pbatch.reset(new CDBBatch(*this));
+        }
+        pcursor->Next();
+    }
+    LogPrintf("%s: moved the votes of %u blocks\n", __func__, nBlocks);
+    return WriteBatch(*pbatch);
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
@@ -214,6 +318,10 @@ bool CBlockTreeDB::GetProposalIndex(std::vector<CFund::CProposal>&vect) {
     return true;
 }
 
+bool CBlockTreeDB::ReadVoteTally(CFund::CVoteTally& voteTally) {
+    return Read(DB_CFUND_VOTES, voteTally);
+}
+
 bool CBlockTreeDB::ReadPaymentRequestIndex(const uint256 &prequestid, CFund::CPaymentRequest &prequest) {
     return Read(make_pair(DB_PREQINDEX, prequestid), prequest);
 }
@@ -315,10 +423,49 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::UpdateColdStakingIndex(const std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_COLDSTAKINGINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_COLDSTAKINGINDEX, it->first), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadColdStakingIndex(const uint160 &stakingKey,
+                                        std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &vect) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_COLDSTAKINGINDEX, CColdStakingIndexIteratorKey(stakingKey)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CColdStakingIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_COLDSTAKINGINDEX && key.second.stakingKey == stakingKey) {
+            CColdStakingIndexValue nValue;
+            if (pcursor->GetValue(nValue)) {
+                vect.push_back(make_pair(key.second, nValue));
+                pcursor->Next();
+            } else {
+                return error("failed to get cold staking index value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    UpdateAddressBalances(batch, vect, false);
     return WriteBatch(batch);
 }
 
@@ -326,43 +473,235 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    UpdateAddressBalances(batch, vect, true);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+void CBlockTreeDB::UpdateAddressBalances(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase) {
+    std::map<std::pair<unsigned int, uint160>, std::vector<const std::pair<CAddressIndexKey, CAmount>*> > mapEntries;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        mapEntries[std::make_pair(it->first.type, it->first.hashBytes)].push_back(&*it);
+
+    for (std::map<std::pair<unsigned int, uint160>, std::vector<const std::pair<CAddressIndexKey, CAmount>*> >::iterator it=mapEntries.begin(); it!=mapEntries.end(); it++) {
+        const std::pair<unsigned int, uint160> &address = it->first;
+
+        CAddressBalanceValue value;
+        if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)), value))
+            value.SetNull();
+
+        // Blocks are connected again after an unclean shutdown or with -reindex-chainstate. As they
+        // are connected in height order, the totals already include the entries up to lastHeight:
+        // only count the ones above it (or, when erasing, the ones it still includes)
+        CAddressBalanceValue delta;
+        std::set<uint256> setTxs;
+        int nFirstHeight = 0;
+        for (unsigned int i = 0; i < it->second.size(); i++) {
+            const CAddressIndexKey &key = it->second[i]->first;
+            CAmount nAmount = it->second[i]->second;
+            if ((key.blockHeight <= value.lastHeight) != fErase)
+                continue;
+            delta.balance += nAmount;
+            if (nAmount > 0)
+                delta.received += nAmount;
+            delta.lastHeight = std::max(delta.lastHeight, key.blockHeight);
+            if (setTxs.empty() || key.blockHeight < nFirstHeight)
+                nFirstHeight = key.blockHeight;
+            setTxs.insert(key.txhash);
+        }
+        if (setTxs.empty())
+            continue;
+
+        if (fErase) {
+            value.balance -= delta.balance;
+            value.received -= delta.received;
+            value.txCount = value.txCount > setTxs.size() ? value.txCount - setTxs.size() : 0;
+            // The erased entries are still in the database, look for the last one before them
+            value.lastHeight = FindLastAddressIndexHeight(address.second, address.first, nFirstHeight);
+        } else {
+            value.balance += delta.balance;
+            value.received += delta.received;
+            value.txCount += setTxs.size();
+            value.lastHeight = delta.lastHeight;
+        }
+
+        if (value.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)), value);
+        }
+    }
+}
 
+int CBlockTreeDB::FindLastAddressIndexHeight(const uint160 &addressHash, int type, int nBelowHeight) {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
+    // Step back from the first entry at nBelowHeight (or whatever follows it)
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nBelowHeight)));
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+
+    std::pair<char,CAddressIndexKey> key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+        key.second.hashBytes == addressHash && (int)key.second.type == type && key.second.blockHeight < nBelowHeight)
+        return key.second.blockHeight;
+
+    return 0;
+}
+
+bool CBlockTreeDB::ReadAddressBalance(const uint160 &addressHash, int type, CAddressBalanceValue &value) {
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value))
+        value.SetNull();
+    return true;
+}
 
+bool CBlockTreeDB::BuildAddressBalanceIndex() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBBatch> pbatch(new CDBBatch(*this));
+    unsigned int nErased = 0;
+
+    // Erase the existing totals first, those of addresses without entries would survive otherwise
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
     while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        pbatch->Erase(key);
+        if (++nErased % 10000 == 0) {
+            if (!WriteBatch(*pbatch))
+                return false;
+            pbatch.reset(new CDBBatch(*this));
+        }
+        pcursor->Next();
+    }
+    if (!WriteBatch(*pbatch))
+        return false;
+    pbatch.reset(new CDBBatch(*this));
+    unsigned int nAddresses = 0;
+
+    pcursor->Seek(DB_ADDRESSINDEX);
+    std::pair<unsigned int, uint160> address;
+    std::pair<int, unsigned int> lastTx;
+    CAddressBalanceValue value;
+
+    while (true) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+
+        // Write the totals of the previous address once all of its entries are read
+        if (!value.IsNull() && (!fValid || std::make_pair(key.second.type, key.second.hashBytes) != address)) {
+            pbatch->Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)), value);
+            value.SetNull();
+            if (++nAddresses % 10000 == 0) {
+                if (!WriteBatch(*pbatch))
+                    return false;
+                pbatch.reset(new CDBBatch(*this));
             }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
+        }
+        if (!fValid)
             break;
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+
+        // Entries of the same transaction are adjacent
+        std::pair<int, unsigned int> tx(key.second.blockHeight, key.second.txindex);
+        if (value.IsNull() || tx != lastTx)
+            value.txCount++;
+        address = std::make_pair(key.second.type, key.second.hashBytes);
+        lastTx = tx;
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        value.lastHeight = key.second.blockHeight;
+
+        pcursor->Next();
+    }
+
+    LogPrintf("%s: computed the balances of %u addresses\n", __func__, nAddresses);
+    return WriteBatch(*pbatch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    int start, int end) {
+
+    boost::scoped_ptr<CAddressIndexCursor> pcursor(AddressIndexCursor(addressHash, type, start > 0 && end > 0 ? start : 0, end));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        CAddressIndexKey key;
+        CAmount nValue;
+        if (pcursor->GetKey(key) && pcursor->GetValue(nValue)) {
+            addressIndex.push_back(make_pair(key, nValue));
+            pcursor->Next();
+        } else {
+            return error("failed to get address index value");
         }
     }
 
     return true;
 }
 
+CAddressIndexCursor *CBlockTreeDB::AddressIndexCursor(const uint160 &addressHash, int type, int start, int end,
+                                                      const CAddressIndexKey *pkeyAfter) {
+    CAddressIndexCursor *i = new CAddressIndexCursor(NewIterator(), addressHash, type, end);
+
+    if (pkeyAfter) {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pkeyAfter));
+    } else if (start > 0) {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    } else {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+    i->ReadKey();
+
+    // Resume after the given entry
+    if (pkeyAfter && i->Valid() && i->keyTmp.second == *pkeyAfter)
+        i->Next();
+
+    return i;
+}
+
+void CAddressIndexCursor::ReadKey()
+{
+    // Invalidate the cached key past the last entry of the address so that Valid() and GetKey() return false
+    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp) || keyTmp.first != DB_ADDRESSINDEX ||
+        keyTmp.second.hashBytes != addressHash || (int)keyTmp.second.type != type ||
+        (nEnd > 0 && keyTmp.second.blockHeight > nEnd))
+        keyTmp.first = 0;
+}
+
+bool CAddressIndexCursor::GetKey(CAddressIndexKey &key) const
+{
+    // Return cached key
+    if (keyTmp.first == DB_ADDRESSINDEX) {
+        key = keyTmp.second;
+        return true;
+    }
+    return false;
+}
+
+bool CAddressIndexCursor::GetValue(CAmount &nValue) const
+{
+    return pcursor->GetValue(nValue);
+}
+
+bool CAddressIndexCursor::Valid() const
+{
+    return keyTmp.first == DB_ADDRESSINDEX;
+}
+
+void CAddressIndexCursor::Next()
+{
+    pcursor->Next();
+    ReadKey();
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -430,46 +769,61 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    vDiskIndex.reserve(BLOCK_INDEX_LOAD_BATCH);
+    vHeaders.reserve(BLOCK_INDEX_LOAD_BATCH);
+
     // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nMint          = diskindex.nMint;
-                pindexNew->nCFSupply      = diskindex.nCFSupply;
-                pindexNew->vPaymentRequestVotes
-                                          = diskindex.vPaymentRequestVotes;
-                pindexNew->vProposalVotes = diskindex.vProposalVotes;
-                pindexNew->nCFLocked      = diskindex.nCFLocked;
-                pindexNew->strDZeel       = diskindex.strDZeel;
-                pindexNew->nFlags         = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake   = diskindex.prevoutStake;
-                pindexNew->nStakeTime     = diskindex.nStakeTime;
-                pindexNew->hashProof      = diskindex.hashProof;
 
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
+        // Read a batch of entries so their headers can be hashed together
+        vDiskIndex.clear();
+        vHeaders.clear();
+        while (vDiskIndex.size() < BLOCK_INDEX_LOAD_BATCH) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fDone = true;
+                break;
             }
-        } else {
-            break;
+            // Votes are read on demand by ReadBlockVotes
+            vDiskIndex.push_back(CDiskBlockIndex());
+            if (!pcursor->GetValue(vDiskIndex.back()))
+                return error("LoadBlockIndex() : failed to read value");
+            vHeaders.push_back(vDiskIndex.back().GetBlockHeader());
+            pcursor->Next();
+        }
+
+        GetBlockHeaderHashes(vHeaders, vHashes);
+
+        for (unsigned int i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(vHashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nMint          = diskindex.nMint;
+            pindexNew->nCFSupply      = diskindex.nCFSupply;
+            pindexNew->nCFLocked      = diskindex.nCFLocked;
+            pindexNew->nFlags         = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake   = diskindex.prevoutStake;
+            pindexNew->nStakeTime     = diskindex.nStakeTime;
+            pindexNew->hashProof      = diskindex.hashProof;
         }
     }
 
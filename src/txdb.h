@@ -11,10 +11,12 @@
 #include "dbwrapper.h"
 #include "chain.h"
 #include "addressindex.h"
+#include "coldstakingindex.h"
 #include "spentindex.h"
 #include "timestampindex.h"
 
 #include <functional>
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
@@ -23,6 +25,7 @@
 #include <boost/function.hpp>
 
 class CBlockIndex;
+class CAddressIndexCursor;
 class CCoinsViewDBCursor;
 class uint256;
 
@@ -46,6 +49,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Number of block index entries read and hashed together by LoadBlockIndexGuts
+static const unsigned int BLOCK_INDEX_LOAD_BATCH = 1024;
 
 template<typename T, typename M, template<typename> class C = std::less>
 struct member_comparer : std::binary_function<T, T, bool>
@@ -129,6 +134,36 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * Cursor over the address index entries of a single address, in key order
+ * (block height, position in the block). Entries are read one at a time, so
+ * the history of an address never needs to be loaded at once.
+ */
+class CAddressIndexCursor
+{
+public:
+    ~CAddressIndexCursor() {}
+
+    bool GetKey(CAddressIndexKey &key) const;
+    bool GetValue(CAmount &nValue) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CAddressIndexCursor(CDBIterator* pcursorIn, const uint160 &addressHashIn, int typeIn, int endIn):
+        pcursor(pcursorIn), addressHash(addressHashIn), type(typeIn), nEnd(endIn) {}
+    void ReadKey();
+
+    boost::scoped_ptr<CDBIterator> pcursor;
+    uint160 addressHash;
+    int type;
+    int nEnd;
+    std::pair<char, CAddressIndexKey> keyTmp;
+
+    friend class CBlockTreeDB;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -137,8 +172,23 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    void UpdateAddressBalances(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase);
+    int FindLastAddressIndexHeight(const uint160 &addressHash, int type, int nBelowHeight);
+
+    //! Block votes waiting for the next WriteBatchSync, and recently read ones
+    CCriticalSection cs_votes;
+    std::map<uint256, CBlockVotes> mapPendingVotes;
+    std::list<std::pair<uint256, CBlockVotes> > lruVotes;
+    std::map<uint256, std::list<std::pair<uint256, CBlockVotes> >::iterator> mapCachedVotes;
+    void CacheBlockVotes(const uint256 &hash, const CBlockVotes &votes);
 public:
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    //! Number of blocks whose votes are kept in memory after reading them
+    static const size_t nMaxCachedVotes = 2048;
+
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                        const std::vector<std::pair<uint256, CFund::CProposal> >& proposals = std::vector<std::pair<uint256, CFund::CProposal> >(),
+                        const std::vector<std::pair<uint256, CFund::CPaymentRequest> >& prequests = std::vector<std::pair<uint256, CFund::CPaymentRequest> >(),
+                        const CFund::CVoteTally* pvoteTally = NULL);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -150,11 +200,24 @@ public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool UpdateColdStakingIndex(const std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &vect);
+    bool ReadColdStakingIndex(const uint160 &stakingKey,
+                              std::vector<std::pair<CColdStakingIndexKey, CColdStakingIndexValue> > &vect);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressBalance(const uint160 &addressHash, int type, CAddressBalanceValue &value);
+    //! Compute the address balance index from the address index entries, for databases created before it existed
+    bool BuildAddressBalanceIndex();
+    /**
+     * Open a cursor over the address index entries of an address, starting at
+     * height start (or at the first entry when 0) or right after pkeyAfter
+     * when given, and ending after height end (or at the last entry when 0).
+     */
+    CAddressIndexCursor *AddressIndexCursor(const uint160 &addressHash, int type, int start = 0, int end = 0,
+                                            const CAddressIndexKey *pkeyAfter = NULL);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
@@ -162,10 +225,17 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Votes of a block, written by the next WriteBatchSync */
+    void WriteBlockVotes(const uint256 &hash, const CBlockVotes &votes);
+    /** Votes of a block. Returns false, with empty votes, when none were written for it. */
+    bool ReadBlockVotes(const uint256 &hash, CBlockVotes &votes);
+    //! Move the votes out of the block index records, for databases created when they were stored there
+    bool BuildBlockVotesIndex();
     bool ReadProposalIndex(const uint256 &proposalid, CFund::CProposal &proposal);
     bool WriteProposalIndex(const std::vector<std::pair<uint256, CFund::CProposal> >&vect);
     bool GetProposalIndex(std::vector<CFund::CProposal>&vect);
     bool UpdateProposalIndex(const std::vector<std::pair<uint256, CFund::CProposal> >&vect);
+    bool ReadVoteTally(CFund::CVoteTally& voteTally);
     bool ReadPaymentRequestIndex(const uint256 &prequestid, CFund::CPaymentRequest &prequest);
     bool WritePaymentRequestIndex(const std::vector<std::pair<uint256, CFund::CPaymentRequest> >&vect);
     bool GetPaymentRequestIndex(std::vector<CFund::CPaymentRequest>&vect);
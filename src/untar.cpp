@@ -1,18 +1,30 @@
 // Based on original code by Tim Kientzle, March 2009.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/navcoin-config.h"
+#endif
+
+#include "untar.h"
+
 #include "util.h"
+#include "utilstrencodings.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <boost/filesystem.hpp>
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* Parse an octal number, ignoring leading and trailing nonsense. */
-static int
+static int64_t
 parseoct(const char *p, size_t n)
 {
-    int i = 0;
+    int64_t i = 0;
 
     while ((*p < '0' || *p > '7') && n > 0) {
         ++p;
@@ -40,9 +52,9 @@ is_end_of_archive(const char *p)
 
 /* Create a directory, including parent directories as necessary. */
 static void
-create_dir(const char *pathname, int mode)
+create_dir(const boost::filesystem::path& dest, const char *pathname, int mode)
 {
-    std::string sFile = (GetDataDir(true) / pathname).string();
+    std::string sFile = (dest / pathname).string();
     fprintf(stdout, "[UNTAR] Creating folder %s\n", sFile.c_str());
     boost::filesystem::path p = sFile;
     boost::filesystem::create_directories(p);
@@ -50,10 +62,10 @@ create_dir(const char *pathname, int mode)
 
 /* Create a file, including parent directory as necessary. */
 static FILE *
-create_file(char *pathname, int mode)
+create_file(const boost::filesystem::path& dest, char *pathname, int mode)
 {
     FILE *f;
-    std::string sFile = (GetDataDir(true) / pathname).string();
+    std::string sFile = (dest / pathname).string();
     f = fopen(sFile.c_str(), "wb+");
     fprintf(stdout, "[UNTAR] Creating file %s\n", sFile.c_str());
     if (f == NULL) {
@@ -61,7 +73,7 @@ create_file(char *pathname, int mode)
         char *p = strrchr(pathname, '/');
         if (p != NULL) {
             *p = '\0';
-            create_dir(pathname, 0755);
+            create_dir(dest, pathname, 0755);
             *p = '/';
             f = fopen(sFile.c_str(), "wb+");
         }
@@ -69,6 +81,36 @@ create_file(char *pathname, int mode)
     return (f);
 }
 
+/*
+ * Normalise an entry name in place, dropping empty and "." components so that
+ * "./blocks//a" becomes "blocks/a" and "./" becomes empty. Returns false for
+ * absolute names or names with ".." components, as they leave the destination.
+ */
+static bool
+normalize_path(char *pathname)
+{
+    if (pathname[0] == '/' || pathname[0] == '\\' || strchr(pathname, ':') != NULL)
+        return false;
+    const char *p = pathname;
+    char *out = pathname;
+    while (true) {
+        size_t n = strcspn(p, "/\\");
+        if (n == 2 && p[0] == '.' && p[1] == '.')
+            return false;
+        if (n > 0 && !(n == 1 && p[0] == '.')) {
+            if (out != pathname)
+                *out++ = '/';
+            memmove(out, p, n);
+            out += n;
+        }
+        if (p[n] == '\0')
+            break;
+        p += n + 1;
+    }
+    *out = '\0';
+    return true;
+}
+
 /* Verify the tar checksum. */
 static int
 verify_checksum(const char *p)
@@ -85,87 +127,265 @@ verify_checksum(const char *p)
     return (u == parseoct(p + 148, 8));
 }
 
+CTarExtractor::CTarExtractor(const boost::filesystem::path& pathDestIn) :
+    pathDest(pathDestIn), nBuff(0), nFileSize(0), f(NULL), fFinished(false), fFailed(false)
+{
+}
+
+CTarExtractor::~CTarExtractor()
+{
+    CloseFile();
+}
+
+void
+CTarExtractor::CloseFile()
+{
+    if (f != NULL) {
+        fclose(f);
+        f = NULL;
+    }
+}
+
+/* Handle the header block in buff. */
+bool
+CTarExtractor::ProcessHeader()
+{
+    if (is_end_of_archive(buff)) {
+        fFinished = true;
+        return true;
+    }
+    if (!verify_checksum(buff)) {
+        fprintf(stderr, "[UNTAR] Checksum failure\n");
+        return false;
+    }
+    nFileSize = parseoct(buff + 124, 12);
+    /* The name field is not terminated when it is 100 characters long. */
+    char name[101];
+    memcpy(name, buff, 100);
+    name[100] = '\0';
+    /* Only links and special files are skipped, anything else is extracted. */
+    bool fExtract = buff[156] == '5' || buff[156] < '1' || buff[156] > '6';
+    if (fExtract && !normalize_path(name)) {
+        fprintf(stderr, "[UNTAR] Refusing entry %s outside of the destination\n", name);
+        return false;
+    }
+    /* Only the destination itself, as in "./", has an empty name. */
+    if (fExtract && name[0] == '\0' && buff[156] != '5') {
+        fprintf(stderr, "[UNTAR] Refusing file entry without a name\n");
+        return false;
+    }
+    switch (buff[156]) {
+    case '1':
+        // Ignoring hardlink
+        break;
+    case '2':
+        // Ignoring symlink
+        break;
+    case '3':
+        // Ignoring character device
+        break;
+    case '4':
+        // Ignoring block device
+        break;
+    case '5':
+        // Extracting dir
+        if (name[0] != '\0')
+            create_dir(pathDest, name, parseoct(buff + 100, 8));
+        nFileSize = 0;
+        break;
+    case '6':
+        // Ignoring FIFO
+        break;
+    default:
+        // Extracting file
+        if(!strcmp(name, "wallet.dat")) {
+            fprintf(stderr, "[UNTAR] Wrong bootstrap, it includes a wallet.dat file\n");
+        } else {
+            f = create_file(pathDest, name, parseoct(buff + 100, 8));
+        }
+        break;
+    }
+    if (nFileSize == 0)
+        CloseFile();
+    return true;
+}
+
+/* Write data of the current entry, nSize is never more than nFileSize. */
+bool
+CTarExtractor::WriteData(const char *pch, size_t nSize)
+{
+    if (f != NULL) {
+        if (fwrite(pch, 1, nSize, f) != nSize) {
+            fprintf(stderr, "[UNTAR] Failed write\n");
+            CloseFile();
+            return false;
+        }
+    }
+    nFileSize -= nSize;
+    if (nFileSize == 0)
+        CloseFile();
+    return true;
+}
+
+bool
+CTarExtractor::Write(const char *pch, size_t nSize)
+{
+    while (nSize > 0 && !fFinished && !fFailed) {
+        if (nBuff == 0 && nFileSize > 0 && nSize >= 512) {
+            /* Write whole blocks of file data straight from the input. */
+            size_t nBlocks = std::min((uint64_t)nSize / 512, ((uint64_t)nFileSize + 511) / 512);
+            size_t nData = std::min((uint64_t)nBlocks * 512, (uint64_t)nFileSize);
+            if (!WriteData(pch, nData))
+                fFailed = true;
+            pch += nBlocks * 512;
+            nSize -= nBlocks * 512;
+            continue;
+        }
+
+        size_t nCopy = std::min(nSize, sizeof(buff) - nBuff);
+        memcpy(buff + nBuff, pch, nCopy);
+        nBuff += nCopy;
+        pch += nCopy;
+        nSize -= nCopy;
+        if (nBuff < sizeof(buff))
+            break;
+        nBuff = 0;
+
+        if (nFileSize > 0) {
+            if (!WriteData(buff, std::min((int64_t)sizeof(buff), nFileSize)))
+                fFailed = true;
+        } else if (!ProcessHeader()) {
+            fFailed = true;
+        }
+    }
+    return !fFailed;
+}
+
 /* Extract a tar archive. */
 bool
 untar(FILE *a, const char *path)
 {
-    char buff[512];
-    FILE *f = NULL;
+    char buff[65536];
     size_t bytes_read;
-    int filesize;
+    CTarExtractor extractor(GetDataDir(true));
 
     fprintf(stdout, "[UNTAR] Extracting from %s\n", path);
-    for (;;) {
-        bytes_read = fread(buff, 1, 512, a);
-        if (bytes_read < 512) {
-            fprintf(stderr, "[UNTAR] Short read on %s: expected 512, got %d\n",
-                      path, (int)bytes_read);
+    while (!extractor.IsFinished()) {
+        bytes_read = fread(buff, 1, sizeof(buff), a);
+        if (bytes_read == 0) {
+            fprintf(stderr, "[UNTAR] Short read on %s\n", path);
             return false;
         }
-        if (is_end_of_archive(buff)) {
-            return true;
-        }
-        if (!verify_checksum(buff)) {
-            fprintf(stderr, "[UNTAR] Checksum failure\n");
+        if (!extractor.Write(buff, bytes_read))
             return false;
-        }
-        filesize = parseoct(buff + 124, 12);
-        switch (buff[156]) {
-        case '1':
-            // Ignoring hardlink
-            break;
-        case '2':
-            // Ignoring symlink
-            break;
-        case '3':
-            // Ignoring character device
-            break;
-        case '4':
-            // Ignoring block device
-            break;
-        case '5':
-            // Extracting dir
-            create_dir(buff, parseoct(buff + 100, 8));
-            filesize = 0;
-            break;
-        case '6':
-            // Ignoring FIFO
-            break;
-        default:
-            // Extracting file
-            if(!strcmp(buff, "wallet.dat")) {
-                fprintf(stderr, "[UNTAR] Wrong bootstrap, it includes a wallet.dat file\n");
-            } else {
-                f = create_file(buff, parseoct(buff + 100, 8));
-            }
-            break;
-        }
-        while (filesize > 0) {
-            bytes_read = fread(buff, 1, 512, a);
-            if (bytes_read < 512) {
-                fprintf(stderr, "[UNTAR] Short read on %s: Expected 512, got %d\n",
-                          path, (int)bytes_read);
+    }
+    return true;
+}
+
+CBootstrapStream::CBootstrapStream(const boost::filesystem::path& pathDest) :
+    extractor(pathDest), nSize(0), format(FORMAT_UNKNOWN), pzstream(NULL), fFailed(false)
+{
+}
+
+CBootstrapStream::~CBootstrapStream()
+{
+#if HAVE_ZLIB
+    if (pzstream != NULL) {
+        inflateEnd(pzstream);
+        delete pzstream;
+    }
+#endif
+}
+
+bool
+CBootstrapStream::Write(const char *pch, size_t nSizeIn)
+{
+    if (fFailed)
+        return false;
+
+    hasher.Write((const unsigned char*)pch, nSizeIn);
+    nSize += nSizeIn;
+
+    if (format == FORMAT_UNKNOWN) {
+        /* Wait for the magic bytes which tell gzip from a plain tar. */
+        vMagic.insert(vMagic.end(), pch, pch + nSizeIn);
+        if (vMagic.size() < 2)
+            return true;
+        if ((unsigned char)vMagic[0] == 0x1f && (unsigned char)vMagic[1] == 0x8b) {
+#if HAVE_ZLIB
+            pzstream = new z_stream();
+            if (inflateInit2(pzstream, 16 + MAX_WBITS) != Z_OK) {
+                fprintf(stderr, "[UNTAR] Could not initialize zlib\n");
+                delete pzstream;
+                pzstream = NULL;
+                fFailed = true;
                 return false;
             }
-            if (filesize < 512)
-                bytes_read = filesize;
-            if (f != NULL) {
-                if (fwrite(buff, 1, bytes_read, f)
-                        != bytes_read)
-                {
-                    fprintf(stderr, "[UNTAR] Failed write\n");
-                    fclose(f);
-                    f = NULL;
-                    return false;
-                }
-            }
-            filesize -= bytes_read;
-        }
-        if (f != NULL) {
-            fclose(f);
-            f = NULL;
+            format = FORMAT_GZIP;
+#else
+            fprintf(stderr, "[UNTAR] Compressed archives are not supported by this build\n");
+            fFailed = true;
+            return false;
+#endif
+        } else {
+            format = FORMAT_TAR;
         }
+        std::vector<char> vData;
+        vData.swap(vMagic);
+        fFailed = !Extract(&vData[0], vData.size());
+        return !fFailed;
     }
+
+    fFailed = !Extract(pch, nSizeIn);
+    return !fFailed;
+}
+
+bool
+CBootstrapStream::Extract(const char *pch, size_t nSizeIn)
+{
+    if (extractor.IsFinished())
+        return true;
+
+    if (format == FORMAT_TAR)
+        return extractor.Write(pch, nSizeIn);
+
+#if HAVE_ZLIB
+    char buff[65536];
+    pzstream->next_in = (Bytef*)pch;
+    pzstream->avail_in = nSizeIn;
+    /* A full output buffer may leave output behind even when all the input is consumed. */
+    do {
+        pzstream->next_out = (Bytef*)buff;
+        pzstream->avail_out = sizeof(buff);
+        int ret = inflate(pzstream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            fprintf(stderr, "[UNTAR] Decompression failure\n");
+            return false;
+        }
+        if (!extractor.Write(buff, sizeof(buff) - pzstream->avail_out))
+            return false;
+        if (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && pzstream->avail_out == sizeof(buff)))
+            break;
+    } while ((pzstream->avail_in > 0 || pzstream->avail_out == 0) && !extractor.IsFinished());
     return true;
+#else
+    return false;
+#endif
 }
 
+bool
+CBootstrapStream::Finish()
+{
+    /* Flush what the decompressor still holds. */
+    if (!fFailed && format == FORMAT_GZIP)
+        fFailed = !Extract(NULL, 0);
+    return !fFailed && extractor.IsFinished();
+}
+
+std::string
+CBootstrapStream::GetSHA256()
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    hasher.Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
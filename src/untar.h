@@ -5,6 +5,94 @@
 #ifndef UNTAR_H
 #define UNTAR_H
 
+#include "crypto/sha256.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+struct z_stream_s;
+
 bool untar(FILE *a, const char *path);
 
+/**
+ * Incremental tar extractor. The archive is fed in chunks of any size as it
+ * arrives, and the entries are written below pathDest. Entries with absolute
+ * names or ".." components fail the extraction.
+ */
+class CTarExtractor
+{
+private:
+    boost::filesystem::path pathDest;
+    //! The current 512 bytes block
+    char buff[512];
+    size_t nBuff;
+    //! Bytes of the current entry still to be read
+    int64_t nFileSize;
+    FILE *f;
+    bool fFinished;
+    bool fFailed;
+
+    bool ProcessHeader();
+    bool WriteData(const char *pch, size_t nSize);
+    void CloseFile();
+
+public:
+    CTarExtractor(const boost::filesystem::path& pathDestIn);
+    ~CTarExtractor();
+
+    /** Extract the next nSize bytes of the archive. Returns false once extraction failed. */
+    bool Write(const char *pch, size_t nSize);
+
+    /** Whether the end of the archive has been reached. Data after it is ignored. */
+    bool IsFinished() const { return fFinished; }
+    bool HasFailed() const { return fFailed; }
+};
+
+/**
+ * A bootstrap archive as it is downloaded: the raw data is hashed and
+ * extracted in a single pass, inflating it first when it is gzip compressed.
+ */
+class CBootstrapStream
+{
+private:
+    enum Format {
+        FORMAT_UNKNOWN,
+        FORMAT_TAR,
+        FORMAT_GZIP
+    };
+
+    CTarExtractor extractor;
+    CSHA256 hasher;
+    uint64_t nSize;
+    Format format;
+    //! Data received before the format is known
+    std::vector<char> vMagic;
+    struct z_stream_s *pzstream;
+    bool fFailed;
+
+    bool Extract(const char *pch, size_t nSize);
+
+public:
+    CBootstrapStream(const boost::filesystem::path& pathDest);
+    ~CBootstrapStream();
+
+    /** Process the next nSize bytes of the download. Returns false once it failed. */
+    bool Write(const char *pch, size_t nSize);
+
+    /** Call once the download ended. Returns whether the whole archive was extracted. */
+    bool Finish();
+
+    /** Bytes of the archive received so far */
+    uint64_t GetSize() const { return nSize; }
+    bool IsFinished() const { return extractor.IsFinished(); }
+    bool HasFailed() const { return fFailed; }
+
+    /** Hex SHA256 of the data received. Can only be called once. */
+    std::string GetSHA256();
+};
+
 #endif // UNTAR_H
@@ -9,6 +9,7 @@
 
 #include "utiltime.h"
 
+#include <atomic>
 #include <chrono>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -17,7 +18,7 @@
 using namespace std;
 
 static int64_t nMockTime = 0; //!< For unit testing
-static int64_t nNtpTimeOffset = 0;
+static std::atomic<int64_t> nNtpTimeOffset(0); //!< Set by the NTP clock sync thread
 
 int64_t GetTime()
 {
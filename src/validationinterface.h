@@ -18,6 +18,7 @@ class CTransaction;
 class CValidationInterface;
 class CValidationState;
 class uint256;
+struct CStakingRound;
 
 // These functions dispatch to one or all registered wallets
 
@@ -41,6 +42,7 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
+    virtual void StakingRound(const CStakingRound &round) {};
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -65,6 +67,8 @@ struct CMainSignals {
     boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /** Notifies listeners that the staker finished a round */
+    boost::signals2::signal<void (const CStakingRound &)> StakingRound;
 };
 
 CMainSignals& GetMainSignals();
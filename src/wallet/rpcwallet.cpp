@@ -24,6 +24,7 @@
 #include "wallet.h"
 #include "walletdb.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -3128,69 +3129,28 @@ struct StakePeriodRange_T {
 typedef std::vector<StakePeriodRange_T> vStakePeriodRange_T;
 
 // **em52: Get total coins staked on given period
-// inspired from CWallet::GetStake()
 // Parameter aRange = Vector with given limit date, and result
-// return int =  Number of Wallet's elements analyzed
+// return int =  Number of mature stakes of the wallet
 int GetsStakeSubTotal(vStakePeriodRange_T& aRange)
 {
-    int nElement = 0;
-    int64_t nAmount = 0;
-
-    const CWalletTx* pcoin;
-
     vStakePeriodRange_T::iterator vIt;
 
-    // scan the entire wallet transactions
-    for (map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin();
-         it != pwalletMain->mapWallet.end();
-         ++it)
+    for(vIt=aRange.begin(); vIt != aRange.end(); vIt++)
     {
-        pcoin = &(*it).second;
-
-        // skip orphan block or immature
-        if  ((!pcoin->GetDepthInMainChain()) || (pcoin->GetBlocksToMaturity()>0))
-            continue;
-
-        // skip abandoned transactions
-        if(pcoin->isAbandoned())
-            continue;
-
-        // skip transaction other than POS block
-        if (!(pcoin->IsCoinStake()))
-            continue;
-
-        if(pcoin->isAbandoned())
-            continue;
-
-        nElement++;
-
-        // use the cached amount if available
-        if (pcoin->fCreditCached && pcoin->fDebitCached)
-            nAmount = pcoin->nCreditCached - pcoin->nDebitCached;
-        else
-            nAmount = pcoin->GetCredit(ISMINE_SPENDABLE) - pcoin->GetDebit(ISMINE_SPENDABLE);
-
-
-        // scan the range
-        for(vIt=aRange.begin(); vIt != aRange.end(); vIt++)
-        {
-            if (pcoin->nTime >= vIt->Start)
-            {
-                if (! vIt->End)
-                {   // Manage Special case
-                    vIt->Start = pcoin->nTime;
-                    vIt->Total = nAmount;
-                }
-                else if (pcoin->nTime <= vIt->End)
-                {
-                    vIt->Count++;
-                    vIt->Total += nAmount;
-                }
-            }
+        if (! vIt->End)
+        {   // Manage Special case
+            CAmount nAmount = 0;
+            if (pwalletMain->GetLatestStake(vIt->Start, nAmount))
+                vIt->Total = nAmount;
         }
-
+        else
+            pwalletMain->GetStakeRewards(vIt->Start, vIt->End, vIt->Count, vIt->Total);
     }
 
+    int nElement = 0;
+    CAmount nTotal = 0;
+    pwalletMain->GetStakeRewards(0, std::numeric_limits<int64_t>::max(), nElement, nTotal);
+
     return nElement;
 }
 
@@ -3356,11 +3316,9 @@ UniValue proposalvotelist(const UniValue& params, bool fHelp)
     UniValue nullvotes(UniValue::VARR);
 
     std::vector<CFund::CProposal> vec;
-     if(pblocktree->GetProposalIndex(vec))
+     if(pcfundstate->GetProposalsByState(CFund::NIL, vec))
      {
          BOOST_FOREACH(const CFund::CProposal& proposal, vec) {
-             if (proposal.fState != CFund::NIL)
-                 continue;
              auto it = std::find_if( vAddedProposalVotes.begin(), vAddedProposalVotes.end(),
                  [&proposal](const std::pair<std::string, bool>& element){ return element.first == proposal.hash.ToString();} );
              UniValue p(UniValue::VOBJ);
@@ -3456,11 +3414,9 @@ UniValue paymentrequestvotelist(const UniValue& params, bool fHelp)
     UniValue nullvotes(UniValue::VARR);
 
     std::vector<CFund::CPaymentRequest> vec;
-     if(pblocktree->GetPaymentRequestIndex(vec))
+     if(pcfundstate->GetPaymentRequestsByState(CFund::NIL, vec))
      {
          BOOST_FOREACH(const CFund::CPaymentRequest& prequest, vec) {
-             if (prequest.fState != CFund::NIL)
-                 continue;
              auto it = std::find_if( vAddedPaymentRequestVotes.begin(), vAddedPaymentRequestVotes.end(),
                  [&prequest](const std::pair<std::string, bool>& element){ return element.first == prequest.hash.ToString();} );
              UniValue p(UniValue::VOBJ);
@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakehistory.h"
+
+#include <algorithm>
+
+static bool CompareStakeEntries(const CStakeHistoryEntry& a, const CStakeHistoryEntry& b)
+{
+    if (a.nTime != b.nTime)
+        return a.nTime < b.nTime;
+    return a.hash < b.hash;
+}
+
+static bool CompareStakeEntryTime(const CStakeHistoryEntry& a, int64_t nTime)
+{
+    return a.nTime < nTime;
+}
+
+static bool CompareTimeStakeEntry(int64_t nTime, const CStakeHistoryEntry& a)
+{
+    return nTime < a.nTime;
+}
+
+std::vector<CStakeHistoryEntry>::iterator CStakeHistory::Find(const uint256& hash, int64_t nTime)
+{
+    CStakeHistoryEntry entry(nTime, hash, 0);
+    std::vector<CStakeHistoryEntry>::iterator it = std::lower_bound(vEntries.begin(), vEntries.end(), entry, CompareStakeEntries);
+    if (it != vEntries.end() && it->hash == hash)
+        return it;
+    return vEntries.end();
+}
+
+void CStakeHistory::UpdateTotals(size_t nFrom)
+{
+    CAmount nTotal = nFrom > 0 ? vEntries[nFrom - 1].nTotal : 0;
+    for (size_t i = nFrom; i < vEntries.size(); i++)
+    {
+        nTotal += vEntries[i].nAmount;
+        vEntries[i].nTotal = nTotal;
+    }
+}
+
+void CStakeHistory::Add(const uint256& hash, int64_t nTime, CAmount nAmount)
+{
+    std::map<uint256, int64_t>::iterator mi = mapTimes.find(hash);
+    if (mi != mapTimes.end())
+    {
+        std::vector<CStakeHistoryEntry>::iterator it = Find(hash, mi->second);
+        if (mi->second == nTime && it != vEntries.end() && it->nAmount == nAmount)
+            return;
+        Remove(hash);
+    }
+
+    CStakeHistoryEntry entry(nTime, hash, nAmount);
+    std::vector<CStakeHistoryEntry>::iterator it = std::upper_bound(vEntries.begin(), vEntries.end(), entry, CompareStakeEntries);
+    size_t nPos = it - vEntries.begin();
+    vEntries.insert(it, entry);
+    mapTimes[hash] = nTime;
+    UpdateTotals(nPos);
+}
+
+void CStakeHistory::Remove(const uint256& hash)
+{
+    std::map<uint256, int64_t>::iterator mi = mapTimes.find(hash);
+    if (mi == mapTimes.end())
+        return;
+
+    std::vector<CStakeHistoryEntry>::iterator it = Find(hash, mi->second);
+    mapTimes.erase(mi);
+    if (it == vEntries.end())
+        return;
+
+    size_t nPos = it - vEntries.begin();
+    vEntries.erase(it);
+    UpdateTotals(nPos);
+}
+
+void CStakeHistory::Clear()
+{
+    vEntries.clear();
+    mapTimes.clear();
+}
+
+void CStakeHistory::GetRange(int64_t nStart, int64_t nEnd, int& nCountRet, CAmount& nTotalRet) const
+{
+    nCountRet = 0;
+    nTotalRet = 0;
+    if (nStart > nEnd)
+        return;
+
+    std::vector<CStakeHistoryEntry>::const_iterator begin = std::lower_bound(vEntries.begin(), vEntries.end(), nStart, CompareStakeEntryTime);
+    std::vector<CStakeHistoryEntry>::const_iterator end = std::upper_bound(begin, vEntries.end(), nEnd, CompareTimeStakeEntry);
+    if (begin == end)
+        return;
+
+    nCountRet = end - begin;
+    nTotalRet = (end - 1)->nTotal - (begin == vEntries.begin() ? 0 : (begin - 1)->nTotal);
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_WALLET_STAKEHISTORY_H
+#define NAVCOIN_WALLET_STAKEHISTORY_H
+
+#include "amount.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** A coinstake reward of the wallet */
+struct CStakeHistoryEntry
+{
+    int64_t nTime;
+    uint256 hash;
+    CAmount nAmount;
+    //! Sum of the rewards up to and including this one
+    CAmount nTotal;
+
+    CStakeHistoryEntry() : nTime(0), nAmount(0), nTotal(0) {}
+    CStakeHistoryEntry(int64_t nTimeIn, const uint256& hashIn, CAmount nAmountIn) :
+        nTime(nTimeIn), hash(hashIn), nAmount(nAmountIn), nTotal(0) {}
+};
+
+/**
+ * Stake rewards ordered by time with running totals, so the number and sum
+ * of the rewards of any time range take two binary searches. Rewards
+ * normally arrive in time order and are appended in constant time.
+ */
+class CStakeHistory
+{
+private:
+    std::vector<CStakeHistoryEntry> vEntries;
+    std::map<uint256, int64_t> mapTimes;
+
+    std::vector<CStakeHistoryEntry>::iterator Find(const uint256& hash, int64_t nTime);
+    void UpdateTotals(size_t nFrom);
+
+public:
+    /** Add or replace the reward of coinstake hash */
+    void Add(const uint256& hash, int64_t nTime, CAmount nAmount);
+    void Remove(const uint256& hash);
+    void Clear();
+
+    /** Number and sum of the rewards with nStart <= nTime <= nEnd */
+    void GetRange(int64_t nStart, int64_t nEnd, int& nCountRet, CAmount& nTotalRet) const;
+
+    /** Rewards ordered by time, oldest first */
+    const std::vector<CStakeHistoryEntry>& GetEntries() const { return vEntries; }
+    size_t size() const { return vEntries.size(); }
+};
+
+#endif // NAVCOIN_WALLET_STAKEHISTORY_H
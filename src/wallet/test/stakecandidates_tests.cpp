@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/wallet.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "wallet/test/wallet_test_fixture.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakecandidates_tests, WalletTestingSetup)
+
+// Index a block on top of pindexPrev and make it the tip, without wallet events
+static CBlockIndex* ConnectIndex(CBlockIndex* pindexPrev)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first->first;
+    pindex->pprev = pindexPrev;
+    pindex->nHeight = pindexPrev->nHeight + 1;
+    pindex->nTime = pindexPrev->nTime + 64;
+    pindex->BuildSkip();
+    chainActive.SetTip(pindex);
+    pindexBestHeader = pindex;
+    return pindex;
+}
+
+static CBlockIndex* ConnectIndexes(CBlockIndex* pindex, int nCount)
+{
+    for (int i = 0; i < nCount; i++)
+        pindex = ConnectIndex(pindex);
+    return pindex;
+}
+
+// Two outputs of each transaction can stake, the one in the middle is below -mininputvalue
+static uint256 AddTx(const CScript& script, const CBlockIndex* pindex, unsigned int nTime,
+                     bool fCoinStake = false, const COutPoint& prevout = COutPoint())
+{
+    CMutableTransaction tx;
+    tx.nTime = nTime;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout.IsNull() ? COutPoint(GetRandHash(), 0) : prevout;
+    if (fCoinStake)
+        tx.vout.push_back(CTxOut(0, CScript()));
+    tx.vout.push_back(CTxOut(10 * COIN, script));
+    tx.vout.push_back(CTxOut(COIN / 2, script));
+    tx.vout.push_back(CTxOut(20 * COIN, script));
+
+    CWalletTx wtx(pwalletMain, CTransaction(tx));
+    if (pindex)
+    {
+        wtx.hashBlock = pindex->GetBlockHash();
+        wtx.nIndex = 0;
+    }
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    BOOST_CHECK(pwalletMain->AddToWallet(wtx, false, &walletdb));
+    return wtx.GetHash();
+}
+
+// The candidates kept up to date since the last check must match a rebuild from the whole wallet
+static void CheckStakeCandidates(unsigned int nSpendTime, size_t nExpected)
+{
+    std::vector<COutput> vIncremental, vRebuilt;
+    pwalletMain->AvailableCoinsForStaking(vIncremental, nSpendTime);
+    pwalletMain->MarkStakeCandidatesDirty(true);
+    pwalletMain->AvailableCoinsForStaking(vRebuilt, nSpendTime);
+
+    BOOST_CHECK_EQUAL(vIncremental.size(), nExpected);
+    BOOST_REQUIRE_EQUAL(vIncremental.size(), vRebuilt.size());
+    for (unsigned int i = 0; i < vIncremental.size(); i++)
+    {
+        BOOST_CHECK(vIncremental[i].tx->GetHash() == vRebuilt[i].tx->GetHash());
+        BOOST_CHECK_EQUAL(vIncremental[i].i, vRebuilt[i].i);
+        BOOST_CHECK_EQUAL(vIncremental[i].nDepth, vRebuilt[i].nDepth);
+        BOOST_CHECK_EQUAL(vIncremental[i].fSolvable, vRebuilt[i].fSolvable);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_candidates_incremental)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    const unsigned int nStakeMinAge = Params().GetConsensus().nStakeMinAge;
+    const unsigned int nTime = 1500000000;
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKey(key));
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    CBlockIndex* pindex5 = ConnectIndexes(pindexGenesis, 5);
+    CBlockIndex* pindex7 = ConnectIndexes(pindex5, 2);
+    CBlockIndex* pindex8 = ConnectIndex(pindex7);
+    CBlockIndex* pindex9 = ConnectIndex(pindex8);
+    CBlockIndex* pindexTip = ConnectIndex(pindex9);
+
+    uint256 hashA = AddTx(script, pindex5, nTime);
+    AddTx(script, pindex8, nTime, true);
+    AddTx(script, pindex9, nTime + nStakeMinAge);
+    AddTx(script, NULL, nTime);
+
+    // Only A is old enough and confirmed, the coinstake is immature
+    CheckStakeCandidates(nTime + nStakeMinAge, 2);
+
+    // The coinstake matures as the tip advances
+    pindexTip = ConnectIndexes(pindexTip, COINBASE_MATURITY);
+    CheckStakeCandidates(nTime + nStakeMinAge, 4);
+
+    // The third transaction reaches the minimum age
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 6);
+
+    // Spending an output removes it
+    AddTx(CScript() << OP_TRUE, NULL, nTime + 2 * nStakeMinAge, false, COutPoint(hashA, 0));
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 5);
+
+    // Outputs already in the wallet become candidates after importing their key or script
+    CBlockIndex* pindex20 = pindexTip->GetAncestor(20);
+    CKey keyImported;
+    keyImported.MakeNewKey(true);
+    AddTx(GetScriptForDestination(keyImported.GetPubKey().GetID()), pindex20, nTime);
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 5);
+    BOOST_CHECK(pwalletMain->AddKey(keyImported));
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 7);
+
+    CKey keyScript;
+    keyScript.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKey(keyScript));
+    CScript redeemScript = GetScriptForDestination(keyScript.GetPubKey().GetID());
+    AddTx(GetScriptForDestination(CScriptID(redeemScript)), pindex20, nTime);
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 7);
+    BOOST_CHECK(pwalletMain->AddCScript(redeemScript));
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 9);
+
+    // A reorg past block 8 leaves only the unspent output of A
+    CBlockIndex* pindexFork = ConnectIndexes(pindex7, COINBASE_MATURITY + 10);
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 1);
+
+    // and reorganizing back restores the rest
+    chainActive.SetTip(pindexTip);
+    pindexBestHeader = pindexTip;
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 9);
+
+    // Each step above starts from a rebuild, check a few tip changes in a row too
+    std::vector<COutput> vCoins;
+    pindexTip = ConnectIndexes(pindexTip, 3);
+    pwalletMain->AvailableCoinsForStaking(vCoins, nTime + 2 * nStakeMinAge);
+    pindexTip = ConnectIndex(pindexTip);
+    pwalletMain->AvailableCoinsForStaking(vCoins, nTime + 2 * nStakeMinAge);
+    chainActive.SetTip(pindexFork);
+    pindexBestHeader = pindexFork;
+    pwalletMain->AvailableCoinsForStaking(vCoins, nTime + 2 * nStakeMinAge);
+    chainActive.SetTip(pindexTip);
+    pindexBestHeader = pindexTip;
+    pwalletMain->AvailableCoinsForStaking(vCoins, nTime + 2 * nStakeMinAge);
+    pindexTip = ConnectIndexes(pindexTip, 2);
+    CheckStakeCandidates(nTime + 2 * nStakeMinAge, 9);
+    BOOST_CHECK_EQUAL(vCoins.size(), 9U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakehistory.h"
+
+#include "arith_uint256.h"
+#include "test/test_navcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakehistory_tests, BasicTestingSetup)
+
+static uint256 StakeHash(int n)
+{
+    return ArithToUint256(arith_uint256(n));
+}
+
+BOOST_AUTO_TEST_CASE(stakehistory_ranges)
+{
+    CStakeHistory history;
+    int nCount;
+    CAmount nTotal;
+
+    history.GetRange(0, 1000, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 0);
+    BOOST_CHECK_EQUAL(nTotal, 0);
+
+    history.Add(StakeHash(1), 100, 2 * COIN);
+    history.Add(StakeHash(2), 200, 3 * COIN);
+    history.Add(StakeHash(3), 300, 5 * COIN);
+    // Out of order
+    history.Add(StakeHash(4), 150, 7 * COIN);
+
+    history.GetRange(0, 1000, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 4);
+    BOOST_CHECK_EQUAL(nTotal, 17 * COIN);
+
+    // Limits are inclusive
+    history.GetRange(150, 200, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 2);
+    BOOST_CHECK_EQUAL(nTotal, 10 * COIN);
+
+    history.GetRange(201, 299, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 0);
+    BOOST_CHECK_EQUAL(nTotal, 0);
+
+    history.GetRange(300, 200, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 0);
+
+    // Adding again replaces the reward
+    history.Add(StakeHash(2), 250, 4 * COIN);
+    BOOST_CHECK_EQUAL(history.size(), 4U);
+    history.GetRange(0, 200, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 2);
+    BOOST_CHECK_EQUAL(nTotal, 9 * COIN);
+
+    history.Remove(StakeHash(4));
+    history.Remove(StakeHash(5));
+    history.GetRange(0, 1000, nCount, nTotal);
+    BOOST_CHECK_EQUAL(nCount, 3);
+    BOOST_CHECK_EQUAL(nTotal, 11 * COIN);
+    BOOST_CHECK(history.GetEntries().back().hash == StakeHash(3));
+
+    history.Clear();
+    BOOST_CHECK_EQUAL(history.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
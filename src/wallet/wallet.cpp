@@ -31,6 +31,7 @@
 #include "kernel.h"
 #include "pos.h"
 
+#include <algorithm>
 #include <assert.h>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -40,6 +41,7 @@
 using namespace std;
 
 CWallet* pwalletMain = NULL;
+std::vector<CWallet*> vpwalletStaking;
 /** Transaction fee set by the user */
 CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
@@ -187,6 +189,81 @@ int64_t CWallet::GetStake() const
     return nTotal;
 }
 
+void CWallet::UpdateStakeHistory(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!fStakeHistoryLoaded || !wtx.IsCoinStake())
+        return;
+
+    // Abandoned coinstakes are unset too
+    if (wtx.hashUnset())
+        stakeHistory.Remove(wtx.GetHash());
+    else
+        stakeHistory.Add(wtx.GetHash(), wtx.nTime, GetCredit(wtx, ISMINE_SPENDABLE) - GetDebit(wtx, ISMINE_SPENDABLE));
+}
+
+void CWallet::LoadStakeHistory() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fStakeHistoryLoaded)
+        return;
+
+    stakeHistory.Clear();
+    fStakeHistoryLoaded = true;
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (it->second.IsCoinStake() && it->second.GetDepthInMainChain() > 0)
+            UpdateStakeHistory(it->second);
+}
+
+bool CWallet::IsReportedStake(const CStakeHistoryEntry& entry) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    map<uint256, CWalletTx>::const_iterator it = mapWallet.find(entry.hash);
+    return it != mapWallet.end() && it->second.GetDepthInMainChain() > 0 && it->second.GetBlocksToMaturity() == 0;
+}
+
+void CWallet::GetStakeRewards(int64_t nStart, int64_t nEnd, int& nCountRet, CAmount& nTotalRet) const
+{
+    LOCK2(cs_main, cs_wallet);
+    LoadStakeHistory();
+    stakeHistory.GetRange(nStart, nEnd, nCountRet, nTotalRet);
+
+    // Stake times grow with the height, so only the newest rewards can be
+    // immature or out of the active chain
+    const std::vector<CStakeHistoryEntry>& vEntries = stakeHistory.GetEntries();
+    for (std::vector<CStakeHistoryEntry>::const_reverse_iterator it = vEntries.rbegin(); it != vEntries.rend() && !IsReportedStake(*it); ++it)
+    {
+        if (it->nTime >= nStart && it->nTime <= nEnd)
+        {
+            nCountRet--;
+            nTotalRet -= it->nAmount;
+        }
+    }
+}
+
+bool CWallet::GetLatestStake(int64_t& nTimeRet, CAmount& nAmountRet) const
+{
+    LOCK2(cs_main, cs_wallet);
+    LoadStakeHistory();
+
+    const std::vector<CStakeHistoryEntry>& vEntries = stakeHistory.GetEntries();
+    for (std::vector<CStakeHistoryEntry>::const_reverse_iterator it = vEntries.rbegin(); it != vEntries.rend(); ++it)
+    {
+        if (IsReportedStake(*it))
+        {
+            nTimeRet = it->nTime;
+            nAmountRet = it->nAmount;
+            return true;
+        }
+    }
+    return false;
+}
+
 int64_t CWallet::GetNewMint() const
 {
     int64_t nTotal = 0;
@@ -237,40 +314,162 @@ uint64_t CWallet::GetStakeWeight() const
     return nWeight;
 }
 
-void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSpendTime) const
+void CWallet::MarkStakeCandidatesDirty(bool fReload)
 {
-    vCoins.clear();
+    LOCK(cs_wallet);
+    fStakeCandidatesDirty = true;
+    if (fReload)
+    {
+        fStakeCandidatesLoaded = false;
+        // Key changes also change the rewards
+        fStakeHistoryLoaded = false;
+    }
+}
+
+void CWallet::QueueStakeCandidate(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
 
+    fStakeCandidatesDirty = true;
+
+    if (setStakeTxs.count(wtx.GetHash()))
+        return;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (IsMine(wtx.vout[i]) && wtx.vout[i].nValue >= nMinimumInputValue)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            const uint256& wtxid = it->first;
+            int64_t nTimeMature = (int64_t)wtx.nTime + Params().GetConsensus().nStakeMinAge;
+            std::pair<std::multimap<int64_t, uint256>::iterator, std::multimap<int64_t, uint256>::iterator> range = mapStakeMaturing.equal_range(nTimeMature);
+            for (std::multimap<int64_t, uint256>::iterator it = range.first; it != range.second; ++it)
+                if (it->second == wtx.GetHash())
+                    return;
+            mapStakeMaturing.insert(make_pair(nTimeMature, wtx.GetHash()));
+            return;
+        }
+    }
+}
 
-            // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
-            if (pcoin->nTime + Params().GetConsensus().nStakeMinAge > nSpendTime)
-                continue;
+static bool StakeCandidateLess(const COutput& a, const COutput& b)
+{
+    if (a.tx->GetHash() != b.tx->GetHash())
+        return a.tx->GetHash() < b.tx->GetHash();
+    return a.i < b.i;
+}
 
-            if (pcoin->GetBlocksToMaturity() > 0)
-                continue;
+// Returns false while the depth or maturity of the transaction can still change with the tip
+bool CWallet::AddStakeCandidateOutputs(const CWalletTx& wtx) const
+{
+    if (wtx.isAbandoned())
+        return true;
 
-            if (pcoin->isAbandoned())
-                continue;
+    int nDepth = wtx.GetDepthInMainChain();
+    if (nDepth < 1 || wtx.GetBlocksToMaturity() > 0)
+        return false;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < 1)
-                continue;
+    const uint256& wtxid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        if (!(IsSpent(wtxid,i)) && IsMine(wtx.vout[i]) && wtx.vout[i].nValue >= nMinimumInputValue){
+            vStakeCandidates.push_back(COutput(&wtx, i, nDepth, true,
+                                   ((IsMine(wtx.vout[i]) & (ISMINE_SPENDABLE)) != ISMINE_NO &&
+                                   !wtx.vout[i].scriptPubKey.IsColdStaking()) ||
+                                   ((IsMine(wtx.vout[i]) & (ISMINE_STAKABLE)) != ISMINE_NO &&
+                                   fStakeCandidatesColdStaking)));
+        }
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-                if (!(IsSpent(wtxid,i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue){
-                    vCoins.push_back(COutput(pcoin, i, nDepth, true,
-                                           ((IsMine(pcoin->vout[i]) & (ISMINE_SPENDABLE)) != ISMINE_NO &&
-                                           !pcoin->vout[i].scriptPubKey.IsColdStaking()) ||
-                                           ((IsMine(pcoin->vout[i]) & (ISMINE_STAKABLE)) != ISMINE_NO &&
-                                           IsColdStakingEnabled(pindexBestHeader, Params().GetConsensus()))));
-                }
+    return true;
+}
+
+void CWallet::UpdateStakeCandidates(unsigned int nSpendTime) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!fStakeCandidatesLoaded)
+    {
+        // Key changes can turn any wallet transaction into a candidate
+        mapStakeMaturing.clear();
+        setStakeTxs.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            QueueStakeCandidate(it->second);
+        fStakeCandidatesLoaded = true;
+    }
+
+    bool fRecheck = false;
+
+    // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
+    while (!mapStakeMaturing.empty() && mapStakeMaturing.begin()->first <= nSpendTime)
+    {
+        setStakeTxs.insert(mapStakeMaturing.begin()->second);
+        setStakeTxsWaiting.insert(mapStakeMaturing.begin()->second);
+        mapStakeMaturing.erase(mapStakeMaturing.begin());
+        fRecheck = true;
+    }
+
+    bool fColdStaking = IsColdStakingEnabled(pindexBestHeader, Params().GetConsensus());
+    if (fColdStaking != fStakeCandidatesColdStaking)
+    {
+        fStakeCandidatesColdStaking = fColdStaking;
+        fStakeCandidatesDirty = true;
+    }
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    uint256 hashTip = pindexTip ? pindexTip->GetBlockHash() : uint256();
+    if (hashTip != hashStakeCandidatesTip)
+    {
+        // Extending the chain only makes the candidates deeper, anything else needs a rebuild
+        const CBlockIndex* pindexOld = pindexTip && nStakeCandidatesHeight >= 0 ? pindexTip->GetAncestor(nStakeCandidatesHeight) : NULL;
+        if (!fStakeCandidatesDirty && pindexOld && pindexOld->GetBlockHash() == hashStakeCandidatesTip)
+        {
+            int nBlocks = pindexTip->nHeight - nStakeCandidatesHeight;
+            for (std::vector<COutput>::iterator it = vStakeCandidates.begin(); it != vStakeCandidates.end(); ++it)
+                it->nDepth += nBlocks;
+        }
+        else
+            fStakeCandidatesDirty = true;
+        hashStakeCandidatesTip = hashTip;
+        nStakeCandidatesHeight = pindexTip ? pindexTip->nHeight : -1;
+        fRecheck = true;
+    }
+
+    if (fStakeCandidatesDirty)
+    {
+        vStakeCandidates.clear();
+        setStakeTxsWaiting = setStakeTxs;
+        fStakeCandidatesDirty = false;
+        fRecheck = true;
+    }
+
+    if (!fRecheck)
+        return;
+
+    size_t nCandidates = vStakeCandidates.size();
+    for (std::set<uint256>::iterator it = setStakeTxsWaiting.begin(); it != setStakeTxsWaiting.end();)
+    {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end())
+        {
+            setStakeTxs.erase(*it);
+            setStakeTxsWaiting.erase(it++);
         }
+        else if (AddStakeCandidateOutputs(mi->second))
+            setStakeTxsWaiting.erase(it++);
+        else
+            ++it;
+    }
+
+    // The new outputs come in outpoint order, merge them with the older ones
+    std::inplace_merge(vStakeCandidates.begin(), vStakeCandidates.begin() + nCandidates, vStakeCandidates.end(), StakeCandidateLess);
+}
+
+void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSpendTime) const
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        UpdateStakeCandidates(nSpendTime);
+        vCoins = vStakeCandidates;
     }
 }
 
@@ -314,19 +513,70 @@ bool CWallet::SelectCoinsForStaking(int64_t nTargetValue, unsigned int nSpendTim
     return true;
 }
 
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CMutableTransaction& txNew, CKey& key)
+// Get the coinstake output script and signing key for a kernel output
+static bool GetCoinStakeScript(const CKeyStore& keystore, const CScript& scriptPubKeyKernel, CScript& scriptPubKeyOut, CKey& key)
 {
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
+    vector<std::vector<unsigned char>> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+    {
+        LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
+        return false;
+    }
+    LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
+    if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_COLDSTAKING)
+    {
+        LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
+        return false;  // only support pay to public key and pay to address
+    }
+    if (whichType == TX_COLDSTAKING) // cold staking
+    {
+        // try to find staking key
+        if (!keystore.GetKey(uint160(vSolutions[0]), key))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false;  // unable to find corresponding public key
+        } else {
+            // we keep the same script
+            scriptPubKeyOut = scriptPubKeyKernel;
+        }
+    }
+    if (whichType == TX_PUBKEYHASH) // pay to address type
+    {
+        // convert to pay to public key type
+        if (!keystore.GetKey(uint160(vSolutions[0]), key))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false;  // unable to find corresponding public key
+        }
+        scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    }
+    if (whichType == TX_PUBKEY)
+    {
+        std::vector<unsigned char>& vchPubKey = vSolutions[0];
+        if (!keystore.GetKey(Hash160(vchPubKey), key))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false;  // unable to find corresponding public key
+        }
 
-    txNew.vin.clear();
-    txNew.vout.clear();
+        if (key.GetPubKey() != vchPubKey)
+        {
+            LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+            return false; // keys mismatch
+        }
 
-    // Mark coin stake transaction
-    CScript scriptEmpty;
-    scriptEmpty.clear();
-    txNew.vout.push_back(CTxOut(0, scriptEmpty));
+        scriptPubKeyOut = scriptPubKeyKernel;
+    }
+
+    LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
+    return true;
+}
+
+bool CWallet::GetStakeKernelInputs(unsigned int nTime, vector<pair<const CWalletTx*,unsigned int> >& vCoinsRet, vector<CStakeKernelInput>& vInputsRet) const
+{
+    vCoinsRet.clear();
+    vInputsRet.clear();
 
     // Choose coins to use
     int64_t nBalance = GetBalance() + GetColdStakingBalance();
@@ -334,112 +584,60 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance <= nReserveBalance)
         return false;
 
-    set<pair<const CWalletTx*,unsigned int> > vwtxPrev;
-
     set<pair<const CWalletTx*,unsigned int> > setCoins;
     int64_t nValueIn = 0;
 
     // Select coins with suitable depth
-    if (!SelectCoinsForStaking(nBalance - nReserveBalance, txNew.nTime, setCoins, nValueIn))
+    if (!SelectCoinsForStaking(nBalance - nReserveBalance, nTime, setCoins, nValueIn))
         return false;
 
-    if (setCoins.empty())
-        return false;
-
-    int64_t nCredit = 0;
-    CScript scriptPubKeyKernel;
+    // The kernel inputs of a candidate come from its wallet transaction, so
+    // the previous transaction does not need to be looked up again
+    LOCK(cs_main);
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
-        static int nMaxStakeSearchInterval = 60;
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBestHeader; n++)
-        {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
-            {
-                // Found a kernel
-                LogPrint("coinstake", "CreateCoinStake : kernel found\n");
-                vector<std::vector<unsigned char>> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_COLDSTAKING)
-                {
-                    LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_COLDSTAKING) // cold staking
-                {
-                    // try to find staking key
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    } else {
-                        // we keep the same script
-                        scriptPubKeyOut = scriptPubKeyKernel;
-                    }
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
-                }
-                if (whichType == TX_PUBKEY)
-                {
-                    std::vector<unsigned char>& vchPubKey = vSolutions[0];
-                    if (!keystore.GetKey(Hash160(vchPubKey), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
+        BlockMap::iterator mi = mapBlockIndex.find(pcoin.first->hashBlock);
+        if (mi == mapBlockIndex.end())
+            continue;
+        vCoinsRet.push_back(pcoin);
+        vInputsRet.push_back(CStakeKernelInput(COutPoint(pcoin.first->GetHash(), pcoin.second),
+                                               mi->second->GetBlockTime(), pcoin.first->nTime,
+                                               pcoin.first->vout[pcoin.second].nValue));
+    }
 
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    }
+    return !vCoinsRet.empty();
+}
 
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, const CBlockIndex* pindexPrev, const vector<pair<const CWalletTx*,unsigned int> >& vCoins, const pair<const CWalletTx*,unsigned int>& kernel, unsigned int nTimeKernel, int64_t nFees, CMutableTransaction& txNew, CKey& key)
+{
+    txNew.vin.clear();
+    txNew.vout.clear();
 
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.insert(make_pair(pcoin.first,pcoin.second));
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+    // Mark coin stake transaction
+    CScript scriptEmpty;
+    scriptEmpty.clear();
+    txNew.vout.push_back(CTxOut(0, scriptEmpty));
 
-                LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+    int64_t nBalance = GetBalance() + GetColdStakingBalance();
 
-            }
+    set<pair<const CWalletTx*,unsigned int> > vwtxPrev;
 
-        }
+    int64_t nCredit = 0;
+    CScript scriptPubKeyKernel = kernel.first->vout[kernel.second].scriptPubKey;
+    CScript scriptPubKeyOut;
+    if (!GetCoinStakeScript(keystore, scriptPubKeyKernel, scriptPubKeyOut, key))
+        return false;
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
-    }
+    txNew.nTime = nTimeKernel;
+    txNew.vin.push_back(CTxIn(kernel.first->GetHash(), kernel.second));
+    nCredit += kernel.first->vout[kernel.second].nValue;
+    vwtxPrev.insert(kernel);
+    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
-    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, vCoins)
     {
         // Attempt to add more inputs
         // Only add coins of the same key/address as kernel
@@ -472,7 +670,12 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     {
         uint64_t nCoinAge;
         CTransaction ptxNew = CTransaction(txNew);
-        if (!TransactionGetCoinAge(ptxNew, nCoinAge))
+        LOCK(cs_main);
+        // The UTXO set only matches the chain of the kernel while it is still the tip
+        if (chainActive.Tip() != pindexPrev)
+            return false;
+        // Cached for the validation of the block
+        if (!TransactionGetCoinAge(ptxNew, *pcoinsTip, pindexPrev, nCoinAge))
             return error("CreateCoinStake : failed to calculate coin age");
 
         nReward = GetProofOfStakeReward(pindexPrev->nHeight + 1, nCoinAge, nFees, pindexBestHeader);
@@ -631,6 +834,9 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     if (HaveWatchOnly(script))
         RemoveWatchOnly(script);
 
+    // Outputs already in the wallet may have become stakable
+    MarkStakeCandidatesDirty(true);
+
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
@@ -681,6 +887,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    MarkStakeCandidatesDirty(true);
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -707,6 +914,7 @@ bool CWallet::AddWatchOnly(const CScript &dest)
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
+    MarkStakeCandidatesDirty(true);
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
         return true;
@@ -1198,6 +1406,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fStakeCandidatesDirty = true;
     }
 }
 
@@ -1220,6 +1429,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                 }
             }
         }
+        if (fStakeCandidatesLoaded)
+            QueueStakeCandidate(wtx);
     }
     else
     {
@@ -1320,6 +1531,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        // New outputs may stake, spent ones can not anymore
+        QueueStakeCandidate(wtx);
+        UpdateStakeHistory(wtx);
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1415,6 +1630,8 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            fStakeCandidatesDirty = true;
+            UpdateStakeHistory(wtx);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1549,6 +1766,7 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
             if (mapWallet.count(txin.prevout.hash))
                 mapWallet[txin.prevout.hash].MarkDirty();
         }
+        fStakeCandidatesDirty = true;
     }
 
     if (!fConnect && tx.IsCoinStake() && IsFromMe(tx))
@@ -3187,6 +3405,11 @@ DBErrors CWallet::ZapSelectTx(vector<uint256>& vHashIn, vector<uint256>& vHashOu
     if (nZapSelectTxRet != DB_LOAD_OK)
         return nZapSelectTxRet;
 
+    {
+        LOCK(cs_wallet);
+        fStakeHistoryLoaded = false;
+    }
+
     MarkDirty();
 
     return DB_LOAD_OK;
@@ -3860,6 +4083,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-usehd", _("Use hierarchical deterministic key generation (HD) after BIP32. Only has effect during wallet creation/first start") + " " + strprintf(_("(default: %u)"), DEFAULT_USE_HD_WALLET));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
+    strUsage += HelpMessageOpt("-stakingwallet=<file>", _("Also stake with this unencrypted wallet file (within data directory), can be specified multiple times"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
@@ -3878,10 +4102,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     return strUsage;
 }
 
-bool CWallet::InitLoadWallet()
+CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
 {
-    std::string walletFile = GetArg("-wallet", DEFAULT_WALLET_DAT);
-
     // needed to restore wallet transaction meta data after -zapwallettxes
     std::vector<CWalletTx> vWtx;
 
@@ -3891,7 +4113,8 @@ bool CWallet::InitLoadWallet()
         CWallet *tempWallet = new CWallet(walletFile);
         DBErrors nZapWalletRet = tempWallet->ZapWalletTx(vWtx);
         if (nZapWalletRet != DB_LOAD_OK) {
-            return InitError(strprintf(_("Error loading %s: Wallet corrupted"), walletFile));
+            InitError(strprintf(_("Error loading %s: Wallet corrupted"), walletFile));
+            return NULL;
         }
 
         delete tempWallet;
@@ -3906,23 +4129,30 @@ bool CWallet::InitLoadWallet()
     DBErrors nLoadWalletRet = walletInstance->LoadWallet(fFirstRun);
     if (nLoadWalletRet != DB_LOAD_OK)
     {
-        if (nLoadWalletRet == DB_CORRUPT)
-            return InitError(strprintf(_("Error loading %s: Wallet corrupted"), walletFile));
+        if (nLoadWalletRet == DB_CORRUPT) {
+            InitError(strprintf(_("Error loading %s: Wallet corrupted"), walletFile));
+            return NULL;
+        }
         else if (nLoadWalletRet == DB_NONCRITICAL_ERROR)
         {
             InitWarning(strprintf(_("Error reading %s! All keys read correctly, but transaction data"
                                          " or address book entries might be missing or incorrect."),
                 walletFile));
         }
-        else if (nLoadWalletRet == DB_TOO_NEW)
-            return InitError(strprintf(_("Error loading %s: Wallet requires newer version of %s"),
+        else if (nLoadWalletRet == DB_TOO_NEW) {
+            InitError(strprintf(_("Error loading %s: Wallet requires newer version of %s"),
                                walletFile, _(PACKAGE_NAME)));
+            return NULL;
+        }
         else if (nLoadWalletRet == DB_NEED_REWRITE)
         {
-            return InitError(strprintf(_("Wallet needed to be rewritten: restart %s to complete"), _(PACKAGE_NAME)));
+            InitError(strprintf(_("Wallet needed to be rewritten: restart %s to complete"), _(PACKAGE_NAME)));
+            return NULL;
+        }
+        else {
+            InitError(strprintf(_("Error loading %s"), walletFile));
+            return NULL;
         }
-        else
-            return InitError(strprintf(_("Error loading %s"), walletFile));
     }
 
     if (GetBoolArg("-upgradewallet", fFirstRun))
@@ -3938,7 +4168,8 @@ bool CWallet::InitLoadWallet()
             LogPrintf("Allowing wallet upgrade up to %i\n", nMaxVersion);
         if (nMaxVersion < walletInstance->GetVersion())
         {
-            return InitError(_("Cannot downgrade wallet"));
+            InitError(_("Cannot downgrade wallet"));
+            return NULL;
         }
         walletInstance->SetMaxVersion(nMaxVersion);
     }
@@ -3956,18 +4187,24 @@ bool CWallet::InitLoadWallet()
         CPubKey newDefaultKey;
         if (walletInstance->GetKeyFromPool(newDefaultKey)) {
             walletInstance->SetDefaultKey(newDefaultKey);
-            if (!walletInstance->SetAddressBook(walletInstance->vchDefaultKey.GetID(), "", "receive"))
-                return InitError(_("Cannot write default address") += "\n");
+            if (!walletInstance->SetAddressBook(walletInstance->vchDefaultKey.GetID(), "", "receive")) {
+                InitError(_("Cannot write default address") += "\n");
+                return NULL;
+            }
         }
 
         walletInstance->SetBestChain(chainActive.GetLocator());
     }
     else if (mapArgs.count("-usehd")) {
         bool useHD = GetBoolArg("-usehd", DEFAULT_USE_HD_WALLET);
-        if (!walletInstance->hdChain.masterKeyID.IsNull() && !useHD)
-            return InitError(strprintf(_("Error loading %s: You can't disable HD on a already existing HD wallet"), walletFile));
-        if (walletInstance->hdChain.masterKeyID.IsNull() && useHD)
-            return InitError(strprintf(_("Error loading %s: You can't enable HD on a already existing non-HD wallet"), walletFile));
+        if (!walletInstance->hdChain.masterKeyID.IsNull() && !useHD) {
+            InitError(strprintf(_("Error loading %s: You can't disable HD on a already existing HD wallet"), walletFile));
+            return NULL;
+        }
+        if (walletInstance->hdChain.masterKeyID.IsNull() && useHD) {
+            InitError(strprintf(_("Error loading %s: You can't enable HD on a already existing non-HD wallet"), walletFile));
+            return NULL;
+        }
     }
 
     LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
@@ -3997,8 +4234,10 @@ bool CWallet::InitLoadWallet()
             while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
                 block = block->pprev;
 
-            if (pindexRescan != block)
-                return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            if (pindexRescan != block) {
+                InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+                return NULL;
+            }
         }
 
         uiInterface.InitMessage(_("Rescanning..."));
@@ -4036,8 +4275,73 @@ bool CWallet::InitLoadWallet()
     }
     walletInstance->SetBroadcastTransactions(GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
-    pwalletMain = walletInstance;
-    return true;
+    return walletInstance;
+}
+
+bool CWallet::InitLoadWallet()
+{
+    pwalletMain = CreateWalletFromFile(GetArg("-wallet", DEFAULT_WALLET_DAT));
+    return pwalletMain != NULL;
+}
+
+static void LoadStakingWallet(const std::string walletFile, CWallet** ppwalletRet)
+{
+    try {
+        *ppwalletRet = CWallet::CreateWalletFromFile(walletFile);
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "LoadStakingWallet()");
+        InitError(strprintf(_("Error loading %s"), walletFile));
+    }
+}
+
+bool CWallet::InitLoadStakingWallets()
+{
+    if (!mapMultiArgs.count("-stakingwallet"))
+        return true;
+
+    std::set<std::string> setFiles;
+    setFiles.insert(GetArg("-wallet", DEFAULT_WALLET_DAT));
+
+    const std::vector<std::string>& vFiles = mapMultiArgs["-stakingwallet"];
+    BOOST_FOREACH(const std::string& walletFile, vFiles)
+    {
+        // Wallet file must be a plain filename without a directory
+        if (walletFile != boost::filesystem::basename(walletFile) + boost::filesystem::extension(walletFile))
+            return InitError(strprintf(_("Wallet %s resides outside data directory %s"), walletFile, GetDataDir().string()));
+        if (!setFiles.insert(walletFile).second)
+            return InitError(strprintf(_("Staking wallet %s is already loaded"), walletFile));
+
+        if (boost::filesystem::exists(GetDataDir() / walletFile))
+        {
+            if (bitdb.Verify(walletFile, CWalletDB::Recover) == CDBEnv::RECOVER_FAIL)
+                return InitError(strprintf(_("%s corrupt, salvage failed"), walletFile));
+        }
+    }
+
+    // The database reads run concurrently, the rescans serialize on cs_main
+    std::vector<CWallet*> vpwallet(vFiles.size(), NULL);
+    boost::thread_group loadThreads;
+    for (unsigned int i = 0; i < vFiles.size(); i++)
+        loadThreads.create_thread(boost::bind(&LoadStakingWallet, vFiles[i], &vpwallet[i]));
+    loadThreads.join_all();
+
+    bool fLoaded = true;
+    for (unsigned int i = 0; i < vFiles.size(); i++)
+    {
+        if (!vpwallet[i]) {
+            fLoaded = false;
+            continue;
+        }
+        vpwalletStaking.push_back(vpwallet[i]);
+        // walletpassphrase only unlocks the main wallet, so an encrypted staking wallet would never stake
+        if (vpwallet[i]->IsCrypted()) {
+            InitError(strprintf(_("Staking wallet %s is encrypted, only the main wallet can be unlocked"), vFiles[i]));
+            fLoaded = false;
+            continue;
+        }
+        LogPrintf("Loaded staking wallet %s\n", vFiles[i]);
+    }
+    return fLoaded;
 }
 
 bool CWallet::ParameterInteraction()
@@ -14,6 +14,7 @@
 #include "validationinterface.h"
 #include "script/ismine.h"
 #include "wallet/crypter.h"
+#include "wallet/stakehistory.h"
 #include "wallet/walletdb.h"
 #include "wallet/rpcwallet.h"
 #include "primitives/transaction.h"
@@ -30,6 +31,8 @@
 #include <boost/shared_ptr.hpp>
 
 extern CWallet* pwalletMain;
+//! Wallets loaded with -stakingwallet, which are only used to stake
+extern std::vector<CWallet*> vpwalletStaking;
 
 /**
  * Settings
@@ -72,6 +75,7 @@ class CCoinControl;
 class COutput;
 class CReserveKey;
 class CScript;
+struct CStakeKernelInput;
 class CTxMemPool;
 class CWalletTx;
 
@@ -637,7 +641,42 @@ private:
      */
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL) const;
     bool SelectCoinsForStaking(int64_t nTargetValue, unsigned int nSpendTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
-    void AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned int nSpendTime) const;
+
+    /**
+     * Staking candidates, maintained from wallet and tip events instead of
+     * scanning mapWallet every staking round. Transactions with outputs which
+     * can stake wait in mapStakeMaturing, ordered by the time they reach
+     * nStakeMinAge, and are then moved to setStakeTxs. vStakeCandidates holds
+     * their stakable outputs, sorted by outpoint, and is only rebuilt when a
+     * wallet event marks it dirty. When the tip extends the chain the
+     * candidates are deepened in place and only the transactions in
+     * setStakeTxsWaiting, unconfirmed or immature ones, are checked again.
+     */
+    mutable std::multimap<int64_t, uint256> mapStakeMaturing;
+    mutable std::set<uint256> setStakeTxs;
+    mutable std::set<uint256> setStakeTxsWaiting;
+    mutable std::vector<COutput> vStakeCandidates;
+    mutable uint256 hashStakeCandidatesTip;
+    mutable int nStakeCandidatesHeight;
+    mutable bool fStakeCandidatesColdStaking;
+    mutable bool fStakeCandidatesDirty;
+    mutable bool fStakeCandidatesLoaded;
+
+    void QueueStakeCandidate(const CWalletTx& wtx) const;
+    bool AddStakeCandidateOutputs(const CWalletTx& wtx) const;
+    void UpdateStakeCandidates(unsigned int nSpendTime) const;
+
+    /**
+     * Rewards of the coinstakes in blocks, loaded on the first stake report
+     * and then kept up to date as wallet transactions change. Immature
+     * rewards are only filtered out when reporting.
+     */
+    mutable CStakeHistory stakeHistory;
+    mutable bool fStakeHistoryLoaded;
+
+    void UpdateStakeHistory(const CWalletTx& wtx) const;
+    void LoadStakeHistory() const;
+    bool IsReportedStake(const CStakeHistoryEntry& entry) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -722,6 +761,11 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        nStakeCandidatesHeight = -1;
+        fStakeCandidatesColdStaking = false;
+        fStakeCandidatesDirty = true;
+        fStakeCandidatesLoaded = false;
+        fStakeHistoryLoaded = false;
     }
 
     bool IsHDEnabled() const;
@@ -754,6 +798,8 @@ public:
      * populate vCoins with vector of available COutputs.
      */
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, bool fIncludeZeroValue=false, bool fIncludeColdStaking=false) const;
+    //! populate vCoins with the outputs which can stake at nSpendTime
+    void AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned int nSpendTime) const;
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
@@ -770,9 +816,25 @@ public:
     void UnlockCoin(const COutPoint& output);
     void UnlockAllCoins();
     void ListLockedCoins(std::vector<COutPoint>& vOutpts);
+    //! Rebuild the staking candidates before the next staking round
+    void MarkStakeCandidatesDirty(bool fReload = false);
     uint64_t GetStakeWeight() const;
-    bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CMutableTransaction& txNew, CKey& key);
+    /**
+     * Get the coins which can be the kernel of a coinstake at nTime, and the
+     * inputs of the kernel search for them, in the same order.
+     */
+    bool GetStakeKernelInputs(unsigned int nTime, std::vector<std::pair<const CWalletTx*,unsigned int> >& vCoinsRet, std::vector<CStakeKernelInput>& vInputsRet) const;
+    /**
+     * Create and sign a coinstake on a kernel found at nTimeKernel on top of
+     * pindexPrev. vCoins are the coins returned by GetStakeKernelInputs,
+     * which can be added as further inputs.
+     */
+    bool CreateCoinStake(const CKeyStore& keystore, const CBlockIndex* pindexPrev, const std::vector<std::pair<const CWalletTx*,unsigned int> >& vCoins, const std::pair<const CWalletTx*,unsigned int>& kernel, unsigned int nTimeKernel, int64_t nFees, CMutableTransaction& txNew, CKey& key);
     int64_t GetStake() const;
+    /** Number and sum of the rewards of the mature coinstakes with nStart <= nTime <= nEnd */
+    void GetStakeRewards(int64_t nStart, int64_t nEnd, int& nCountRet, CAmount& nTotalRet) const;
+    /** Time and reward of the latest mature coinstake, false if there is none */
+    bool GetLatestStake(int64_t& nTimeRet, CAmount& nAmountRet) const;
     int64_t GetNewMint() const;
 
     /**
@@ -987,9 +1049,15 @@ public:
     /* Returns the wallets help message */
     static std::string GetWalletHelpString(bool showDebug);
 
+    /* Loads a wallet file, returns a new CWallet instance or a null pointer in case of an error */
+    static CWallet* CreateWalletFromFile(const std::string walletFile);
+
     /* Initializes the wallet, returns a new CWallet instance or a null pointer in case of an error */
     static bool InitLoadWallet();
 
+    /* Loads the -stakingwallet files into vpwalletStaking */
+    static bool InitLoadStakingWallets();
+
     /* Wallets parameter interaction */
     static bool ParameterInteraction();
 
@@ -9,6 +9,7 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+struct CStakingRound;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
@@ -34,6 +35,7 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyStakingRound(const CStakingRound &round);
 
 protected:
     void *psocket;
@@ -26,6 +26,7 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock, const bool fConnect = true);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void StakingRound(const CStakingRound &round);
 
 private:
     CZMQNotificationInterface();
@@ -5,6 +5,7 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "stakingstats.h"
 #include "util.h"
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
@@ -13,6 +14,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_STAKINGROUND = "stakinground";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -189,3 +191,11 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishStakingRoundNotifier::NotifyStakingRound(const CStakingRound &round)
+{
+    LogPrint("zmq", "zmq: Publish stakinground %d\n", round.nSlot);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << round;
+    return SendMessage(MSG_STAKINGROUND, &(*ss.begin()), ss.size());
+}
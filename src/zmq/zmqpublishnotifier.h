@@ -52,4 +52,10 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishStakingRoundNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyStakingRound(const CStakingRound &round);
+};
+
 #endif // NAVCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H